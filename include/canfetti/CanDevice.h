@@ -1,6 +1,7 @@
 #pragma once
 #include <functional>
 #include <type_traits>
+#include <vector>
 #include "Types.h"
 
 namespace canfetti {
@@ -14,6 +15,17 @@ class CanDevice {
     size_t overruns      = 0;
   };
 
+  // Frames whose id matches id under mask are accepted. Ids above 0x7FF are
+  // 29 bit, the rest 11 bit, same as Msg::id.
+  struct RxFilter {
+    uint32_t id;
+    uint32_t mask;
+
+    static RxFilter exact(uint32_t id) { return {id, id > 0x7FF ? 0x1FFFFFFFu : 0x7FFu}; }
+    bool operator<(const RxFilter &o) const { return id != o.id ? id < o.id : mask < o.mask; }
+    bool operator==(const RxFilter &o) const { return id == o.id && mask == o.mask; }
+  };
+
   CanDevice();
 
   template <size_t N>
@@ -32,6 +44,37 @@ class CanDevice {
   // happens later; caller cannot tell whether actual write succeeds
   virtual Error write(const Msg &msg, bool async = false) = 0;
   virtual Error writePriority(const Msg &msg) { return write(msg); }
+  // Push out any frames queued by async writes, where the platform batches them
+  virtual void flush() {}
+  // Have the device itself send msg every periodMs, so cyclic frames don't
+  // depend on the stack being scheduled on time. With periodMs 0, only replace
+  // the content of a frame already being sent on msg.id.
+  virtual Error writeCyclic(const Msg &msg, uint32_t periodMs)
+  {
+    (void)msg;
+    (void)periodMs;
+    return Error::UnsupportedAccess;
+  }
+  virtual void stopCyclic(uint32_t id) { (void)id; }
+  // Have the device only deliver frames on id whose DLC or first len payload
+  // bytes differ from the last one delivered. With timeoutMs, the device also
+  // reports when no frame arrives for that long, through
+  // LocalNode::processRxTimeout().
+  virtual Error setRxChangeFilter(uint32_t id, uint8_t len, uint32_t timeoutMs)
+  {
+    (void)id;
+    (void)len;
+    (void)timeoutMs;
+    return Error::UnsupportedAccess;
+  }
+  virtual void clearRxChangeFilter(uint32_t id) { (void)id; }
+  // Only frames matching one of filters need to be delivered. Called again
+  // whenever the node's configured COB-IDs change; platforms that can't
+  // filter in hardware or the kernel may ignore it.
+  virtual void setRxFilters(const std::vector<RxFilter> &filters) { (void)filters; }
+  // Whether the bus runs CAN FD, so frames of up to MaxFdLen bytes can be
+  // sent and received
+  virtual bool fdEnabled() const { return false; }
 
   Stats stats;
 };
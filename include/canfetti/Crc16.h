@@ -0,0 +1,41 @@
+#pragma once
+#include <cstddef>
+#include <cstdint>
+#include "canfetti/System.h"
+
+// Number of 256 entry tables the CRC works through per step. Each costs 512
+// bytes; platforms with room for them raise this to 8.
+#ifndef CANFETTI_CRC16_SLICES
+  #define CANFETTI_CRC16_SLICES 1
+#endif
+
+namespace canfetti {
+
+//******************************************************************************
+// CRC-16-CCITT as used by SDO block transfers
+//
+// Polynomial 0x1021, initial value 0, no reflection and no final xor. Data may
+// be fed in pieces of any size. Up to CANFETTI_CRC16_SLICES bytes are folded
+// in per step, one independent table lookup per byte, so a whole 7 byte SDO
+// segment takes a single step with 8 slices.
+//******************************************************************************
+class Crc16 {
+ public:
+  static constexpr size_t Slices = CANFETTI_CRC16_SLICES;
+  static_assert(Slices >= 1, "Need at least one CRC table");
+
+  Crc16() = default;
+  explicit Crc16(uint16_t crc) : crc(crc) {}
+
+  void update(const uint8_t *data, size_t len) { crc = update(crc, data, len); }
+  uint16_t value() const { return crc; }
+  void reset() { crc = 0; }
+
+  static uint16_t update(uint16_t crc, const uint8_t *data, size_t len);
+  static uint16_t compute(const uint8_t *data, size_t len) { return update(0, data, len); }
+
+ private:
+  uint16_t crc = 0;
+};
+
+}  // namespace canfetti
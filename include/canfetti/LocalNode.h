@@ -9,6 +9,7 @@
 #include "services/Nmt.h"
 #include "services/Pdo.h"
 #include "services/Sdo.h"
+#include "services/Sync.h"
 
 namespace canfetti {
 
@@ -19,6 +20,10 @@ class LocalNode : public Node {
   Error init();
   inline void setSDOServerTimeout(uint32_t timeoutMs) { sdo.setServerSegmentTimeout(timeoutMs); }
   inline size_t getActiveTransactionCount() { return sdo.getActiveTransactionCount(); }
+  inline const SdoService::Stats &getSdoStats() { return sdo.getStats(); }
+  // Cancel an SDO read or write by the id it handed back; see SdoService::clientTransaction()
+  inline Error cancelSdo(SdoService::TransactionId id) { return sdo.cancelTransaction(id); }
+  inline void setSdoQueueDepth(size_t depth) { sdo.setClientQueueDepth(depth); }
   inline Error addSDOServer(uint16_t rxCobid, uint16_t txCobid, uint8_t clientId) { return sdo.addSDOServer(rxCobid, txCobid, clientId); }
   inline Error addSDOClient(uint32_t txCobid, uint16_t rxCobid, uint8_t serverId) { return sdo.addSDOClient(txCobid, rxCobid, serverId); }
   inline Error addSDOServer(uint8_t sdoId, uint8_t remoteNode) { return sdo.addSDOServer(0x600 + sdoId, 0x580 + sdoId, remoteNode); }
@@ -28,6 +33,12 @@ class LocalNode : public Node {
   inline Error updateTpdoEventTime(uint16_t pdoNum, uint16_t periodMs) { return pdo.updateTpdoEventTime(0x1800 + pdoNum, periodMs); }
   inline Error disableTPDO(uint16_t pdoNum) { return pdo.disablePdo(0x1800 + pdoNum); }
   inline Error enableTPDO(uint16_t pdoNum) { return pdo.enablePdo(0x1800 + pdoNum); }
+  inline Error setTpdoTransmissionType(uint16_t pdoNum, uint8_t type) { return pdo.setTransmissionType(0x1800 + pdoNum, type); }
+  inline Error setTpdoInhibitTime(uint16_t pdoNum, uint16_t inhibitTime100us) { return pdo.setInhibitTime(0x1800 + pdoNum, inhibitTime100us); }
+  inline Error setTpdoChangeOfState(uint16_t pdoNum, bool enable) { return pdo.setChangeOfState(0x1800 + pdoNum, enable); }
+  inline Error setRpdoTransmissionType(uint16_t cobid, uint8_t type) { return pdo.setRpdoTransmissionType(cobid, type); }
+  inline Error setSyncProducer(uint16_t periodMs, uint8_t counterOverflow = 0) { return sync.setProducer(periodMs, counterOverflow); }
+  inline Error registerSyncCallback(SyncService::SyncCb cb) { return sync.addSyncCallback(cb); }
   inline Error setHeartbeatPeriod(uint16_t periodMs) { return nmt.setHeartbeatPeriod(periodMs); }
   inline Error setRemoteTimeout(uint8_t node, uint16_t timeoutMs) { return nmt.setRemoteTimeout(node, timeoutMs); }
   inline Error addRPDO(uint16_t cobid, const std::tuple<uint16_t, uint8_t> *mapping, size_t numMapping, uint16_t timeoutMs = 0, PdoService::TimeoutCb cb = nullptr) { return pdo.addRPDO(cobid, mapping, numMapping, timeoutMs, cb); }
@@ -39,6 +50,8 @@ class LocalNode : public Node {
   inline Error clearEmcy(uint16_t error, EmcyService::ErrorType type = EmcyService::ErrorType::Generic) { return emcy.clearEmcy(error, type); }
   inline const char *getDeviceName() { return deviceName; }
   Error setState(State s);
+  // Recompute the frames this node receives and hand them to the bus
+  void rxFiltersChanged() override;
   canfetti::Error registerEmcyCallback(EmcyService::EmcyCallback cb) { return emcy.registerCallback(cb); }
 
   template <typename... Args>
@@ -75,7 +88,7 @@ class LocalNode : public Node {
   Error registerRemoteStateCb(uint8_t node, NmtService::RemoteStateCb cb) { return nmt.addRemoteStateCb(node, cb); }
 
   template <typename T>
-  inline Error read(uint8_t node, uint16_t idx, uint8_t subIdx, std::function<void(Error e, T &)> cb, uint32_t segmentTimeout = SdoService::DefaultSegmentXferTimeoutMs)
+  inline Error read(uint8_t node, uint16_t idx, uint8_t subIdx, std::function<void(Error e, T &)> cb, uint32_t segmentTimeout = SdoService::DefaultSegmentXferTimeoutMs, uint32_t queueTimeout = 0, SdoService::TransactionId *id = nullptr)
   {
     OdVariant *v = new OdVariant(T());
 
@@ -86,7 +99,7 @@ class LocalNode : public Node {
     Error err = sdo.clientTransaction(true, node, idx, subIdx, *v, segmentTimeout, [=](Error e) {
       if (cb) cb(e, *std::get_if<T>(v));
       delete v;
-    });
+    }, queueTimeout, id);
 
     if (err != Error::Success) {
       delete v;
@@ -95,7 +108,7 @@ class LocalNode : public Node {
   }
 
   template <typename T>
-  inline Error readData(uint8_t node, uint16_t idx, uint8_t subIdx, T &&data, std::function<void(Error e)> cb, uint32_t segmentTimeout = SdoService::DefaultSegmentXferTimeoutMs)
+  inline Error readData(uint8_t node, uint16_t idx, uint8_t subIdx, T &&data, std::function<void(Error e)> cb, uint32_t segmentTimeout = SdoService::DefaultSegmentXferTimeoutMs, uint32_t queueTimeout = 0, SdoService::TransactionId *id = nullptr)
   {
     OdVariant *v = new OdVariant(data);
 
@@ -106,7 +119,7 @@ class LocalNode : public Node {
     Error err = sdo.clientTransaction(true, node, idx, subIdx, *v, segmentTimeout, [=](Error e) {
       if (cb) cb(e);
       delete v;
-    });
+    }, queueTimeout, id);
 
     if (err != Error::Success) {
       delete v;
@@ -115,7 +128,7 @@ class LocalNode : public Node {
   }
 
   template <typename T>
-  Error write(uint8_t node, uint16_t idx, uint8_t subIdx, T &&data, std::function<void(Error e)> cb, uint32_t segmentTimeout = SdoService::DefaultSegmentXferTimeoutMs)
+  Error write(uint8_t node, uint16_t idx, uint8_t subIdx, T &&data, std::function<void(Error e)> cb, uint32_t segmentTimeout = SdoService::DefaultSegmentXferTimeoutMs, uint32_t queueTimeout = 0, SdoService::TransactionId *id = nullptr)
   {
     OdVariant *v = new OdVariant(data);
 
@@ -126,7 +139,7 @@ class LocalNode : public Node {
     Error err = sdo.clientTransaction(false, node, idx, subIdx, *v, segmentTimeout, [=](Error e) {
       if (cb) cb(e);
       delete v;
-    });
+    }, queueTimeout, id);
 
     if (err != Error::Success) {
       delete v;
@@ -137,6 +150,8 @@ class LocalNode : public Node {
  protected:
   LocalNode(CanDevice &d, System &sys, uint8_t nodeId, const char *deviceName, uint32_t deviceType);
   void processFrame(const Msg &m);
+  // No frame arrived on id within the timeout given to the device's change filter
+  inline void processRxTimeout(uint32_t id) { pdo.processRxTimeout(id); }
 
   template <typename Arg>
   canfetti::Error _autoInsertAll(std::vector<std::tuple<uint16_t, uint8_t>> &map, canfetti::Access access, Arg &&arg)
@@ -159,8 +174,10 @@ class LocalNode : public Node {
   PdoService pdo;
   SdoService sdo;
   EmcyService emcy;
+  SyncService sync;
   const char *deviceName;
   uint32_t deviceType;
+  bool initialized = false;  // Filters are first applied once init() is done
 };
 
 }  // namespace canfetti
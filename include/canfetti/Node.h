@@ -15,6 +15,8 @@ class Node {
 
   virtual Error setState(State s) = 0;
   State getState() const { return state; }
+  // Services call this after changing a COB-ID they receive on
+  virtual void rxFiltersChanged() {}
 
  protected:
   State state = State::Bootup;
@@ -1,23 +1,39 @@
 #pragma once
 
 #include <array>
-#include <map>
+#include <deque>
 #include <tuple>
 #include <type_traits>
 #include <utility>
+#include <vector>
 #include "canfetti/OdData.h"
+#include "canfetti/StaticOd.h"
 #include "canfetti/System.h"
 
 namespace canfetti {
 
 class ObjDict {
  public:
-  using OdTable = std::map<uint16_t, std::map<uint8_t, OdEntry>>;
+  ObjDict() = default;
+  ObjDict(const ObjDict &) = delete;
+  ObjDict &operator=(const ObjDict &) = delete;
+  ~ObjDict();
+
+  // Attach a compile-time table from makeStaticOd(). Only one table may be
+  // attached; its rows share the index with entries inserted at runtime.
+  template <size_t N>
+  Error attachStatic(const std::array<StaticOdEntry, N> &table, StaticOdStorage<N> &storage)
+  {
+    return attachStatic(table.data(), N, storage.rows);
+  }
 
   void dumpTable();
   Error registerCallback(uint16_t idx, uint8_t subIdx, ChangedCallback cb);
   Error fireCallbacks(uint16_t idx, uint8_t subIdx);
   Error generation(uint16_t idx, uint8_t subIdx, uint32_t &generationOut);
+  // When the entry was last written by an RPDO; see Msg::timestamp. Meant for
+  // ChangedCallbacks to judge how fresh the value is.
+  Error rxTimestamp(uint16_t idx, uint8_t subIdx, uint64_t &timestampOut);
   std::tuple<Error, OdProxy> makeProxy(uint16_t idx, uint8_t subIdx);
 
   template <typename T>
@@ -26,7 +42,7 @@ class ObjDict {
     if (OdEntry *entry = lookup(idx, subIdx)) {
       if constexpr (std::is_same_v<T, OdBuffer>) {
         if (entry->lock()) {
-          OdProxy src(idx, subIdx, entry->data);
+          OdProxy src = view(*entry);
           OdProxy dst(idx, subIdx, v);
           dst.copyFrom(src);
           entry->unlock();
@@ -35,7 +51,7 @@ class ObjDict {
         return Error::Timeout;
       }
       else {
-        if (T *p = std::get_if<T>(&entry->data)) {
+        if (T *p = entry->get_if<T>()) {
           if (entry->lock()) {
             v = *p;
             entry->unlock();
@@ -57,18 +73,19 @@ class ObjDict {
     if (OdEntry *entry = lookup(idx, subIdx)) {
       if constexpr (std::is_same_v<T, OdBuffer>) {
         if (entry->lock()) {
-          OdProxy dst(idx, subIdx, entry->data);
+          OdProxy dst = view(*entry);
           OdProxy src(idx, subIdx, v);
           dst.copyFrom(src);
 
           entry->unlock();
+          entry->bumpGeneration();
           entry->fireCallbacks();
           return Error::Success;
         }
         return Error::Timeout;
       }
       else {
-        if (auto p = std::get_if<T>(&entry->data)) {
+        if (auto p = entry->get_if<T>()) {
           if (entry->lock()) {
             *p = v;
             entry->unlock();
@@ -86,6 +103,19 @@ class ObjDict {
     return Error::IndexNotFound;
   }
 
+  // Resolve an entry once for repeated access through the returned handle
+  template <typename T>
+  std::tuple<Error, OdRef<T>> resolve(uint16_t idx, uint8_t subIdx)
+  {
+    if (OdEntry *entry = lookup(idx, subIdx)) {
+      if (T *p = entry->get_if<T>()) {
+        return std::make_tuple(Error::Success, OdRef<T>(*entry, *p));
+      }
+      return std::make_tuple(Error::ParamIncompatibility, OdRef<T>());
+    }
+    return std::make_tuple(Error::IndexNotFound, OdRef<T>());
+  }
+
   template <typename T>
   CANFETTI_NO_INLINE Error insert(uint16_t idx, uint8_t subIdx, canfetti::Access access, T &&v, ChangedCallback cb = nullptr, bool cbOnInsert = false)
   {
@@ -159,17 +189,39 @@ class ObjDict {
   inline size_t entrySize(uint16_t idx, uint8_t subIdx)
   {
     auto entry = lookup(idx, subIdx);
-    return entry ? canfetti::size(entry->data) : 0;
+    return entry ? entry->size() : 0;
   }
 
- protected:
-  OdTable table;
+  // Entries are never removed, so the returned pointer is valid for the
+  // lifetime of the ObjDict
   OdEntry *lookup(uint16_t idx, uint8_t subIdx);
 
+ protected:
+  static constexpr uint32_t EmptySlot = UINT32_MAX;  // Never a valid key; keys are 24 bits
+  static constexpr uint32_t makeKey(uint16_t idx, uint8_t subIdx) { return (static_cast<uint32_t>(idx) << 8) | subIdx; }
+
+  // Entries are never removed, so the deque gives them a stable address while
+  // lookups hit an open-addressed table of contiguous keys (linear probing,
+  // load factor <= 1/2). Rows of the static table are indexed the same way.
+  std::deque<OdRuntimeEntry> entries;
+  std::vector<uint32_t> slotKeys;
+  std::vector<OdEntry *> slotEntries;  // Parallel to slotKeys
+  size_t indexed = 0;  // Keys in the index, runtime and static
+
+  StaticOdRow *staticRows = nullptr;
+  size_t staticCount      = 0;
+
+  Error attachStatic(const StaticOdEntry *table, size_t n, StaticOdRow *rows);
+  // Unlocked proxy over an entry's value, for copying a whole OdBuffer
+  static OdProxy view(OdEntry &entry);
+  void addToIndex(uint32_t key, OdEntry *entry);
+  void growIndex();
+
   template <typename... Args>
-  constexpr void buildSubEntry(uint16_t idx, uint8_t subIdx, Args &&...args)
+  void buildSubEntry(uint16_t idx, uint8_t subIdx, Args &&...args)
   {
-    table[idx].emplace(std::piecewise_construct, std::forward_as_tuple(subIdx), std::forward_as_tuple(idx, subIdx, std::forward<Args>(args)...));
+    entries.emplace_back(idx, subIdx, std::forward<Args>(args)...);
+    addToIndex(makeKey(idx, subIdx), &entries.back());
   }
 };
 
@@ -1,6 +1,8 @@
 #pragma once
 
 #include <functional>
+#include <memory>
+#include <new>
 #include <string>
 #include <type_traits>
 #include <variant>
@@ -51,12 +53,37 @@ enum class Access {
 
 using ChangedCallback = std::function<void(uint16_t idx, uint8_t subIdx)>;
 
-struct OdEntry {
-  OdEntry(uint16_t i, uint8_t s, Access a, OdVariant d, ChangedCallback cb = nullptr);
+// Reference to a variable with static storage duration
+struct StaticOdRef {
+  void *buf;
+  size_t len;
+};
+
+using StaticOdValue = std::variant<int8_t, uint8_t,
+                                   uint16_t, int16_t,
+                                   uint32_t, int32_t,
+                                   uint64_t, int64_t,
+                                   float, StaticOdRef>;
+
+// Row of a compile-time table; see StaticOd.h
+struct StaticOdEntry {
+  uint32_t key;  // (idx << 8) | subIdx
+  Access access;
+  StaticOdValue value;
+
+  constexpr uint16_t idx() const { return key >> 8; }
+  constexpr uint8_t subIdx() const { return key & 0xff; }
+};
+
+struct OdRuntimeEntry;
+
+// State of an entry held in RAM, whichever kind it is: inserted at runtime
+// with its value in an OdVariant (OdRuntimeEntry), or a row of a static table
+// whose descriptor stays in flash (StaticOdRow)
+class OdEntry {
+ public:
   OdEntry(OdEntry &&o)      = delete;
   OdEntry(const OdEntry &o) = delete;
-  Access access;
-  OdVariant data;
 
   bool lock();
   void unlock();
@@ -65,13 +92,131 @@ struct OdEntry {
   void addCallback(ChangedCallback cb);
   inline unsigned generation() { return generation_; }
   inline void bumpGeneration() { generation_ = newGeneration(); }
+  inline uint16_t idx() const { return key >> 8; }
+  inline uint8_t subIdx() const { return key & 0xff; }
+
+  // The value if it is held as a T
+  template <typename T>
+  T *get_if();
+  // Calls f with the value, a static row's reference passed as an OdBuffer
+  template <typename F>
+  void visit(F &&f);
+  // Runtime entries' value, nullptr for a static row
+  inline OdVariant *variant();
+  // Plain memory holding the value, nullptr if it's resizable or dynamic
+  uint8_t *buffer();
+  size_t size();
+
+  // Msg::timestamp of the last RPDO that wrote this entry, 0 if none has
+  uint64_t rxTimestamp = 0;
+  Access access        = Access::RO;
+
+ protected:
+  OdEntry() = default;
+  OdEntry(uint16_t i, uint8_t s, Access a) : access(a), key((static_cast<uint32_t>(i) << 8) | s) {}
+
+  // Ordered to pack: every static row pays for this
+  bool locked               = false;
+  uint32_t key              = 0;
+  unsigned generation_      = newGeneration();
+  const StaticOdEntry *desc = nullptr;  // Set for static rows
+  std::unique_ptr<std::vector<ChangedCallback>> callbacks;
+};
+
+struct OdRuntimeEntry : OdEntry {
+  OdRuntimeEntry(uint16_t i, uint8_t s, Access a, OdVariant d, ChangedCallback cb = nullptr);
+  OdVariant data;
+};
+
+// RAM state of a row of a static table. Scalars are copied into value so they
+// can be written; references leave it unused.
+class StaticOdRow : public OdEntry {
+ public:
+  StaticOdRow() = default;
+  void attach(const StaticOdEntry &d);
+  void detach();
 
  private:
-  const uint16_t idx;
-  const uint8_t subIdx;
-  bool locked          = false;
-  unsigned generation_ = newGeneration();
-  std::vector<ChangedCallback> callbacks;
+  friend class OdEntry;
+  alignas(uint64_t) uint8_t value[sizeof(uint64_t)];
+};
+
+inline OdVariant *OdEntry::variant()
+{
+  return desc ? nullptr : &static_cast<OdRuntimeEntry *>(this)->data;
+}
+
+template <typename T>
+T *OdEntry::get_if()
+{
+  if (!desc) return std::get_if<T>(&static_cast<OdRuntimeEntry *>(this)->data);
+
+  if constexpr (std::is_arithmetic_v<T>) {
+    if (std::holds_alternative<T>(desc->value)) {
+      return std::launder(reinterpret_cast<T *>(static_cast<StaticOdRow *>(this)->value));
+    }
+  }
+
+  return nullptr;
+}
+
+template <typename F>
+void OdEntry::visit(F &&f)
+{
+  if (!desc) return std::visit(f, static_cast<OdRuntimeEntry *>(this)->data);
+
+  auto g = [&](auto &&arg) {
+    using T = std::decay_t<decltype(arg)>;
+
+    if constexpr (std::is_same_v<T, StaticOdRef>) {
+      OdBuffer b(arg.buf, arg.len);
+      f(b);
+    }
+    else {
+      f(*get_if<T>());
+    }
+  };
+
+  std::visit(g, desc->value);
+}
+
+// Typed handle to an entry resolved once through ObjDict::resolve(). Skips the
+// lookup and variant type check on every access; valid for the lifetime of the
+// ObjDict since entries are never removed or retyped.
+template <typename T>
+class OdRef {
+  static_assert(!std::is_same_v<T, OdBuffer> && !std::is_same_v<T, OdDynamicVar>, "Use an OdProxy for buffer and dynamic entries");
+
+ public:
+  OdRef() = default;
+  OdRef(OdEntry &e, T &v) : entry(&e), value(&v) {}
+
+  explicit operator bool() const { return entry != nullptr; }
+  inline unsigned generation() const { return entry ? entry->generation() : 0; }
+
+  Error get(T &v) const
+  {
+    if (!entry) return Error::IndexNotFound;
+    if (!entry->lock()) return Error::Timeout;
+    v = *value;
+    entry->unlock();
+    return Error::Success;
+  }
+
+  Error set(const T &v)
+  {
+    if (!entry) return Error::IndexNotFound;
+    if (!entry->lock()) return Error::Timeout;
+    *value = v;
+    entry->unlock();
+    entry->bumpGeneration();
+    entry->fireCallbacks();
+    return Error::Success;
+  }
+
+ private:
+  OdEntry *entry = nullptr;
+  T *value       = nullptr;
 };
 
 class OdProxy {
@@ -80,6 +225,7 @@ class OdProxy {
   OdProxy(uint16_t, uint8_t, const OdVariant &);
   OdProxy(uint16_t, uint8_t, OdVariant &);
   OdProxy(uint16_t, uint8_t, OdEntry &);
+  OdProxy(uint16_t, uint8_t, uint8_t *buf, size_t len);  // Plain memory, no entry
   OdProxy(OdProxy &&);
   OdProxy(const OdProxy &)            = delete;
   OdProxy &operator=(OdProxy &&)      = delete;
@@ -87,11 +233,15 @@ class OdProxy {
   ~OdProxy();
 
   bool resize(size_t newSize);
+  // Whether resize() can succeed, i.e. the size isn't fixed by the type
+  bool resizable();
   Error copyInto(uint8_t *b, size_t s);  // Copy from variant
   Error copyFrom(uint8_t *b, size_t s);  // Write to variant
   Error copyFrom(const OdProxy &other);
   Error reset();
   size_t remaining();
+  size_t offset() const { return off; }
+  Error seek(size_t offset);
   void suppressCallbacks();
   void senderIsFinished() { sender_is_finished = true; }
 
@@ -110,6 +260,8 @@ class OdProxy {
   size_t off               = 0;
   size_t len               = 0;
   OdDynamicVar *dVar       = nullptr;
+  uint8_t *base            = nullptr;  // Plain memory when there's no variant
+  size_t baseLen           = 0;
 };
 
 template <typename E>
@@ -0,0 +1,77 @@
+#pragma once
+
+#include <cstddef>
+#include <cstdint>
+
+namespace canfetti {
+
+//******************************************************************************
+// Deterministic phase offsets for periodic timers
+//
+// Slot k of a period is offset into it by the k-th value of the base-2 van der
+// Corput sequence (0, 1/2, 1/4, 3/4, 1/8, ...). Timers take the lowest free
+// slot and give it back when deleted, so however many timers share a period,
+// and however often they're re-created, their deadlines stay spread evenly
+// across it and e.g. TPDOs with equal periods don't all hit the bus together.
+//******************************************************************************
+class PhaseSlots {
+ public:
+  static constexpr size_t MaxPeriods = 16;
+  static constexpr uint8_t MaxSlots  = 32;  // Per period
+  static constexpr uint8_t NoSlot    = 0xff;
+
+  // Take the lowest free slot for period. NoSlot when out of room, which
+  // leaves the timer at offset 0.
+  uint8_t acquire(uint32_t period)
+  {
+    Period *p = find(period);
+    if (!p) p = find(0);
+    if (!p) return NoSlot;
+
+    for (uint8_t slot = 0; slot < MaxSlots; ++slot) {
+      if (!(p->used & (1u << slot))) {
+        p->period = period;
+        p->used |= 1u << slot;
+        return slot;
+      }
+    }
+
+    return NoSlot;
+  }
+
+  void release(uint32_t period, uint8_t slot)
+  {
+    if (slot == NoSlot) return;
+    if (Period *p = find(period)) {
+      p->used &= ~(1u << slot);
+      if (!p->used) p->period = 0;
+    }
+  }
+
+  static constexpr uint32_t offset(uint32_t slot, uint32_t period)
+  {
+    uint32_t reversed = 0;
+    for (int i = 0; i < 32; ++i, slot >>= 1) {
+      reversed = (reversed << 1) | (slot & 1);
+    }
+    return (static_cast<uint64_t>(period) * reversed) >> 32;
+  }
+
+ private:
+  struct Period {
+    uint32_t period = 0;  // 0 when unused
+    uint32_t used   = 0;  // Bit per slot
+  };
+
+  Period *find(uint32_t period)
+  {
+    for (auto &p : periods) {
+      if (p.period == period) return &p;
+    }
+    return nullptr;
+  }
+
+  Period periods[MaxPeriods];
+};
+
+}  // namespace canfetti
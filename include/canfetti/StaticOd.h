@@ -0,0 +1,86 @@
+#pragma once
+
+#include <array>
+#include "canfetti/OdData.h"
+
+namespace canfetti {
+
+//******************************************************************************
+// Compile-time object dictionary tables
+//
+// Entries are declared with odEntry()/odRef() and passed through makeStaticOd(),
+// which sorts them at compile time so the table can live in flash. Only each
+// row's mutable state takes RAM, in storage the caller provides:
+//
+//   static float temperatureC;
+//   static constexpr auto StaticOd = canfetti::makeStaticOd({
+//       canfetti::odRef(0x2000, 0, canfetti::Access::RO, temperatureC),
+//       canfetti::odEntry(0x2001, 0, canfetti::Access::RW, canfetti::_u16(10)),
+//   });
+//   static canfetti::StaticOdStorage<StaticOd.size()> staticOdStorage;
+//
+//   co.od.attachStatic(StaticOd, staticOdStorage);
+//******************************************************************************
+
+// RAM for the entries of a static table: a StaticOdRow each, holding the lock,
+// generation and callbacks, plus the value for rows that aren't references.
+// Statically allocate one per table.
+template <size_t N>
+struct StaticOdStorage {
+  StaticOdRow rows[N];
+};
+
+template <typename T>
+constexpr StaticOdEntry odEntry(uint16_t idx, uint8_t subIdx, Access access, T value)
+{
+  return StaticOdEntry{(static_cast<uint32_t>(idx) << 8) | subIdx, access, StaticOdValue(value)};
+}
+
+template <typename T>
+constexpr StaticOdEntry odRef(uint16_t idx, uint8_t subIdx, Access access, T &var)
+{
+  return StaticOdEntry{(static_cast<uint32_t>(idx) << 8) | subIdx, access, StaticOdValue(StaticOdRef{&var, sizeof(T)})};
+}
+
+// Not constexpr: evaluating it while building a table is a compile error
+void staticOdDuplicateEntry();
+
+template <size_t N>
+constexpr std::array<StaticOdEntry, N> makeStaticOd(const StaticOdEntry (&entries)[N])
+{
+  std::array<StaticOdEntry, N> sorted = {};
+
+  // Insertion sort; tables are small and usually declared in order
+  for (size_t i = 0; i < N; ++i) {
+    size_t j = i;
+    for (; j > 0 && sorted[j - 1].key > entries[i].key; --j) {
+      sorted[j] = sorted[j - 1];
+    }
+    if (j > 0 && sorted[j - 1].key == entries[i].key) {
+      staticOdDuplicateEntry();
+    }
+    sorted[j] = entries[i];
+  }
+
+  return sorted;
+}
+
+constexpr const StaticOdEntry *findStaticOdEntry(const StaticOdEntry *table, size_t n, uint16_t idx, uint8_t subIdx)
+{
+  const uint32_t key = (static_cast<uint32_t>(idx) << 8) | subIdx;
+  size_t lo = 0, hi = n;
+
+  while (lo < hi) {
+    size_t mid = lo + (hi - lo) / 2;
+    if (table[mid].key < key) {
+      lo = mid + 1;
+    }
+    else {
+      hi = mid;
+    }
+  }
+
+  return lo < n && table[lo].key == key ? &table[lo] : nullptr;
+}
+
+}  // namespace canfetti
@@ -126,11 +126,35 @@ struct LogDebug {
 template <typename... Ts>
 LogDebug(const char* f, Ts&&...) -> LogDebug<Ts...>;
 
+// Classic CAN carries up to 8 data bytes, CAN FD up to 64
+static constexpr uint8_t MaxClassicLen = 8;
+static constexpr uint8_t MaxFdLen      = 64;
+
+// Smallest CAN FD payload length holding len bytes. Past 8 bytes, FD frames
+// only come in 12, 16, 20, 24, 32, 48 and 64.
+constexpr uint8_t fdPayloadLen(uint8_t len)
+{
+  if (len <= 8) return len;
+  if (len <= 24) return (len + 3) & ~3;
+  if (len <= 32) return 32;
+  if (len <= 48) return 48;
+  return 64;
+}
+
 struct Msg {
   uint32_t id;
   bool rtr;
   uint8_t len;
   uint8_t* data;
+  // When the frame was received, in ns on the platform's receive clock
+  // (CLOCK_REALTIME on Linux). 0 if unknown, and for frames being sent.
+  uint64_t timestamp = 0;
+  // When the adapter received the frame, in ns on its own hardware clock,
+  // which need not track the platform's. 0 if the adapter doesn't provide one.
+  uint64_t hwTimestamp = 0;
+  // A CAN FD frame, whose len may be up to MaxFdLen. Devices send frames
+  // longer than MaxClassicLen as FD either way.
+  bool fd = false;
 
   inline uint16_t getFunction() const { return id & (0xF << 7); }
   inline uint8_t getNode() const { return id & ((1 << 7) - 1); }
@@ -26,6 +26,7 @@ class EmcyService : public canfetti::Service {
   canfetti::Error sendEmcy(uint16_t error, std::array<uint8_t, 5> &specific, ErrorType type);
   canfetti::Error clearEmcy(uint16_t error, ErrorType type);
   canfetti::Error registerCallback(EmcyCallback cb);
+  void addRxFilters(std::vector<CanDevice::RxFilter> &filters) override;
 
  private:
   EmcyCallback cb = nullptr;
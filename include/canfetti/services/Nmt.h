@@ -19,6 +19,7 @@ class NmtService : public canfetti::Service {
   canfetti::Error sendHeartbeat();
   canfetti::Error processMsg(const canfetti::Msg &msg);
   canfetti::Error processHeartbeat(const canfetti::Msg &msg);
+  void addRxFilters(std::vector<CanDevice::RxFilter> &filters) override;
   canfetti::Error setRemoteState(uint8_t node, canfetti::SlaveState state);
   std::tuple<canfetti::Error, canfetti::State> getRemoteState(uint8_t node);
 
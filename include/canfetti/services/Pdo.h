@@ -1,8 +1,16 @@
 #pragma once
+#include <array>
 #include <unordered_map>
+#include <unordered_set>
 #include <vector>
 #include "Service.h"
 
+// Platforms with CAN FD raise this to MaxFdLen. Every PDO's compiled plan is
+// sized for it.
+#ifndef CANFETTI_MAX_PDO_LEN
+  #define CANFETTI_MAX_PDO_LEN 8
+#endif
+
 namespace canfetti {
 
 class PdoService : public Service {
@@ -21,15 +29,119 @@ class PdoService : public Service {
   Error addRPDO(uint16_t cobid, const std::tuple<uint16_t, uint8_t> *mapping, size_t numMapping, uint16_t timeoutMs, PdoService::TimeoutCb cb);
   Error addTPDO(uint16_t pdoNum, uint16_t cobid, const std::tuple<uint16_t, uint8_t> *mapping, size_t numMapping, uint16_t periodMs, bool enabled);
   Error updateTpdoEventTime(uint16_t paramIdx, uint16_t periodMs);
+  Error setTransmissionType(uint16_t paramIdx, uint8_t transmissionType);
+  Error setInhibitTime(uint16_t paramIdx, uint16_t inhibitTime100us);
+  Error setChangeOfState(uint16_t paramIdx, bool enable);
+  Error setRpdoTransmissionType(uint16_t cobid, uint8_t transmissionType);
+  Error processSync(uint8_t counter);
+  Error processRxTimeout(uint32_t cobid);
+  void addRxFilters(std::vector<CanDevice::RxFilter> &filters) override;
 
  private:
+  static constexpr size_t MaxPdoLen   = CANFETTI_MAX_PDO_LEN;
+  static constexpr size_t MaxMappings = MaxPdoLen;  // 1 per payload byte
+  static_assert(MaxPdoLen >= MaxClassicLen && MaxPdoLen <= MaxFdLen);
+
+  // A PDO's communication and mapping parameters compiled down to the entries
+  // and payload bytes they cover. Rebuilt only when those parameters change.
+  struct Plan {
+    struct Step {
+      OdEntry *entry;
+      uint8_t *data;  // nullptr if the entry has to be accessed through an OdProxy
+      uint16_t idx;
+      uint8_t subIdx;
+      uint8_t offset;
+      uint8_t len;
+      unsigned sentGeneration;  // Entry generation when last packed into a TPDO
+    };
+
+    bool valid               = false;
+    bool direct              = false;  // Every step is plain memory
+    uint32_t cobid           = 0;
+    uint8_t transmissionType = 0;
+    uint8_t len              = 0;
+    uint8_t numSteps         = 0;
+    uint16_t inhibitTime     = 0;      // 100 us units
+    uint8_t syncCount        = 0;      // SYNCs since a synchronous TPDO was last sent
+    bool latched             = false;  // A synchronous RPDO is waiting for the next SYNC
+    uint8_t latchedLen       = 0;
+    uint8_t latchedData[MaxPdoLen];
+    uint64_t latchedTimestamp = 0;
+    Step steps[MaxMappings];
+
+    // Event-driven TPDO state, kept across rebuilds
+    bool changeOfState            = false;  // Send when a mapped entry changes
+    bool inhibited                = false;
+    bool eventPending             = false;  // Send once the inhibit time expires
+    unsigned inhibitGeneration    = 0;
+    System::TimerHdl inhibitTimer = System::InvalidTimer;
+  };
+
+  // RPDO dispatch by COB-ID. IDs in the range LocalNode routes to PDOs are
+  // direct-indexed; anything else (i.e. 29-bit IDs) is hashed. Values are RPDO
+  // param indices, with RPDOs sharing a COB-ID chained through nextRpdo.
+  static constexpr uint32_t DirectCobidBase  = 0x180;
+  static constexpr uint32_t DirectCobidCount = 0x580 - DirectCobidBase;
+  static constexpr uint16_t RpdoParamBase    = 0x1400;
+
   bool pdoEnabled = false;
+  std::unordered_map<uint16_t, Plan> plans;
+  std::array<uint16_t, DirectCobidCount> rpdoByCobid = {};
+  std::unordered_map<uint32_t, uint16_t> rpdoByExtCobid;
+  std::vector<uint16_t> nextRpdo;
+  std::vector<uint16_t> latchedRpdos;
+  std::vector<uint16_t> applyingRpdos;  // latchedRpdos as of the current SYNC
+  std::unordered_set<uint64_t> cosWatches;  // (paramIdx << 24) | (idx << 8) | subIdx
   std::vector<uint16_t> configuredTPDONums;
   std::unordered_map<uint16_t, System::TimerHdl> tpdoTimers;
-  std::unordered_map<uint16_t, std::tuple<System::TimerHdl, unsigned /* generation */, uint16_t /* periodMs */, TimeoutCb>> rpdoTimers;
+  std::unordered_map<uint16_t, uint32_t> cyclicTpdos;  // TPDO param index -> COB-ID the device is sending it on
+
+  // RPDO COB-IDs the device only delivers on change, and supervises
+  struct RxChangeFilter {
+    uint8_t len        = 0;
+    uint16_t timeoutMs = 0;
+    bool operator==(const RxChangeFilter &o) const { return len == o.len && timeoutMs == o.timeoutMs; }
+  };
+  std::unordered_map<uint32_t, RxChangeFilter> rxChangeFilters;
+
+  // RPDO timeout supervision. Each frame just pushes its RPDO's deadline out;
+  // one periodic sweep, ticking at a fraction of the shortest timeout, finds
+  // the ones that passed.
+  static constexpr uint16_t SweepsPerTimeout = 10;
+
+  struct RpdoDeadline {
+    TimeoutCb cb;
+    uint16_t cobid;
+    uint16_t periodMs     = 0;  // 0 when not supervised
+    uint32_t timeoutTicks = 0;  // One more than the period, as ticks count from before the frame
+    uint32_t deadline     = 0;  // In sweep ticks
+    bool expired          = false;
+  };
+
+  std::unordered_map<uint16_t, RpdoDeadline> rpdoDeadlines;  // Keyed by RPDO param index
+  System::TimerHdl sweepTimer = System::InvalidTimer;
+  uint16_t sweepPeriodMs      = 0;
+  uint32_t sweepTick          = 0;
+  std::vector<uint16_t> expiredRpdos;
   void enableTpdoEvent(uint16_t idx);
+  bool startCyclicTpdo(uint16_t paramIdx, uint16_t periodMs);
+  void stopCyclicTpdo(uint16_t paramIdx);
   void enableRpdoEvent(uint16_t idx);
-  void rpdoTimeout(unsigned generation, uint16_t idx);
+  void updateDeadlineSweep();
+  void updateRxChangeFilters();
+  void sweepRpdoDeadlines();
+  void invalidatePlan(uint16_t paramIdx);
+  void watchMappedEntries(uint16_t paramIdx);
+  void mappedEntryChanged(uint16_t paramIdx);
+  Error sendEventTpdo(uint16_t paramIdx, bool restartEventTimer);
+  void inhibitExpired(unsigned generation, uint16_t paramIdx);
+  void rebuildRpdoDispatch();
+  uint16_t findRpdo(uint32_t cobid);
+  std::tuple<Error, Plan *> getPlan(uint16_t paramIdx, bool tx);
+  // Payload bytes a PDO may map on this bus
+  size_t maxPdoLen() const { return co.bus.fdEnabled() ? MaxPdoLen : MaxClassicLen; }
+  Error packTxPdo(Plan &plan, uint8_t *payload, uint8_t &len);
+  Error applyRxPdo(Plan &plan, const uint8_t *payload, uint8_t len, uint64_t timestamp);
   Error addPdoEntry(uint16_t paramIdx, uint32_t cobid, uint16_t eventTime,
                     const std::tuple<uint16_t, uint8_t> *mapping, size_t numMapping, bool enabled, bool rtrAllowed, canfetti::ChangedCallback changedCb);
 };
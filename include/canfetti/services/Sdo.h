@@ -1,4 +1,5 @@
 #pragma once
+#include <deque>
 #include <memory>
 #include <unordered_map>
 #include "Service.h"
@@ -10,17 +11,58 @@ namespace canfetti {
 class SdoService : public Service {
  public:
   static constexpr uint32_t DefaultSegmentXferTimeoutMs = 50;
-  using FinishCallback                                  = std::function<void(Error err)>;
+  static constexpr size_t MaxRecentTransfers            = 16;
+  // Client transactions waiting behind the active one, per SDO channel
+  static constexpr size_t DefaultClientQueueDepth = 16;
+  using FinishCallback                            = std::function<void(Error err)>;
+  using TransactionId                             = unsigned;
+
+  struct TransferStats {
+    uint16_t idx;
+    uint8_t subIdx;
+    bool client;  // Started by this node, rather than served
+    Error result;
+    size_t bytes;
+    uint64_t durationNs;         // First to last frame received, 0 without rx timestamps
+    Sdo::Protocol::Stats block;  // All zero unless sent in block mode
+
+    double bytesPerSecond() const { return durationNs ? bytes * 1e9 / durationNs : 0; }
+  };
+
+  struct Stats {
+    size_t transfers      = 0;
+    size_t failed         = 0;
+    size_t resentSegments = 0;
+    size_t queued         = 0;  // Client transactions that had to wait for another
+    size_t queueFull      = 0;  // Refused as their channel's queue was full
+    size_t queueTimeouts  = 0;  // Gave up waiting to start
+    size_t cancelled      = 0;
+    size_t maxQueueDepth  = 0;
+    std::deque<TransferStats> recent;  // Oldest first, up to MaxRecentTransfers
+  };
 
   SdoService(Node &co);
   Error init();
   Error processMsg(const Msg &msg);
+  void addRxFilters(std::vector<CanDevice::RxFilter> &filters) override;
+  // Starts a transaction with node, or queues it behind the one in progress on
+  // the same channel. A queued transaction gives up with Error::Timeout if it
+  // hasn't started within queueTimeout ms, 0 meaning no limit. cb is called
+  // exactly once, unless an error is returned here. id, if given, is set for
+  // cancelTransaction().
   Error clientTransaction(bool read, uint8_t node, uint16_t idx, uint8_t subIdx,
-                          OdVariant &data, uint32_t segmentTimeout, FinishCallback cb);
+                          OdVariant &data, uint32_t segmentTimeout, FinishCallback cb,
+                          uint32_t queueTimeout = 0, TransactionId *id = nullptr);
+  // Drop a queued client transaction, or abort it if in progress. Its callback
+  // gets Error::DataXferLocal.
+  Error cancelTransaction(TransactionId id);
+  inline void setClientQueueDepth(size_t depth) { clientQueueDepth = depth; }
+  size_t getQueuedTransactionCount();
   Error addSDOServer(uint16_t rxCobid, uint16_t txCobid, uint8_t clientId);
   Error addSDOClient(uint32_t txCobid, uint16_t rxCobid, uint8_t serverId);
   size_t getActiveTransactionCount();
   inline void setServerSegmentTimeout(uint32_t timeoutMs) { serverSegmentTimeoutMs = timeoutMs; }
+  const Stats &getStats() const { return stats; }
 
  private:
   struct TransactionState {
@@ -28,15 +70,39 @@ class SdoService : public Service {
     System::TimerHdl timer;
     unsigned generation;
     FinishCallback cb;
+    bool client        = false;
+    TransactionId id   = 0;
+    uint64_t firstRxNs = 0;
+    uint64_t lastRxNs  = 0;
+  };
+
+  struct PendingTransaction {
+    TransactionId id;
+    bool read;
+    uint16_t idx;
+    uint8_t subIdx;
+    OdVariant *data;
+    uint16_t clientToServer;
+    uint32_t segmentTimeout;
+    FinishCallback cb;
+    System::TimerHdl queueTimer;
   };
 
   void transactionTimeout(unsigned generation, uint16_t key);
   void removeTransaction(uint16_t key);
+  Error startClientTransaction(uint16_t key, PendingTransaction &t);
+  void startNextClientTransaction(uint16_t key);
+  void queueTimeout(uint16_t key, TransactionId id);
   Error addSdoEntry(uint16_t paramIdx, uint16_t clientToServer, uint16_t serverToClient, uint8_t node);
   Error syncServices();
   std::unordered_map<uint16_t, TransactionState> activeTransactions;
+  // Keyed like activeTransactions, by the channel's server to client COB-ID
+  std::unordered_map<uint16_t, std::deque<PendingTransaction>> pendingTransactions;
+  size_t clientQueueDepth = DefaultClientQueueDepth;
+  TransactionId nextId    = 1;
   std::unordered_map<uint16_t, std::tuple<uint16_t, uint8_t>> servers;
   uint32_t serverSegmentTimeoutMs;
+  Stats stats;
 };
 
 }  // namespace canfetti
@@ -1,4 +1,5 @@
 #pragma once
+#include <vector>
 #include "canfetti/Node.h"
 
 namespace canfetti {
@@ -7,6 +8,8 @@ class Service {
   Service(Node &co) : co(co) {}
   virtual Error init() { return Error::Success; }
   virtual canfetti::Error processMsg(const canfetti::Msg &msg) = 0;
+  // Append the frames this service needs to receive
+  virtual void addRxFilters(std::vector<CanDevice::RxFilter> &filters) { (void)filters; }
 
  protected:
   Node &co;
@@ -0,0 +1,35 @@
+#pragma once
+#include <array>
+#include "Service.h"
+
+namespace canfetti {
+
+class SyncService : public canfetti::Service {
+ public:
+  // counter is 0 if the SYNC carried no counter
+  using SyncCb = std::function<void(uint8_t counter)>;
+
+  SyncService(Node &co);
+
+  canfetti::Error init() override;
+  canfetti::Error processMsg(const canfetti::Msg &msg);
+  canfetti::Error setProducer(uint16_t periodMs, uint8_t counterOverflow = 0);
+  canfetti::Error addSyncCallback(SyncCb cb);
+  canfetti::Error sendSync();
+  void addRxFilters(std::vector<CanDevice::RxFilter> &filters) override;
+  inline uint32_t getCobid() const { return syncCobid; }
+
+ private:
+  static constexpr uint32_t DefaultCobid = 0x080;
+  static constexpr uint32_t ProducerBit  = 1 << 30;
+
+  System::TimerHdl producerTimer = System::InvalidTimer;
+  uint32_t syncCobid             = DefaultCobid;
+  uint8_t counter                = 0;
+  std::array<SyncCb, 4> syncCbs;
+
+  void updateProducer();
+  void notifySyncCbs(uint8_t counter);
+};
+
+}  // namespace canfetti
@@ -0,0 +1,55 @@
+#pragma once
+#include <cstdint>
+
+namespace canfetti::Sdo {
+
+//******************************************************************************
+// Sub-block size a block mode receiver asks for
+//
+// Each sub-block costs an ack round trip, and a lost segment costs the rest of
+// its sub-block, on average half of it. For a loss rate of p per segment and a
+// round trip of r segment times, time per delivered segment is then about
+// 1 + r/n + p*n/2 for a sub-block of n, least at n = sqrt(2r/p). Both p and r
+// are moving averages over recent sub-blocks, r taken from the frames' receive
+// timestamps where the platform has them.
+//******************************************************************************
+class BlockSizeControl {
+ public:
+  static constexpr uint8_t MaxBlockSize = 127;
+  // A sub-block of one would end on seqNo 1, which a repeat of its last
+  // segment couldn't be told apart from the start of the next one by
+  static constexpr uint8_t MinBlockSize = 2;
+  // Round trip in segment times when frames carry no timestamps: the ack and
+  // the sender turning around
+  static constexpr float DefaultRoundTrip = 2.f;
+
+  uint8_t size() const { return blksize; }
+
+  // Every segment received, in sequence or not
+  void segment(uint64_t timestampNs);
+  // The sub-block is being acked. segments is how many the sender sent,
+  // going by the highest sequence number seen. Returns the size to ask for
+  // next.
+  uint8_t subBlockDone(uint8_t segments, bool lost);
+  // Nothing arrived for a while, so something was lost, and the wait says
+  // nothing about the round trip
+  void timedOut()
+  {
+    lastNs   = 0;
+    timeouts = true;
+  }
+
+ private:
+  static constexpr float Decay = 0.875f;
+
+  uint8_t blksize       = MaxBlockSize;
+  float lossEvents      = 0;  // Decaying counts for the loss rate
+  float segmentsSeen    = 0;
+  float segmentNs       = 0;  // Moving averages, 0 until measured
+  float roundTripNs     = 0;
+  uint64_t lastNs       = 0;
+  bool subBlockStarting = true;
+  bool timeouts         = false;  // Since the last sub-block was done
+};
+
+}  // namespace canfetti::Sdo
@@ -1,6 +1,7 @@
 #pragma once
 #include <memory>
 #include <tuple>
+#include "BlockSizeControl.h"
 #include "Protocol.h"
 
 namespace canfetti::Sdo {
@@ -15,12 +16,40 @@ class Client : public Protocol {
                                                                             OdVariant &data, uint16_t txCobid, Node &co);
 
   bool processMsg(const canfetti::Msg &msg);
+  bool resumeAfterTimeout();
 
  private:
+  enum class BlockUpload {
+    None,
+    Initiated,
+    SubBlock,
+    End,
+  };
+
+  enum class BlockDownload {
+    None,
+    SubBlock,
+    End,
+  };
+
   uint8_t lastBlockBytes;
+  BlockDownload blockDownload = BlockDownload::None;
+  uint8_t segmentsSent        = 0;
+  bool lastSegmentSent        = false;
+  BlockUpload blockUpload     = BlockUpload::None;
+  uint8_t blockSize           = 0;  // Of the current sub-block
+  uint8_t expectedSeqNo       = 0;
+  uint8_t highestSeqNo        = 0;
+  bool gap                    = false;  // Segments were lost in the current sub-block
+  uint8_t lastSegmentData[7];
+  BlockSizeControl blockSizeControl;
+
   canfetti::Error checkSize(uint32_t msgLen, bool tooBigCheck);
+  bool processBlockUpload(const canfetti::Msg &msg);
+  void sendBlockAck(uint8_t ackseq, const canfetti::Msg &end);
   void segmentWrite();
   void segmentRead();
   void blockSegmentWrite(uint8_t seqno);
+  void sendSubBlock();
 };
 }  // namespace canfetti::Sdo
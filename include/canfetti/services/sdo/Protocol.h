@@ -1,6 +1,7 @@
 #pragma once
 
 #include "canfetti/CanDevice.h"
+#include "canfetti/Crc16.h"
 #include "canfetti/Node.h"
 #include "canfetti/ObjDict.h"
 
@@ -10,24 +11,67 @@ class Protocol {
  public:
   static const size_t BlockModeThreshold = 100;
 
+  // Block mode figures for one transfer
+  struct Stats {
+    uint32_t subBlocks      = 0;
+    uint32_t resentSegments = 0;  // Lost, or sent after a lost one
+    uint8_t minBlockSize    = 0;
+    uint8_t maxBlockSize    = 0;
+    uint8_t lastBlockSize   = 0;
+  };
+
   Protocol(uint16_t txCobid, canfetti::OdProxy proxy, Node &co);
   virtual ~Protocol();
 
   virtual bool processMsg(const canfetti::Msg &msg) = 0;
   virtual void finish(canfetti::Error status, bool sendAbort = true);
   std::tuple<bool, canfetti::Error> isFinished();
+  // Called when nothing arrived within the segment timeout. Returning true
+  // keeps the transfer going, e.g. after asking for lost segments again.
+  virtual bool resumeAfterTimeout() { return false; }
+  const Stats &getStats() const { return stats; }
+  size_t bytesTransferred() const { return proxy.offset(); }
+  uint16_t getIdx() const { return proxy.idx; }
+  uint8_t getSubIdx() const { return proxy.subIdx; }
 
  protected:
+  static constexpr uint8_t MaxTimeoutRetries = 3;
+
   static inline bool isAbortMsg(const Msg &m) { return (m.data[0] & (0b111 << 5)) == (4 << 5); }
+  // Segment numbers start at 1, so within a sub-block only an abort has 0
+  static inline bool isSubBlockAbort(const Msg &m) { return m.data[0] == (4 << 5); }
   static uint32_t getInitiateDataLen(const canfetti::Msg &m);
   static void abort(canfetti::Error status, uint16_t txCobid, uint16_t idx, uint8_t subIdx, CanDevice &bus);
 
   bool abortCheck(const Msg &msg);
+  // Block mode sender: remember where a sub-block starts, and go back to just
+  // after its ackseq'th segment if the receiver lost the rest of it
+  void startSubBlock();
+  canfetti::Error rewindSubBlock(uint8_t ackseq);
+  void noteSubBlock(uint8_t blksize);
+  // Block mode sender: a lost ack looks like a lost tail to the receiver, so
+  // on a timeout the sub-block's last segment goes out again either way
+  void sendSegment(const uint8_t (&payload)[8]);
+  void resendLastSegment();
+  // Block mode receiver: ack the sub-block ended by segment end. Should that
+  // segment come again the ack was lost, and resendLostAck() repeats it.
+  void sendSubBlockAck(const uint8_t (&payload)[8], const canfetti::Msg &end);
+  bool resendLostAck(const canfetti::Msg &msg);
 
   bool finished                  = false;
   canfetti::Error finishedStatus = canfetti::Error::Success;
   uint16_t txCobid;
   bool toggle = false;
+  bool useCrc = false;  // Block mode, both sides support CRC
+  canfetti::Crc16 crc;
+  size_t subBlockStart    = 0;
+  uint16_t subBlockCrc    = 0;
+  uint8_t timeoutRetries  = 0;
+  uint8_t lastSegment[8]  = {0};    // Sender, the last segment sent
+  uint8_t ackedSegment[8] = {0};    // Receiver, the segment that ended the last sub-block
+  uint8_t lastAck[8]      = {0};    // And its ack
+  bool awaitingSubBlock   = false;  // Nothing received since that ack
+  Stats stats;
   canfetti::OdProxy proxy;
   Node &co;
 };
@@ -1,4 +1,5 @@
 #pragma once
+#include "BlockSizeControl.h"
 #include "Server.h"
 
 namespace canfetti::Sdo {
@@ -10,23 +11,28 @@ class ServerBlockMode : public Server {
   ServerBlockMode(uint16_t txCobid,
                   canfetti::OdProxy proxy,
                   Node &co,
-                  uint32_t totalsize);
+                  uint32_t totalsize,
+                  bool crc);
 
   bool processMsg(const canfetti::Msg &msg);
+  bool resumeAfterTimeout();
   void sendInitiateResponse();
 
  private:
-  const uint8_t NumSubBlockSegments = 127;
-
   enum State {
-    Start,
     SubBlock,
     End,
   };
 
+  void sendAck(uint8_t ackseq, const canfetti::Msg &end);
+
   uint32_t totalsize;
-  State state = State::Start;
+  State state = State::SubBlock;
   uint8_t lastSegmentData[7];
-  uint8_t expectedSeqNo;
+  uint8_t expectedSeqNo = 1;
+  uint8_t highestSeqNo  = 0;
+  bool gap              = false;  // Segments were lost in the current sub-block
+  BlockSizeControl blockSize;
+  uint8_t blksize = BlockSizeControl::MaxBlockSize;  // Of the current sub-block
 };
-}  // namespace canfetti::Sdo
\ No newline at end of file
+}  // namespace canfetti::Sdo
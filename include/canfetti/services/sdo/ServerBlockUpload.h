@@ -0,0 +1,36 @@
+#pragma once
+#include "Server.h"
+
+namespace canfetti::Sdo {
+
+class ServerBlockUpload : public Server {
+ public:
+  static inline bool isUploadBlockMsg(const canfetti::Msg &m) { return (m.data[0] >> 5) == 5; }
+  static inline bool isUploadBlockInitiate(const canfetti::Msg &m) { return isUploadBlockMsg(m) && (m.data[0] & 0b11) == 0; }
+
+  ServerBlockUpload(uint16_t txCobid,
+                    canfetti::OdProxy proxy,
+                    Node &co,
+                    uint8_t blksize,
+                    bool crc);
+
+  bool processMsg(const canfetti::Msg &msg);
+  bool resumeAfterTimeout();
+  void sendInitiateResponse();
+
+ private:
+  enum State {
+    Initiated,
+    SubBlock,
+    End,
+  };
+
+  void sendSubBlock();
+
+  State state = State::Initiated;
+  uint8_t blksize;
+  uint8_t segmentsSent = 0;
+  uint8_t lastLen      = 0;  // Data bytes in the final segment
+  bool lastSent        = false;
+};
+}  // namespace canfetti::Sdo
@@ -0,0 +1,52 @@
+#pragma once
+#include <array>
+#include <cstddef>
+#include <cstdint>
+
+namespace canfetti {
+
+//******************************************************************************
+// Log2 histogram of latencies
+//
+// Bucket 0 counts samples under 1 us, bucket i > 0 those in [2^(i-1), 2^i) us,
+// and the last bucket everything longer.
+//******************************************************************************
+struct LatencyHistogram {
+  static constexpr size_t NumBuckets = 24;  // Last bucket starts at ~4 s
+
+  std::array<uint64_t, NumBuckets> buckets = {};
+  uint64_t count   = 0;
+  uint64_t totalNs = 0;
+  uint64_t maxNs   = 0;
+
+  void record(uint64_t ns)
+  {
+    uint64_t us = ns / 1000;
+    size_t b    = 0;
+    while (us && b < NumBuckets - 1) {
+      us >>= 1;
+      b++;
+    }
+
+    buckets[b]++;
+    count++;
+    totalNs += ns;
+    if (ns > maxNs) maxNs = ns;
+  }
+
+  // Upper bound of bucket b in us
+  static constexpr uint64_t bucketLimitUs(size_t b) { return 1ull << b; }
+
+  // Upper bound in us of the bucket holding the p'th fraction of samples
+  uint64_t percentileUs(double p) const
+  {
+    uint64_t target = p * count, seen = 0;
+    for (size_t b = 0; b < NumBuckets; ++b) {
+      seen += buckets[b];
+      if (seen > target || seen == count) return bucketLimitUs(b);
+    }
+    return bucketLimitUs(NumBuckets - 1);
+  }
+};
+
+}  // namespace canfetti
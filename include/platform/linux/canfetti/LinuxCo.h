@@ -1,14 +1,22 @@
 #pragma once
 #include <assert.h>
+#include <sys/socket.h>
 #include <time.h>
+#include <array>
 #include <atomic>
+#include <chrono>
 #include <condition_variable>
+#include <deque>
 #include <functional>
+#include <future>
 #include <mutex>
 #include <random>
 #include <thread>
 #include <unordered_set>
+#include "canfetti/LatencyHistogram.h"
 #include "canfetti/LocalNode.h"
+#include "canfetti/MpscQueue.h"
+#include "canfetti/SpscRing.h"
 #include "canfetti/System.h"
 #include "linux/can.h"
 
@@ -16,26 +24,228 @@ namespace canfetti {
 
 class LinuxCoDev : public canfetti::CanDevice {
  public:
+  struct BatchStats {
+    size_t rxBatches  = 0;
+    size_t rxFrames   = 0;
+    size_t rxMaxBatch = 0;
+    size_t txBatches  = 0;
+    size_t txFrames   = 0;
+    size_t txMaxBatch = 0;
+  };
+
+  // Transmit classes, highest priority first. Queued frames go out in class
+  // order, and in write order within a class.
+  enum class TxClass : uint8_t {
+    NmtEmcy,  // NMT, heartbeats, EMCY and anything sent with writePriority()
+    Sync,     // SYNC and TIME
+    Pdo,      // PDOs and anything unrecognised, e.g. 29 bit ids
+    Sdo,
+  };
+  static constexpr size_t NumTxClasses = 4;
+
+  // Which frame a full class gives up to make room
+  enum class TxDropPolicy {
+    DropOldest,  // The longest queued one, e.g. a PDO value that's stale anyway
+    DropNewest,  // The one being written
+  };
+
+  struct TxClassStats {
+    size_t depth            = 0;  // Frames waiting now
+    size_t maxDepth         = 0;
+    size_t sent             = 0;
+    size_t dropped          = 0;
+    uint64_t totalLatencyUs = 0;  // From write() to the socket taking it, over all sent
+    uint64_t maxLatencyUs   = 0;
+  };
+
+  // A received frame and its receive times; see Msg::timestamp and
+  // Msg::hwTimestamp. Classic frames are read into the same struct, with fd
+  // clear.
+  struct RxFrame {
+    struct canfd_frame frame;
+    bool fd;
+    uint64_t timestamp;
+    uint64_t hwTimestamp;
+  };
+
   LinuxCoDev(uint32_t baudrate);
   canfetti::Error open(const char* device);
+  // Use an already open socket instead. The tx queues work
+  // over any datagram socket, which is how canfetti_txqueuetest runs them
+  // without a CAN interface.
+  canfetti::Error open(int socket);
+  // Frames are queued by class and handed to the socket as it has room. When
+  // the kernel reports ENOBUFS they stay queued until POLLOUT; see
+  // txBacklog(). Without async, the queues are flushed before returning.
   canfetti::Error write(const canfetti::Msg& msg, bool async = false) override;
+  canfetti::Error writePriority(const canfetti::Msg& msg) override;
+  // Send and receive CAN FD frames (CAN_RAW_FD_FRAMES). open() fails unless
+  // the interface is CAN FD capable. FD frames are sent with bit rate switch
+  // unless disabled. Call before open().
+  void setFd(bool enable, bool bitRateSwitch = true)
+  {
+    fd  = enable;
+    brs = bitRateSwitch;
+  }
+  bool fdEnabled() const override { return fd; }
+  void flush() override { flushAsyncFrames(); }
+  // Installed as CAN_RAW_FILTER so the kernel drops frames nobody here
+  // consumes. May be called before open().
+  void setRxFilters(const std::vector<RxFilter>& filters) override;
+  // Cyclic frames are sent by the kernel's broadcast manager (CAN_BCM) when
+  // enabled with setCyclicOffload() before open(). Its copy of a TPDO is only
+  // refreshed on writes through the OD, so TPDOs mapping OdBuffer (_p()) or
+  // dynamic entries keep being sent from a user-space timer.
+  void setCyclicOffload(bool enable) { cyclicOffload = enable; }
+  canfetti::Error writeCyclic(const canfetti::Msg& msg, uint32_t periodMs) override;
+  void stopCyclic(uint32_t id) override;
+  // Likewise, RPDOs are change-filtered and timed out by CAN_BCM when enabled
+  // with setRxChangeOffload() before open(). Its messages are read separately
+  // through readBcm().
+  void setRxChangeOffload(bool enable) { rxChangeOffload = enable; }
+  canfetti::Error setRxChangeFilter(uint32_t id, uint8_t len, uint32_t timeoutMs) override;
+  void clearRxChangeFilter(uint32_t id) override;
+  // Append changed frames and timeouts (id | RxTimeoutFlag) without blocking
+  void readBcm(std::vector<RxFrame>& frames);
+  int getBcmFd() const { return bcm; }
+
+  // Not a flag the raw socket ever delivers, since error frames aren't enabled
+  static constexpr canid_t RxTimeoutFlag = CAN_ERR_FLAG;
+  // Classic frames only; an FD frame is truncated
   canfetti::Error read(struct can_frame& frame, bool nonblock);
+  // Read up to maxFrames with one recvmmsg(). Unless nonblock is set, waits up
+  // to SO_RCVTIMEO for the first frame only.
+  canfetti::Error read(std::vector<RxFrame>& frames, size_t maxFrames, bool nonblock);
+  // Also stamp frames with the adapter's raw hardware clock, where it
+  // provides one, in Msg::hwTimestamp. That clock is the adapter's own, so
+  // Msg::timestamp stays the kernel's. Call before open().
+  void setHwTimestamps(bool enable) { hwTimestamps = enable; }
   void flushAsyncFrames();
+  int getFd() const { return s; }
+  BatchStats getBatchStats();
+  // Frames waiting on the socket; flush again once it polls writable
+  size_t txBacklog() const { return txQueued.load(std::memory_order_relaxed); }
+  void setTxQueueLimit(TxClass c, size_t maxFrames, TxDropPolicy policy);
+  TxClassStats getTxClassStats(TxClass c);
 
  private:
-  int s;
-  // Accessed by write() and flushAsyncFrames()
-  std::vector<struct can_frame> asyncFrames;
+  int s = -1;
+  int bcm              = -1;
+  bool cyclicOffload   = false;
+  bool rxChangeOffload = false;
+  bool hwTimestamps    = false;
+  bool fd              = false;
+  bool brs             = true;
+
+  // Empty until the node provides filters, meaning receive everything
+  std::vector<struct can_filter> rxFilters;
+  canfetti::Error applyRxFilters();
+
+  struct TxEntry {
+    struct canfd_frame frame;
+    bool fd;
+    std::chrono::steady_clock::time_point queuedAt;
+  };
+
+  struct TxQueue {
+    std::deque<TxEntry> entries;
+    size_t limit        = 256;
+    TxDropPolicy policy = TxDropPolicy::DropOldest;
+    TxClassStats stats;
+  };
+
+  // write() may be called under the node lock from any thread while the main
+  // loop flushes outside it
+  std::mutex txMtx;
+  std::array<TxQueue, NumTxClasses> txQueues;
+  std::atomic<size_t> txQueued{0};
+  std::vector<struct mmsghdr> txMsgs;
+  std::vector<struct iovec> txIovs;
+  static TxClass classify(canid_t id);
+  TxEntry toEntry(const canfetti::Msg& msg) const;
+  canfetti::Error enqueue(TxClass c, const TxEntry& entry);
+  canfetti::Error drainTxQueues();
+  void popTxEntries(size_t n, bool sent);
+
+  // Only used by the thread reading the socket
+  union RxControl {
+    struct cmsghdr hdr;
+    char buf[CMSG_SPACE(3 * sizeof(struct timespec))];  // struct scm_timestamping
+  };
+  std::vector<struct mmsghdr> rxMsgs;
+  std::vector<struct iovec> rxIovs;
+  std::vector<RxControl> rxControl;
+  void rxTimestamps(struct msghdr& hdr, RxFrame& rx);
+
+  struct AtomicBatchStats {
+    std::atomic<size_t> rxBatches{0};
+    std::atomic<size_t> rxFrames{0};
+    std::atomic<size_t> rxMaxBatch{0};
+    std::atomic<size_t> txBatches{0};
+    std::atomic<size_t> txFrames{0};
+    std::atomic<size_t> txMaxBatch{0};
+  } batchStats;
 };
 
 class LinuxCo : public canfetti::LocalNode {
  public:
+  enum class Engine {
+    Threaded,  // Separate recv and main threads
+    Epoll,     // One thread waiting on the socket, a timerfd and an eventfd
+  };
+
   LinuxCo(LinuxCoDev& d, uint8_t nodeId, const char* deviceName, uint32_t deviceType = 0);
   ~LinuxCo();
-  Error start(const char* dev);
+  Error start(const char* dev, Engine engine = Engine::Threaded);
   size_t getTimerCount() { return sys.getTimerCount(); }
+  uint64_t getTimerOverruns() { return sys.getTimerOverruns(); }
+  // Times the recv thread stalled on a full ring to the stack thread
+  size_t getRxRingFull() const { return rxRingFull.load(std::memory_order_relaxed); }
+  // From the kernel receiving a frame to it being handed to the stack, over
+  // all timestamped frames
+  LatencyHistogram getRxLatency()
+  {
+    std::lock_guard g(mtx);
+    return rxLatency;
+  }
+
+  // Run f() on the stack thread between frame batches. The caller neither
+  // takes the node lock nor waits for f(), so it doesn't stall behind frame
+  // processing. Commands run in the order each thread posted them. f() must
+  // not block.
+  template <typename F>
+  void post(F &&f)
+  {
+    commands.push(std::function<void()>(std::forward<F>(f)));
+    wakeMainThread();
+  }
 
-  // All external callers must go through this to access node state, OD data, etc. f() must not block.
+  // As post(), with f()'s result delivered through the returned future. Don't
+  // wait on it from the stack thread itself, e.g. in an OD callback.
+  template <typename F>
+  auto submit(F &&f) -> std::future<std::invoke_result_t<F>>
+  {
+    using R   = std::invoke_result_t<F>;
+    auto task = std::make_shared<std::packaged_task<R()>>(std::forward<F>(f));
+    auto res  = task->get_future();
+    post([task]() { (*task)(); });
+    return res;
+  }
+
+  template <typename T>
+  std::future<Error> setAsync(uint16_t idx, uint8_t subIdx, T value)
+  {
+    return submit([this, idx, subIdx, value = std::move(value)]() { return od.set(idx, subIdx, value); });
+  }
+
+  // triggerTPDOOnce() through the command queue
+  void postTPDOOnce(uint16_t pdoNum)
+  {
+    post([this, pdoNum]() { triggerTPDOOnce(pdoNum); });
+  }
+
+  // All external callers must go through this or post() to access node state, OD data, etc. f() must not block.
+  // Use this where several operations have to happen atomically.
   template <typename F>
   void doWithLock(F f)
   {
@@ -44,7 +254,7 @@ class LinuxCo : public canfetti::LocalNode {
     bool noPendingTpdos = pendingTpdos.empty();
     f();
     if (gen != sys.getTimerGeneration() || (noPendingTpdos && !pendingTpdos.empty())) {
-      mainThreadWakeup.notify_one();
+      wakeMainThread();
     }
   }
 
@@ -69,16 +279,17 @@ class LinuxCo : public canfetti::LocalNode {
     Error result = Error::Error;
     OdVariant val(data);
 
-    Error initErr;
-    doWithLock([&]() {
-      initErr = sdo.clientTransaction(read, node, idx, subIdx, val, segmentTimeout, [&](Error e) {
-        std::lock_guard g(mtx);
-        done = true;
-        result = e;
-        cv.notify_one();
-      });
+    auto finish = [&](Error e) {
+      std::lock_guard g(mtx);
+      done   = true;
+      result = e;
+      cv.notify_one();
+    };
+    post([&]() {
+      if (Error e = sdo.clientTransaction(read, node, idx, subIdx, val, segmentTimeout, finish); e != Error::Success) {
+        finish(e);
+      }
     });
-    if (initErr != Error::Success) return initErr;
 
     {
       std::unique_lock u(mtx);
@@ -92,25 +303,52 @@ class LinuxCo : public canfetti::LocalNode {
 
   // Request async TPDO send. Requests are coalesced so that only one send per
   // TPDO happens per main loop iteration. This prevents an external caller
-  // running faster than the main loop from enqueueing unbounded sends.
+  // running faster than the main loop from enqueueing unbounded sends. Call
+  // on the stack thread or under doWithLock(); see postTPDOOnce().
   Error triggerTPDOOnce(uint16_t pdoNum);
 
  private:
   // These are separate threads due to the difficulty of combining socket IO with timers
   void runMainThread();
   void runRecvThread();
+  void runEventLoop();
+  void wakeMainThread();
+  void processFrames(std::vector<LinuxCoDev::RxFrame>& frames);
+  void dispatchFrame(LinuxCoDev::RxFrame& rx);
+  bool retryTx(size_t backlog);
+  void drainRxRing();
+  void runCommands();
+
+  static constexpr size_t RxRingSize = 1024;
+  // How long to stop waiting for POLLOUT once the device queue itself is full
+  static constexpr int TxBackoffMs = 1;
 
   std::recursive_mutex mtx;
-  // when pendingFrames becomes non-empty / timers have changed / async TPDOs are requested
-  std::condition_variable_any mainThreadWakeup;
-  // when pendingFrames becomes empty
-  std::condition_variable_any recvThreadWakeup;
+  // Guards wakePending only, so the recv thread never waits on mtx
+  std::mutex wakeMtx;
+  // when frames have been queued / timers have changed / async TPDOs are requested
+  std::condition_variable mainThreadWakeup;
+  bool wakePending = false;
+  // when the recv thread is stalled on a full ring and space frees up
+  std::condition_variable recvThreadWakeup;
+  std::atomic<bool> recvStalled{false};
+  std::atomic<size_t> rxRingFull{0};
   System sys;
-  std::vector<can_frame> pendingFrames;
+  // Frames from the recv thread to the main thread
+  SpscRing<LinuxCoDev::RxFrame, RxRingSize> rxRing;
+  LatencyHistogram rxLatency;
   std::unique_ptr<std::thread> mainThread;
   std::unique_ptr<std::thread> recvThread;
   std::atomic<bool> shutdown{false};
   std::unordered_set<uint16_t> pendingTpdos;
+  // From post(), run by the stack thread
+  MpscQueue<std::function<void()>> commands;
+  Engine engine   = Engine::Threaded;
+  int epollFd     = -1;
+  int timerFd     = -1;
+  int wakeFd      = -1;
+  int txWakeFd    = -1;  // Threaded engine: has the recv thread wait for POLLOUT
+  int txBackoffFd = -1;  // Epoll engine: ends a wait for a full device queue
 };
 
 }  // namespace canfetti
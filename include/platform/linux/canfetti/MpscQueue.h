@@ -0,0 +1,62 @@
+#pragma once
+#include <atomic>
+#include <utility>
+
+namespace canfetti {
+
+//******************************************************************************
+// Unbounded multiple producer / single consumer queue
+//
+// Lock-free: push() may be called from any thread, pop() from one consumer
+// thread. Producers only swap the head pointer and link the previous node, so
+// they never wait on each other or the consumer. A push that is still linking
+// its node may be missed by a concurrent pop(); it shows up on the next one.
+//******************************************************************************
+template <typename T>
+class MpscQueue {
+  struct Node {
+    std::atomic<Node *> next{nullptr};
+    T value;
+  };
+
+ public:
+  MpscQueue() : head(new Node), tail(head.load(std::memory_order_relaxed)) {}
+  MpscQueue(const MpscQueue &)            = delete;
+  MpscQueue &operator=(const MpscQueue &) = delete;
+
+  ~MpscQueue()
+  {
+    T v;
+    while (pop(v)) {}
+    delete tail;
+  }
+
+  void push(T value)
+  {
+    Node *n    = new Node;
+    n->value   = std::move(value);
+    Node *prev = head.exchange(n, std::memory_order_acq_rel);
+    prev->next.store(n, std::memory_order_release);
+  }
+
+  // Consumer side. Returns false if the queue is empty.
+  bool pop(T &value)
+  {
+    Node *next = tail->next.load(std::memory_order_acquire);
+    if (!next) return false;
+
+    // next becomes the new stub, its value moved out
+    value = std::move(next->value);
+    delete tail;
+    tail = next;
+    return true;
+  }
+
+  bool empty() const { return !tail->next.load(std::memory_order_acquire); }
+
+ private:
+  alignas(64) std::atomic<Node *> head;  // Last pushed, written by producers
+  alignas(64) Node *tail;                // Stub before the next to pop, consumer only
+};
+
+}  // namespace canfetti
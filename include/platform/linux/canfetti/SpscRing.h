@@ -0,0 +1,67 @@
+#pragma once
+#include <atomic>
+#include <cstddef>
+
+namespace canfetti {
+
+//******************************************************************************
+// Fixed capacity single producer / single consumer ring
+//
+// Lock-free: push() may only be called from one thread and pop() from one
+// other. Each side keeps its index on its own cache line, along with a cached
+// copy of the other side's index so the shared line is only touched when the
+// ring looks full (producer) or empty (consumer).
+//******************************************************************************
+template <typename T, size_t Capacity>
+class SpscRing {
+  static_assert(Capacity && (Capacity & (Capacity - 1)) == 0, "Capacity must be a power of 2");
+  static constexpr size_t CacheLine = 64;
+
+ public:
+  static constexpr size_t capacity() { return Capacity; }
+
+  // Producer side. Returns false if the ring is full.
+  bool push(const T &item)
+  {
+    size_t t = tail.load(std::memory_order_relaxed);
+    if (t - headCache == Capacity) {
+      headCache = head.load(std::memory_order_acquire);
+      if (t - headCache == Capacity) return false;
+    }
+    slots[t & (Capacity - 1)] = item;
+    tail.store(t + 1, std::memory_order_release);
+    return true;
+  }
+
+  bool full()
+  {
+    return tail.load(std::memory_order_relaxed) - head.load(std::memory_order_acquire) == Capacity;
+  }
+
+  // Consumer side. Returns false if the ring is empty.
+  bool pop(T &item)
+  {
+    size_t h = head.load(std::memory_order_relaxed);
+    if (h == tailCache) {
+      tailCache = tail.load(std::memory_order_acquire);
+      if (h == tailCache) return false;
+    }
+    item = slots[h & (Capacity - 1)];
+    head.store(h + 1, std::memory_order_release);
+    return true;
+  }
+
+  bool empty() const
+  {
+    return head.load(std::memory_order_relaxed) == tail.load(std::memory_order_acquire);
+  }
+
+ private:
+  alignas(CacheLine) std::atomic<size_t> tail{0};  // Written by producer
+  size_t headCache = 0;
+  alignas(CacheLine) std::atomic<size_t> head{0};  // Written by consumer
+  size_t tailCache = 0;
+  alignas(CacheLine) T slots[Capacity];
+};
+
+}  // namespace canfetti
@@ -5,8 +5,8 @@
 #include <condition_variable>
 #include <functional>
 #include <mutex>
-#include <random>
 #include <thread>
+#include "canfetti/PhaseSlots.h"
 
 // Always enable assertions.
 // FIXME: remove once all error handling paths are fleshed out
@@ -15,6 +15,10 @@
 #endif
 
 #define CANFETTI_NO_INLINE
+// CAN FD: PDOs of up to 64 bytes
+#define CANFETTI_MAX_PDO_LEN 64
+// Slice-by-8 CRC for SDO block transfers
+#define CANFETTI_CRC16_SLICES 8
 
 namespace canfetti {
 
@@ -49,9 +53,14 @@ class Logger {
 class System {
  private:
   struct Timer {
-    bool available = true;
-    bool enable    = false;
-    bool repeat    = false;
+    static constexpr size_t NotQueued = SIZE_MAX;
+
+    bool available    = true;
+    bool enable       = false;
+    bool repeat       = false;
+    bool firing       = false;      // Freed only once its callback returns
+    size_t heapIdx    = NotQueued;  // Position in System::heap while enabled
+    uint8_t phaseSlot = PhaseSlots::NoSlot;
     std::chrono::steady_clock::duration interval;
     std::chrono::steady_clock::time_point deadline;
     std::function<void()> callback;
@@ -62,9 +71,16 @@ class System {
   static const TimerHdl InvalidTimer;
 
   TimerHdl resetTimer(TimerHdl& hdl);
+  // Re-arm a live timer to fire delayMs from now, reusing its callback.
+  // Periodic timers carry on at their period after that. Returns InvalidTimer
+  // if hdl has been deleted.
+  TimerHdl resetTimer(TimerHdl& hdl, uint32_t delayMs);
   void deleteTimer(TimerHdl& hdl);
   void disableTimer(TimerHdl& hdl);
   TimerHdl scheduleDelayed(uint32_t delayMs, std::function<void()> cb);
+  // Periodic deadlines are absolute, so late servicing doesn't shift the
+  // schedule. With staggeredStart, timers are phase-aligned through PhaseSlots
+  // so ones sharing a period are spread evenly across it.
   TimerHdl schedulePeriodic(uint32_t periodMs, std::function<void()> cb, bool staggeredStart = true);
 
   // Return a time point no later than the earliest timer deadline. If there
@@ -74,16 +90,27 @@ class System {
   void serviceTimers();
 
   size_t getTimerCount();
+  // Total periods skipped across all periodic timers
+  uint64_t getTimerOverruns() { return overruns; }
   // For LinuxCo::doWithLock() to detect that timers have changed and main
   // thread should be woken
   unsigned getTimerGeneration() { return generation; }
 
  private:
-  // vector instead of [unordered_]set to allow mutation during iteration in
-  // service(). Size only increases.
-  std::vector<TimerHdl> timers;
+  // Enabled timers, ordered by deadline. Each timer tracks its own index so it
+  // can be removed or rescheduled in O(log n).
+  std::vector<TimerHdl> heap;
+  // Deleted timers waiting to be reused
+  std::vector<TimerHdl> freeTimers;
+  size_t activeTimers = 0;
   TimerHdl getAvailableTimer();
-  std::mt19937 prng;  // use default seed
+  void enqueue(const TimerHdl& hdl);
+  void dequeue(Timer& t);
+  void siftUp(size_t i);
+  void siftDown(size_t i);
+  PhaseSlots phaseSlots;
+  const std::chrono::steady_clock::time_point epoch = std::chrono::steady_clock::now();
+  uint64_t overruns                                 = 0;
   unsigned generation = newGeneration();
 };
 
@@ -55,6 +55,9 @@ class System {
 
   bool init(fibre::Callback<std::optional<uint32_t>, float, fibre::Callback<void>> timer, fibre::Callback<bool, std::optional<uint32_t>&> timerCancel);
 
+  // Re-arm a live timer to fire delayMs from now, reusing its callback.
+  // Returns InvalidTimer if hdl has been deleted.
+  TimerHdl resetTimer(TimerHdl& hdl, uint32_t delayMs);
   void deleteTimer(TimerHdl& hdl);
   TimerHdl scheduleDelayed(uint32_t delayMs, std::function<void()> cb);
   TimerHdl schedulePeriodic(uint32_t periodMs, std::function<void()> cb, bool staggeredStart = true);
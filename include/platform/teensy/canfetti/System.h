@@ -7,6 +7,7 @@
 #include <string>
 #include <vector>
 #include "Arduino.h"
+#include "canfetti/PhaseSlots.h"
 
 //******************************************************************************
 // Teensy specific implementation
@@ -36,18 +37,28 @@ class System {
     uint32_t delay;
     uint32_t period;
     std::function<void()> cb;
-    bool enable    = false;
-    bool available = true;
+    bool enable       = false;
+    bool available    = true;
+    uint8_t phaseSlot = PhaseSlots::NoSlot;
   };
   std::vector<TimerData> timers;
+  PhaseSlots phaseSlots;
+  uint32_t overruns = 0;
 
  public:
   using TimerHdl                         = size_t;
   static constexpr TimerHdl InvalidTimer = SIZE_MAX;
 
+  // Re-arm a live timer to fire delayMs from now, reusing its callback.
+  // Returns InvalidTimer if hdl has been deleted.
+  TimerHdl resetTimer(TimerHdl& hdl, uint32_t delayMs);
   void deleteTimer(TimerHdl& hdl);
   TimerHdl scheduleDelayed(uint32_t delayMs, std::function<void()> cb);
+  // Periodic deadlines are absolute, so late servicing doesn't shift the
+  // schedule. With staggeredStart, timers are phase-aligned through PhaseSlots.
   TimerHdl schedulePeriodic(uint32_t periodMs, std::function<void()> cb, bool staggeredStart = true);
+  // Total periods skipped across all periodic timers
+  uint32_t getTimerOverruns() { return overruns; }
 
   void service();
 };
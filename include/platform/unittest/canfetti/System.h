@@ -9,6 +9,10 @@
 #include <thread>
 
 #define CANFETTI_NO_INLINE
+// CAN FD: PDOs of up to 64 bytes
+#define CANFETTI_MAX_PDO_LEN 64
+// Slice-by-8 CRC for SDO block transfers
+#define CANFETTI_CRC16_SLICES 8
 
 namespace canfetti {
 
@@ -32,6 +36,7 @@ class System {
   static constexpr TimerHdl InvalidTimer = -1;
 
   virtual TimerHdl resetTimer(TimerHdl& hdl)                                                                 = 0;
+  virtual TimerHdl resetTimer(TimerHdl& hdl, uint32_t delayMs)                                               = 0;
   virtual void deleteTimer(TimerHdl& hdl)                                                                    = 0;
   virtual void disableTimer(TimerHdl& hdl)                                                                   = 0;
   virtual TimerHdl scheduleDelayed(uint32_t delayMs, std::function<void()> cb)                               = 0;
@@ -0,0 +1,59 @@
+#include "canfetti/Crc16.h"
+#include <array>
+
+using namespace canfetti;
+
+namespace {
+using Tables = std::array<std::array<uint16_t, 256>, Crc16::Slices>;
+
+// tables[k][b] is the CRC of byte b followed by k zero bytes
+constexpr Tables makeTables()
+{
+  Tables t = {};
+
+  for (unsigned b = 0; b < 256; ++b) {
+    uint16_t crc = b << 8;
+    for (int bit = 0; bit < 8; ++bit) {
+      crc = (crc & 0x8000) ? (crc << 1) ^ 0x1021 : crc << 1;
+    }
+    t[0][b] = crc;
+  }
+
+  for (size_t k = 1; k < Crc16::Slices; ++k) {
+    for (unsigned b = 0; b < 256; ++b) {
+      uint16_t prev = t[k - 1][b];
+      t[k][b]       = (prev << 8) ^ t[0][prev >> 8];
+    }
+  }
+
+  return t;
+}
+
+constexpr Tables tables = makeTables();
+}  // namespace
+
+uint16_t Crc16::update(uint16_t crc, const uint8_t *data, size_t len)
+{
+  // With the register folded into the first two bytes, the CRC of a chunk is
+  // the xor of each byte's contribution at its distance from the end
+  if constexpr (Slices >= 2) {
+    while (len >= 2) {
+      size_t n = len < Slices ? len : Slices;
+
+      uint16_t next = tables[n - 1][data[0] ^ (crc >> 8)] ^ tables[n - 2][data[1] ^ (crc & 0xFF)];
+      for (size_t i = 2; i < n; ++i) {
+        next ^= tables[n - 1 - i][data[i]];
+      }
+
+      crc = next;
+      data += n;
+      len -= n;
+    }
+  }
+
+  while (len--) {
+    crc = (crc << 8) ^ tables[0][(crc >> 8) ^ *data++];
+  }
+
+  return crc;
+}
@@ -1,9 +1,10 @@
 #include "canfetti/LocalNode.h"
+#include <algorithm>
 
 using namespace canfetti;
 
 LocalNode::LocalNode(CanDevice &d, System &sys, uint8_t nodeId, const char *deviceName, uint32_t deviceType)
-    : Node(d, sys, nodeId), nmt(*this), pdo(*this), sdo(*this), emcy(*this), deviceName(deviceName), deviceType(deviceType)
+    : Node(d, sys, nodeId), nmt(*this), pdo(*this), sdo(*this), emcy(*this), sync(*this), deviceName(deviceName), deviceType(deviceType)
 {
 }
 
@@ -23,6 +24,12 @@ Error LocalNode::init()
   if (Error e = emcy.init(); e != Error::Success) {
     return e;
   }
+  if (Error e = sync.init(); e != Error::Success) {
+    return e;
+  }
+  if (Error e = sync.addSyncCallback(std::bind(&PdoService::processSync, &pdo, std::placeholders::_1)); e != Error::Success) {
+    return e;
+  }
 
   //
   // Create default entries
@@ -72,23 +79,45 @@ Error LocalNode::init()
     return e;
   }
 
+  initialized = true;
+  rxFiltersChanged();
+
   return Error::Success;
 }
 
+void LocalNode::rxFiltersChanged()
+{
+  if (!initialized) return;
+
+  std::vector<CanDevice::RxFilter> filters;
+  nmt.addRxFilters(filters);
+  pdo.addRxFilters(filters);
+  sdo.addRxFilters(filters);
+  emcy.addRxFilters(filters);
+  sync.addRxFilters(filters);
+
+  std::sort(filters.begin(), filters.end());
+  filters.erase(std::unique(filters.begin(), filters.end()), filters.end());
+
+  LogDebug("Receiving on %zu filters", filters.size());
+  bus.setRxFilters(filters);
+}
+
 void LocalNode::processFrame(const Msg &msg)
 {
+  // The SYNC COB-ID is configurable, so it can't be routed by function code
+  if (msg.id == sync.getCobid()) {
+    sync.processMsg(msg);
+    return;
+  }
+
   switch (msg.getFunction()) {
     case 0x000:
       nmt.processMsg(msg);
       break;
 
     case 0x080:
-      if (msg.id == 0x080) {
-        // Sync isn't used.
-      }
-      else {
-        emcy.processMsg(msg);
-      }
+      emcy.processMsg(msg);
       break;
 
     case 0x100:
@@ -1,4 +1,5 @@
 #include "canfetti/ObjDict.h"
+#include <algorithm>
 
 using namespace std;
 using namespace canfetti;
@@ -6,15 +7,104 @@ using namespace canfetti;
 //******************************************************************************
 // ObjDict
 //******************************************************************************
-OdEntry *ObjDict::lookup(uint16_t idx, uint8_t subIdx)
+static inline size_t slotFor(uint32_t key, size_t mask)
+{
+  return (key * 0x9E3779B1u) >> 8 & mask;  // Fibonacci hashing spreads sequential keys
+}
+
+ObjDict::~ObjDict()
+{
+  for (size_t i = 0; i < staticCount; ++i) {
+    staticRows[i].detach();
+  }
+}
+
+void canfetti::staticOdDuplicateEntry()
 {
-  if (auto subIdxs = table.find(idx); subIdxs != table.end()) {
-    if (auto entry = subIdxs->second.find(subIdx); entry != subIdxs->second.end()) {
-      return &entry->second;
+  assert(0 && "Duplicate entry in static OD table");
+}
+
+Error ObjDict::attachStatic(const StaticOdEntry *table, size_t n, StaticOdRow *rows)
+{
+  if (staticRows) {
+    LogInfo("Warning: a static OD table is already attached");
+    return Error::Error;
+  }
+
+  for (size_t i = 0; i < n; ++i) {
+    if (lookup(table[i].idx(), table[i].subIdx())) {
+      LogInfo("Warning: index %x[%d] already exists in the OD", table[i].idx(), table[i].subIdx());
+      return Error::Error;
     }
   }
 
-  return nullptr;
+  for (size_t i = 0; i < n; ++i) {
+    rows[i].attach(table[i]);
+    addToIndex(table[i].key, &rows[i]);
+  }
+
+  staticRows  = rows;
+  staticCount = n;
+
+  return Error::Success;
+}
+
+OdEntry *ObjDict::lookup(uint16_t idx, uint8_t subIdx)
+{
+  const uint32_t key = makeKey(idx, subIdx);
+  const size_t mask  = slotKeys.size() - 1;
+
+  if (slotKeys.empty()) return nullptr;
+
+  for (size_t i = slotFor(key, mask);; i = (i + 1) & mask) {
+    if (slotKeys[i] == key) return slotEntries[i];
+    if (slotKeys[i] == EmptySlot) return nullptr;
+  }
+}
+
+OdProxy ObjDict::view(OdEntry &entry)
+{
+  if (OdVariant *v = entry.variant()) return OdProxy(entry.idx(), entry.subIdx(), *v);
+  return OdProxy(entry.idx(), entry.subIdx(), entry.buffer(), entry.size());
+}
+
+void ObjDict::addToIndex(uint32_t key, OdEntry *entry)
+{
+  if ((++indexed << 1) > slotKeys.size()) {
+    growIndex();
+  }
+
+  const size_t mask = slotKeys.size() - 1;
+  size_t i          = slotFor(key, mask);
+
+  while (slotKeys[i] != EmptySlot) {
+    i = (i + 1) & mask;
+  }
+
+  slotKeys[i]    = key;
+  slotEntries[i] = entry;
+}
+
+void ObjDict::growIndex()
+{
+  std::vector<uint32_t> oldKeys(std::max<size_t>(slotKeys.size() << 1, 64), EmptySlot);
+  std::vector<OdEntry *> oldEntries(oldKeys.size(), nullptr);
+  oldKeys.swap(slotKeys);
+  oldEntries.swap(slotEntries);
+
+  const size_t mask = slotKeys.size() - 1;
+
+  for (size_t s = 0; s < oldKeys.size(); ++s) {
+    if (oldKeys[s] == EmptySlot) continue;
+
+    size_t i = slotFor(oldKeys[s], mask);
+    while (slotKeys[i] != EmptySlot) {
+      i = (i + 1) & mask;
+    }
+
+    slotKeys[i]    = oldKeys[s];
+    slotEntries[i] = oldEntries[s];
+  }
 }
 
 Error ObjDict::registerCallback(uint16_t idx, uint8_t subIdx, ChangedCallback cb)
@@ -47,6 +137,16 @@ Error ObjDict::generation(uint16_t idx, uint8_t subIdx, uint32_t& generationOut)
   return Error::IndexNotFound;
 }
 
+Error ObjDict::rxTimestamp(uint16_t idx, uint8_t subIdx, uint64_t& timestampOut)
+{
+  if (auto entry = lookup(idx, subIdx)) {
+    timestampOut = entry->rxTimestamp;
+    return Error::Success;
+  }
+
+  return Error::IndexNotFound;
+}
+
 std::tuple<Error, OdProxy> ObjDict::makeProxy(uint16_t idx, uint8_t subIdx)
 {
   OdEntry *entry = lookup(idx, subIdx);
@@ -63,35 +163,48 @@ std::tuple<Error, OdProxy> ObjDict::makeProxy(uint16_t idx, uint8_t subIdx)
 
 void ObjDict::dumpTable()
 {
-  for (auto &idx : table) {
-    LogInfo("%x:", idx.first);
-
-    for (auto &subIdx : idx.second) {
-      auto f = [&](auto &&arg) {
-        using T       = std::decay_t<decltype(arg)>;
-        const char *a = subIdx.second.access == canfetti::Access::RO ? "RO" : subIdx.second.access == canfetti::Access::RW ? "RW" : "WO";
-
-        if constexpr (std::is_same_v<T, std::vector<uint8_t>>) {
-          LogInfo("    %d: (%s) u8[%zu]", subIdx.first, a, arg.size());
-        }
-        else if constexpr (std::is_same_v<T, std::string>) {
-          LogInfo("    %d: (%s) \"%s\"", subIdx.first, a, arg.c_str());
-        }
-        else if constexpr (std::is_same_v<T, canfetti::OdBuffer>) {
-          LogInfo("    %d: (%s) %s", subIdx.first, a, "Proxy");
-        }
-        else if constexpr (std::is_same_v<T, canfetti::OdDynamicVar>) {
-          LogInfo("    %d: (%s) %s", subIdx.first, a, "Dynamic");
-        }
-        else if constexpr (std::is_same_v<T, float>) {
-          LogInfo("    %d: (%s) %f", subIdx.first, a, (double)arg);
-        }
-        else {
-          LogInfo("    %d: (%s) 0x%x", subIdx.first, a, (unsigned)arg);
-        }
-      };
-
-      std::visit(f, subIdx.second.data);
+  std::vector<std::tuple<uint32_t, OdEntry *>> sorted;
+
+  for (size_t s = 0; s < slotKeys.size(); ++s) {
+    if (slotKeys[s] != EmptySlot) sorted.emplace_back(slotKeys[s], slotEntries[s]);
+  }
+
+  std::sort(sorted.begin(), sorted.end());
+
+  for (size_t i = 0; i < sorted.size(); ++i) {
+    auto [key, e]  = sorted[i];
+    uint16_t idx   = key >> 8;
+    uint8_t subIdx = key & 0xff;
+    OdEntry &entry = *e;
+
+    if (i == 0 || (std::get<0>(sorted[i - 1]) >> 8) != idx) {
+      LogInfo("%x:", idx);
     }
+
+    auto f = [&](auto &&arg) {
+      using T       = std::decay_t<decltype(arg)>;
+      const char *a = entry.access == canfetti::Access::RO ? "RO" : entry.access == canfetti::Access::RW ? "RW" : "WO";
+
+      if constexpr (std::is_same_v<T, std::vector<uint8_t>>) {
+        LogInfo("    %d: (%s) u8[%zu]", subIdx, a, arg.size());
+      }
+      else if constexpr (std::is_same_v<T, std::string>) {
+        LogInfo("    %d: (%s) \"%s\"", subIdx, a, arg.c_str());
+      }
+      else if constexpr (std::is_same_v<T, canfetti::OdBuffer>) {
+        LogInfo("    %d: (%s) %s", subIdx, a, "Proxy");
+      }
+      else if constexpr (std::is_same_v<T, canfetti::OdDynamicVar>) {
+        LogInfo("    %d: (%s) %s", subIdx, a, "Dynamic");
+      }
+      else if constexpr (std::is_same_v<T, float>) {
+        LogInfo("    %d: (%s) %f", subIdx, a, (double)arg);
+      }
+      else {
+        LogInfo("    %d: (%s) 0x%x", subIdx, a, (unsigned)arg);
+      }
+    };
+
+    entry.visit(f);
   }
 }
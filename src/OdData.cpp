@@ -31,25 +31,20 @@ size_t canfetti::size(const OdVariant &v)
 //******************************************************************************
 // OdEntry
 //******************************************************************************
-OdEntry::OdEntry(uint16_t i, uint8_t s, Access a, OdVariant d, ChangedCallback cb) : access(a), data(d), idx(i), subIdx(s)
-{
-  addCallback(std::move(cb));
-}
-
 bool OdEntry::lock()
 {
   if (locked) return false;
   locked = true;
-  if (OdDynamicVar *dvar = std::get_if<OdDynamicVar>(&data); dvar && dvar->beginAccess) {
-    dvar->beginAccess(idx, subIdx);
+  if (OdDynamicVar *dvar = get_if<OdDynamicVar>(); dvar && dvar->beginAccess) {
+    dvar->beginAccess(idx(), subIdx());
   }
   return true;
 }
 
 void OdEntry::unlock()
 {
-  if (OdDynamicVar *dvar = std::get_if<OdDynamicVar>(&data); locked && dvar && dvar->endAccess) {
-    dvar->endAccess(idx, subIdx);
+  if (OdDynamicVar *dvar = get_if<OdDynamicVar>(); locked && dvar && dvar->endAccess) {
+    dvar->endAccess(idx(), subIdx());
   }
   locked = false;
 }
@@ -61,19 +56,88 @@ bool OdEntry::isLocked()
 
 void OdEntry::fireCallbacks()
 {
+  if (!callbacks) return;
+
   // May mutate in callback but never reduces in size
-  for (size_t i = 0; i < callbacks.size(); ++i) {
-    callbacks[i](idx, subIdx);
+  for (size_t i = 0; i < callbacks->size(); ++i) {
+    (*callbacks)[i](idx(), subIdx());
   }
 }
 
 void OdEntry::addCallback(ChangedCallback cb)
 {
   if (cb) {
-    callbacks.emplace_back(std::move(cb));
+    if (!callbacks) callbacks = std::make_unique<std::vector<ChangedCallback>>();
+    callbacks->emplace_back(std::move(cb));
   }
 }
 
+uint8_t *OdEntry::buffer()
+{
+  uint8_t *buf = nullptr;
+
+  visit([&](auto &&arg) {
+    using T = std::decay_t<decltype(arg)>;
+
+    if constexpr (std::is_same_v<T, OdBuffer>) {
+      buf = arg.buf;
+    }
+    else if constexpr (std::is_arithmetic_v<T>) {
+      buf = reinterpret_cast<uint8_t *>(&arg);
+    }
+    // Otherwise resizable or dynamic
+  });
+
+  return buf;
+}
+
+size_t OdEntry::size()
+{
+  if (OdVariant *v = variant()) return canfetti::size(*v);
+
+  size_t len = 0;
+  visit([&](auto &&arg) {
+    using T = std::decay_t<decltype(arg)>;
+
+    if constexpr (std::is_same_v<T, OdBuffer>) {
+      len = arg.len;
+    }
+    else {
+      len = sizeof(arg);
+    }
+  });
+  return len;
+}
+
+OdRuntimeEntry::OdRuntimeEntry(uint16_t i, uint8_t s, Access a, OdVariant d, ChangedCallback cb) : OdEntry(i, s, a), data(d)
+{
+  addCallback(std::move(cb));
+}
+
+void StaticOdRow::attach(const StaticOdEntry &d)
+{
+  desc        = &d;
+  key         = d.key;
+  access      = d.access;
+  rxTimestamp = 0;
+  locked      = false;
+  bumpGeneration();
+  callbacks.reset();
+
+  std::visit(
+      [this](auto &&arg) {
+        using T = std::decay_t<decltype(arg)>;
+        if constexpr (!std::is_same_v<T, StaticOdRef>) new (value) T(arg);
+      },
+      d.value);
+}
+
+void StaticOdRow::detach()
+{
+  desc = nullptr;
+  callbacks.reset();
+}
+
 //******************************************************************************
 // OdProxy
 //******************************************************************************
@@ -92,14 +156,23 @@ OdProxy::OdProxy(uint16_t idx, uint8_t subIdx, OdVariant &v) : idx(idx), subIdx(
   reset();
 }
 
-OdProxy::OdProxy(uint16_t idx, uint8_t subIdx, OdEntry &e) : idx(idx), subIdx(subIdx), v(&e.data), e(&e)
+OdProxy::OdProxy(uint16_t idx, uint8_t subIdx, OdEntry &e) : idx(idx), subIdx(subIdx), v(e.variant()), e(&e)
 {
   assert(e.isLocked());
+  if (!v) {
+    base    = e.buffer();
+    baseLen = e.size();
+  }
+  reset();
+}
+
+OdProxy::OdProxy(uint16_t idx, uint8_t subIdx, uint8_t *buf, size_t len) : idx(idx), subIdx(subIdx), base(buf), baseLen(len)
+{
   reset();
 }
 
 OdProxy::OdProxy(OdProxy &&o)
-    : idx(o.idx), subIdx(o.subIdx), changed(o.changed), v(o.v), e(o.e), ptr(o.ptr), off(o.off), len(o.len), dVar(o.dVar)
+    : idx(o.idx), subIdx(o.subIdx), changed(o.changed), v(o.v), e(o.e), ptr(o.ptr), off(o.off), len(o.len), dVar(o.dVar), base(o.base), baseLen(o.baseLen)
 {
   o.e = nullptr;
 }
@@ -156,6 +229,15 @@ Error OdProxy::reset()
   };
 
   changed = false;
+
+  if (!v && !roV) {
+    ptr  = base;
+    off  = 0;
+    len  = baseLen;
+    dVar = nullptr;
+    return Error::Success;
+  }
+
   std::visit(f, readOnly ? *const_cast<OdVariant *>(roV) : *v);
 
   return Error::Success;
@@ -163,7 +245,7 @@ Error OdProxy::reset()
 
 bool OdProxy::resize(size_t newSize)
 {
-  if (readOnly) return false;
+  if (readOnly || !v) return false;
 
   auto f = [=](auto &&arg) {
     using T = std::decay_t<decltype(arg)>;
@@ -195,6 +277,38 @@ bool OdProxy::resize(size_t newSize)
   return std::visit(f, *v);
 }
 
+Error OdProxy::seek(size_t offset)
+{
+  if (offset > len) {
+    LogInfo("Seek past end of %x[%d]", idx, subIdx);
+    return Error::ParamLength;
+  }
+
+  off = offset;
+  return Error::Success;
+}
+
+bool OdProxy::resizable()
+{
+  if (readOnly || !v) return false;
+
+  auto f = [](auto &&arg) {
+    using T = std::decay_t<decltype(arg)>;
+
+    if constexpr (std::is_same_v<T, std::vector<uint8_t>> || std::is_same_v<T, std::string>) {
+      return true;
+    }
+    else if constexpr (std::is_same_v<T, OdDynamicVar>) {
+      return !!arg.resize;
+    }
+    else {
+      return false;
+    }
+  };
+
+  return std::visit(f, *v);
+}
+
 size_t OdProxy::remaining()
 {
   return len - off;
@@ -1,12 +1,19 @@
 #include "canfetti/LinuxCo.h"
 #include <stdarg.h>
 #include <string.h>
+#include <sys/epoll.h>
+#include <sys/eventfd.h>
+#include <poll.h>
 #include <sys/ioctl.h>
 #include <sys/socket.h>
+#include <sys/timerfd.h>
 #include <unistd.h>
 #include <string>
 #include <thread>
+#include "linux/can/bcm.h"
 #include "linux/can/raw.h"
+#include "linux/errqueue.h"
+#include "linux/net_tstamp.h"
 #include "net/if.h"
 
 using namespace canfetti;
@@ -36,9 +43,20 @@ const System::TimerHdl System::InvalidTimer{nullptr};
 
 System::TimerHdl System::resetTimer(System::TimerHdl &hdl)
 {
-  if (!hdl) return InvalidTimer;
+  if (!hdl || hdl->available) return InvalidTimer;
   hdl->enable   = true;
   hdl->deadline = std::chrono::steady_clock::now() + hdl->interval;
+  enqueue(hdl);
+  generation = newGeneration();
+  return hdl;
+}
+
+System::TimerHdl System::resetTimer(System::TimerHdl &hdl, uint32_t delayMs)
+{
+  if (!hdl || hdl->available) return InvalidTimer;
+  hdl->enable   = true;
+  hdl->deadline = std::chrono::steady_clock::now() + std::chrono::milliseconds(delayMs);
+  enqueue(hdl);
   generation = newGeneration();
   return hdl;
 }
@@ -46,8 +64,17 @@ System::TimerHdl System::resetTimer(System::TimerHdl &hdl)
 void System::deleteTimer(System::TimerHdl &hdl)
 {
   if (!hdl) return;
-  hdl->available = true;
-  hdl->enable = false;
+  if (!hdl->available) {
+    dequeue(*hdl);
+    phaseSlots.release(std::chrono::duration_cast<std::chrono::milliseconds>(hdl->interval).count(), hdl->phaseSlot);
+    hdl->phaseSlot = PhaseSlots::NoSlot;
+    hdl->available = true;
+    hdl->enable    = false;
+    activeTimers--;
+
+    // serviceTimers() frees it after the callback returns
+    if (!hdl->firing) freeTimers.push_back(hdl);
+  }
   hdl = InvalidTimer;
 }
 
@@ -55,6 +82,7 @@ void System::disableTimer(System::TimerHdl &hdl)
 {
   if (!hdl) return;
   hdl->enable = false;
+  dequeue(*hdl);
 }
 
 System::TimerHdl System::scheduleDelayed(uint32_t delayMs, std::function<void()> cb)
@@ -66,20 +94,31 @@ System::TimerHdl System::scheduleDelayed(uint32_t delayMs, std::function<void()>
   hdl->interval = std::chrono::milliseconds(delayMs);
   hdl->deadline = std::chrono::steady_clock::now() + hdl->interval;
   hdl->callback = cb;
+  enqueue(hdl);
   generation = newGeneration();
   return hdl;
 }
 
 System::TimerHdl System::schedulePeriodic(uint32_t periodMs, std::function<void()> cb, bool staggeredStart)
 {
-  auto hdl            = getAvailableTimer();
-  auto staggeredDelay = std::chrono::milliseconds(staggeredStart ? prng() % (periodMs << 1) : 0);
-  hdl->available      = false;
-  hdl->enable         = true;
-  hdl->repeat         = true;
-  hdl->interval       = std::chrono::milliseconds(periodMs);
-  hdl->deadline       = std::chrono::steady_clock::now() + hdl->interval + staggeredDelay;
-  hdl->callback       = cb;
+  auto hdl       = getAvailableTimer();
+  auto now       = std::chrono::steady_clock::now();
+  hdl->available = false;
+  hdl->enable    = true;
+  hdl->repeat    = true;
+  hdl->interval  = std::chrono::milliseconds(periodMs);
+  hdl->deadline  = now + hdl->interval;
+  hdl->callback  = cb;
+
+  // First deadline is the next point on this timer's phase grid
+  if (staggeredStart && periodMs) {
+    hdl->phaseSlot = phaseSlots.acquire(periodMs);
+    uint32_t off   = hdl->phaseSlot == PhaseSlots::NoSlot ? 0 : PhaseSlots::offset(hdl->phaseSlot, periodMs);
+    auto phase     = epoch + std::chrono::milliseconds(off);
+    hdl->deadline  = phase + ((now - phase) / hdl->interval + 1) * hdl->interval;
+  }
+
+  enqueue(hdl);
   generation = newGeneration();
   return hdl;
 }
@@ -87,51 +126,131 @@ System::TimerHdl System::schedulePeriodic(uint32_t periodMs, std::function<void(
 void System::serviceTimers()
 {
   auto now = std::chrono::steady_clock::now();
-  // May mutate in callback, but never decreases in size
-  for (size_t i = 0; i < timers.size(); ++i) {
-    auto &t = timers[i];
-    if (t->enable && t->deadline <= now) {
-      if (t->repeat) {
-        t->deadline = now + t->interval;
-      }
-      else {
-        t->enable = false;
+
+  // Fire each expired timer at most once per call, even if it rescheduled
+  // itself into the past
+  for (size_t budget = heap.size(); budget && !heap.empty() && heap.front()->deadline <= now; --budget) {
+    TimerHdl hdl = heap.front();
+    Timer &t     = *hdl;
+
+    if (t.repeat) {
+      t.deadline += t.interval;
+
+      // Skip missed periods rather than firing them back to back
+      if (t.deadline <= now && t.interval.count()) {
+        auto missed = (now - t.deadline) / t.interval + 1;
+        t.deadline += missed * t.interval;
+        overruns += missed;
       }
-      t->callback();
+
+      siftDown(0);
+    }
+    else {
+      t.enable = false;
+      dequeue(t);
+    }
+
+    t.firing = true;
+    t.callback();
+    t.firing = false;
+
+    // Deleted from within its own callback
+    if (t.available) {
+      freeTimers.push_back(std::move(hdl));
     }
   }
 }
 
 size_t System::getTimerCount()
 {
-  size_t n = 0;
-  for (size_t i = 0; i < timers.size(); ++i) {
-    if (!timers[i]->available) ++n;
-  }
-  return n;
+  return activeTimers;
 }
 
 std::chrono::steady_clock::time_point System::nextTimerDeadline()
 {
-  auto deadline = std::chrono::steady_clock::now() + std::chrono::hours(1);
-  for (const auto &t : timers) {
-    if (t->enable && deadline > t->deadline) {
-      deadline = t->deadline;
-    }
+  if (heap.empty()) {
+    return std::chrono::steady_clock::now() + std::chrono::hours(1);
   }
-  return deadline;
+  return heap.front()->deadline;
 }
 
 System::TimerHdl System::getAvailableTimer()
 {
-  for (const auto &t : timers) {
-    if (t->available) return t;
+  TimerHdl t;
+
+  if (!freeTimers.empty()) {
+    t = std::move(freeTimers.back());
+    freeTimers.pop_back();
+  }
+  else {
+    t = std::make_shared<Timer>();
   }
-  auto t = std::make_shared<Timer>();
-  timers.push_back(t);
+
+  activeTimers++;
   return t;
 }
 
+void System::enqueue(const TimerHdl &hdl)
+{
+  Timer &t = *hdl;
+
+  if (t.heapIdx == Timer::NotQueued) {
+    t.heapIdx = heap.size();
+    heap.push_back(hdl);
+    siftUp(t.heapIdx);
+  }
+  else {
+    // Deadline may have moved either way
+    siftUp(t.heapIdx);
+    siftDown(t.heapIdx);
+  }
+}
+
+void System::dequeue(Timer &t)
+{
+  size_t i = t.heapIdx;
+  if (i == Timer::NotQueued) return;
+
+  t.heapIdx = Timer::NotQueued;
+  TimerHdl last = std::move(heap.back());
+  heap.pop_back();
+
+  if (last.get() != &t) {
+    Timer &moved  = *last;
+    heap[i]       = std::move(last);
+    moved.heapIdx = i;
+    siftUp(i);
+    siftDown(moved.heapIdx);
+  }
+}
+
+void System::siftUp(size_t i)
+{
+  while (i > 0) {
+    size_t parent = (i - 1) / 2;
+    if (heap[parent]->deadline <= heap[i]->deadline) break;
+    std::swap(heap[parent], heap[i]);
+    heap[parent]->heapIdx = parent;
+    heap[i]->heapIdx      = i;
+    i                     = parent;
+  }
+}
+
+void System::siftDown(size_t i)
+{
+  for (;;) {
+    size_t smallest = i;
+    size_t l = 2 * i + 1, r = 2 * i + 2;
+    if (l < heap.size() && heap[l]->deadline < heap[smallest]->deadline) smallest = l;
+    if (r < heap.size() && heap[r]->deadline < heap[smallest]->deadline) smallest = r;
+    if (smallest == i) break;
+    std::swap(heap[smallest], heap[i]);
+    heap[smallest]->heapIdx = smallest;
+    heap[i]->heapIdx        = i;
+    i                       = smallest;
+  }
+}
+
 //******************************************************************************
 // Device
 //******************************************************************************
@@ -151,12 +270,29 @@ canfetti::Error LinuxCoDev::open(const char *device)
     return Error::HwError;
   }
 
+  // Before bind() so unwanted frames are never queued
+  if (Error e = applyRxFilters(); e != Error::Success) {
+    return e;
+  }
+
   strcpy(ifr.ifr_name, device);
   if (ioctl(s, SIOCGIFINDEX, &ifr) == -1) {
     perror("ioctl(SIOCGIFINDEX) failed");
     return Error::HwError;
   }
 
+  if (fd) {
+    int enable = 1;
+    if (ioctl(s, SIOCGIFMTU, &ifr) == -1 || ifr.ifr_mtu != CANFD_MTU) {
+      LogInfo("%s is not CAN FD capable", device);
+      return Error::HwError;
+    }
+    if (setsockopt(s, SOL_CAN_RAW, CAN_RAW_FD_FRAMES, &enable, sizeof enable) == -1) {
+      perror("setsockopt(CAN_RAW_FD_FRAMES) failed");
+      return Error::HwError;
+    }
+  }
+
   addr.can_family  = AF_CAN;
   addr.can_ifindex = ifr.ifr_ifindex;
 
@@ -180,6 +316,252 @@ canfetti::Error LinuxCoDev::open(const char *device)
     return Error::HwError;
   }
 
+  // Clamped to the kernel minimum, a few frames. Keeping the device queue
+  // short leaves the backlog in our priority queues, and makes a full device
+  // show up as EAGAIN and POLLOUT rather than ENOBUFS.
+  // Not fatal; the backlog then just builds up in the device queue first.
+  int sndbuf = 0;
+  if (setsockopt(s, SOL_SOCKET, SO_SNDBUF, &sndbuf, sizeof sndbuf) == -1) {
+    perror("setsockopt(SO_SNDBUF) failed");
+  }
+
+  // Receive times come with each frame as a control message. Not fatal
+  // without them; frames are just left untimestamped.
+  int tsFlags = SOF_TIMESTAMPING_RX_SOFTWARE | SOF_TIMESTAMPING_SOFTWARE;
+  if (hwTimestamps) tsFlags |= SOF_TIMESTAMPING_RX_HARDWARE | SOF_TIMESTAMPING_RAW_HARDWARE;
+  if (setsockopt(s, SOL_SOCKET, SO_TIMESTAMPING, &tsFlags, sizeof tsFlags) == -1) {
+    perror("setsockopt(SO_TIMESTAMPING) failed");
+  }
+
+  if (cyclicOffload || rxChangeOffload) {
+    bcm = socket(PF_CAN, SOCK_DGRAM, CAN_BCM);
+    if (bcm == -1 || connect(bcm, (struct sockaddr *)&addr, sizeof(addr)) == -1) {
+      perror("CAN_BCM setup failed");
+      return Error::HwError;
+    }
+    if (setsockopt(bcm, SOL_SOCKET, SO_TIMESTAMPING, &tsFlags, sizeof tsFlags) == -1) {
+      perror("setsockopt(SO_TIMESTAMPING) failed");
+    }
+  }
+
+  return Error::Success;
+}
+
+canfetti::Error LinuxCoDev::open(int socket)
+{
+  s = socket;
+  return Error::Success;
+}
+
+void LinuxCoDev::rxTimestamps(struct msghdr &hdr, RxFrame &rx)
+{
+  rx.timestamp   = 0;
+  rx.hwTimestamp = 0;
+
+  for (struct cmsghdr *c = CMSG_FIRSTHDR(&hdr); c; c = CMSG_NXTHDR(&hdr, c)) {
+    if (c->cmsg_level != SOL_SOCKET || c->cmsg_type != SCM_TIMESTAMPING) continue;
+
+    struct scm_timestamping ts;
+    memcpy(&ts, CMSG_DATA(c), sizeof(ts));
+
+    // ts[0] is the kernel's CLOCK_REALTIME, ts[2] the adapter's raw clock
+    rx.timestamp = (uint64_t)ts.ts[0].tv_sec * 1000000000 + ts.ts[0].tv_nsec;
+    if (hwTimestamps) rx.hwTimestamp = (uint64_t)ts.ts[2].tv_sec * 1000000000 + ts.ts[2].tv_nsec;
+    return;
+  }
+}
+
+Error LinuxCoDev::writeCyclic(const canfetti::Msg &msg, uint32_t periodMs)
+{
+  if (bcm == -1) return Error::UnsupportedAccess;
+
+  // bcm_msg_head ends in a flexible array of the frames. A classic frame is
+  // laid out the same as the start of an FD one.
+  alignas(struct bcm_msg_head) uint8_t setup[sizeof(struct bcm_msg_head) + sizeof(struct canfd_frame)] = {};
+  auto &head  = *reinterpret_cast<struct bcm_msg_head *>(setup);
+  auto &frame = *reinterpret_cast<struct canfd_frame *>(setup + sizeof(head));
+  canid_t id  = msg.id > CAN_SFF_MASK ? msg.id | CAN_EFF_FLAG : msg.id;
+  bool isFd   = msg.fd || msg.len > MaxClassicLen;
+
+  // Without SETTIMER/STARTTIMER the kernel just swaps in the new content,
+  // keeping its cycle
+  head.opcode  = TX_SETUP;
+  head.can_id  = id;
+  head.nframes = 1;
+  if (periodMs) {
+    head.flags         = SETTIMER | STARTTIMER;
+    head.ival2.tv_sec  = periodMs / 1000;
+    head.ival2.tv_usec = (periodMs % 1000) * 1000;
+  }
+
+  if (isFd) {
+    head.flags |= CAN_FD_FRAME;
+    frame.flags = brs ? CANFD_BRS : 0;
+  }
+
+  assert(msg.len <= (isFd ? MaxFdLen : MaxClassicLen));
+  frame.can_id = id;
+  frame.len    = msg.len;
+  if (msg.len) memcpy(frame.data, msg.data, msg.len);
+
+  ssize_t size = sizeof(head) + (isFd ? CANFD_MTU : CAN_MTU);
+  if (::write(bcm, setup, size) != size) {
+    perror("CAN_BCM TX_SETUP failed");
+    stats.droppedTx++;
+    return Error::HwError;
+  }
+
+  return Error::Success;
+}
+
+void LinuxCoDev::stopCyclic(uint32_t id)
+{
+  if (bcm == -1) return;
+
+  struct bcm_msg_head head = {};
+  head.opcode              = TX_DELETE;
+  head.can_id              = id > CAN_SFF_MASK ? id | CAN_EFF_FLAG : id;
+
+  if (::write(bcm, &head, sizeof(head)) != sizeof(head)) {
+    perror("CAN_BCM TX_DELETE failed");
+  }
+}
+
+Error LinuxCoDev::setRxChangeFilter(uint32_t id, uint8_t len, uint32_t timeoutMs)
+{
+  if (bcm == -1 || !rxChangeOffload) return Error::UnsupportedAccess;
+
+  alignas(struct bcm_msg_head) uint8_t setup[sizeof(struct bcm_msg_head) + sizeof(struct canfd_frame)] = {};
+  auto &head    = *reinterpret_cast<struct bcm_msg_head *>(setup);
+  auto &frame   = *reinterpret_cast<struct canfd_frame *>(setup + sizeof(head));
+  canid_t canId = id > CAN_SFF_MASK ? id | CAN_EFF_FLAG : id;
+  // The kernel matches either classic or FD frames on an id, not both, so
+  // this goes by what a payload of len bytes has to be sent as
+  bool isFd = len > MaxClassicLen;
+
+  // Resending RX_SETUP also forgets the last frame, so the next one is
+  // delivered whatever its content. After a timeout, the first frame is always
+  // delivered so the stack sees the RPDO resume.
+  head.opcode = RX_SETUP;
+  head.can_id = canId;
+  head.flags  = RX_CHECK_DLC | RX_ANNOUNCE_RESUME;
+  if (isFd) head.flags |= CAN_FD_FRAME;
+  if (timeoutMs) {
+    head.flags |= SETTIMER | STARTTIMER;
+    head.ival1.tv_sec  = timeoutMs / 1000;
+    head.ival1.tv_usec = (timeoutMs % 1000) * 1000;
+  }
+
+  // Compare the bytes the RPDOs map. With none, just pass the id through.
+  size_t size = sizeof(head) + (isFd ? CANFD_MTU : CAN_MTU);
+  if (len) {
+    head.nframes = 1;
+    frame.can_id = canId;
+    frame.len    = fdPayloadLen(std::min(len, MaxFdLen));
+    memset(frame.data, 0xff, std::min(len, MaxFdLen));
+  }
+  else {
+    head.flags |= RX_FILTER_ID;
+    size = sizeof(head);
+  }
+
+  if (::write(bcm, setup, size) != static_cast<ssize_t>(size)) {
+    perror("CAN_BCM RX_SETUP failed");
+    return Error::HwError;
+  }
+
+  return Error::Success;
+}
+
+void LinuxCoDev::clearRxChangeFilter(uint32_t id)
+{
+  if (bcm == -1) return;
+
+  struct bcm_msg_head head = {};
+  head.opcode              = RX_DELETE;
+  head.can_id              = id > CAN_SFF_MASK ? id | CAN_EFF_FLAG : id;
+
+  if (::write(bcm, &head, sizeof(head)) != sizeof(head)) {
+    perror("CAN_BCM RX_DELETE failed");
+  }
+}
+
+void LinuxCoDev::readBcm(std::vector<RxFrame> &frames)
+{
+  alignas(struct bcm_msg_head) uint8_t buf[sizeof(struct bcm_msg_head) + sizeof(struct canfd_frame)];
+  auto &head  = *reinterpret_cast<struct bcm_msg_head *>(buf);
+  auto &frame = *reinterpret_cast<struct canfd_frame *>(buf + sizeof(head));
+  RxControl control;
+  struct iovec iov = {buf, sizeof(buf)};
+
+  if (bcm == -1) return;
+
+  for (;;) {
+    struct msghdr hdr  = {};
+    hdr.msg_iov        = &iov;
+    hdr.msg_iovlen     = 1;
+    hdr.msg_control    = &control;
+    hdr.msg_controllen = sizeof(control);
+    ssize_t r          = ::recvmsg(bcm, &hdr, MSG_DONTWAIT);
+
+    if (r < 0) {
+      if (errno != EAGAIN) perror("CAN_BCM read");
+      return;
+    }
+
+    bool isFd = head.flags & CAN_FD_FRAME;
+    if (head.opcode == RX_CHANGED && head.nframes == 1 && r == (ssize_t)(sizeof(head) + (isFd ? CANFD_MTU : CAN_MTU))) {
+      RxFrame rx = {.frame = {}, .fd = isFd, .timestamp = 0, .hwTimestamp = 0};
+      rxTimestamps(hdr, rx);
+      memcpy(&rx.frame, &frame, isFd ? CANFD_MTU : CAN_MTU);
+      frames.push_back(rx);
+    }
+    else if (head.opcode == RX_TIMEOUT) {
+      RxFrame timeout      = {};
+      timeout.frame.can_id = (head.can_id & CAN_EFF_MASK) | RxTimeoutFlag;
+      frames.push_back(timeout);
+    }
+  }
+}
+
+void LinuxCoDev::setRxFilters(const std::vector<RxFilter> &filters)
+{
+  rxFilters.clear();
+
+  // Past the kernel's limit, fall back to receiving everything
+  if (filters.size() <= CAN_RAW_FILTER_MAX) {
+    for (auto &&f : filters) {
+      bool eff = f.id > CAN_SFF_MASK;
+      rxFilters.push_back({
+          .can_id   = eff ? f.id | CAN_EFF_FLAG : f.id,
+          .can_mask = f.mask | CAN_EFF_FLAG,  // Don't let 11 bit filters match 29 bit ids or vice versa
+      });
+    }
+  }
+  else {
+    LogInfo("%zu rx filters exceed CAN_RAW_FILTER_MAX, receiving all frames", filters.size());
+  }
+
+  if (s != -1) applyRxFilters();
+}
+
+Error LinuxCoDev::applyRxFilters()
+{
+  if (rxFilters.empty()) {
+    // Default raw socket filter: everything
+    struct can_filter all = {.can_id = 0, .can_mask = 0};
+    if (setsockopt(s, SOL_CAN_RAW, CAN_RAW_FILTER, &all, sizeof(all)) == -1) {
+      perror("setsockopt(CAN_RAW_FILTER) failed");
+      return Error::HwError;
+    }
+    return Error::Success;
+  }
+
+  if (setsockopt(s, SOL_CAN_RAW, CAN_RAW_FILTER, rxFilters.data(), rxFilters.size() * sizeof(rxFilters[0])) == -1) {
+    perror("setsockopt(CAN_RAW_FILTER) failed");
+    return Error::HwError;
+  }
+
   return Error::Success;
 }
 
@@ -197,41 +579,243 @@ Error LinuxCoDev::read(struct can_frame &frame, bool nonblock)
   return r > 0 ? Error::Success : Error::Timeout;
 }
 
-Error LinuxCoDev::write(const Msg &msg, bool async)
+static void recordBatch(std::atomic<size_t> &batches, std::atomic<size_t> &frames, std::atomic<size_t> &maxBatch, size_t n)
+{
+  batches.fetch_add(1, std::memory_order_relaxed);
+  frames.fetch_add(n, std::memory_order_relaxed);
+  if (n > maxBatch.load(std::memory_order_relaxed)) maxBatch.store(n, std::memory_order_relaxed);
+}
+
+
+LinuxCoDev::TxClass LinuxCoDev::classify(canid_t id)
+{
+  if (id & CAN_EFF_FLAG) return TxClass::Pdo;
+
+  switch (id & 0x780) {
+    case 0x000:
+    case 0x700:
+      return TxClass::NmtEmcy;
+
+    case 0x080:
+      // The default SYNC COB-ID; the rest of the range is EMCY
+      return (id & CAN_SFF_MASK) == 0x080 ? TxClass::Sync : TxClass::NmtEmcy;
+
+    case 0x100:
+      return TxClass::Sync;
+
+    case 0x580:
+    case 0x600:
+      return TxClass::Sdo;
+
+    default:
+      return TxClass::Pdo;
+  }
+}
+
+// Called with txMtx held
+Error LinuxCoDev::enqueue(TxClass c, const TxEntry &entry)
+{
+  TxQueue &q = txQueues[static_cast<size_t>(c)];
+
+  if (q.entries.size() >= q.limit) {
+    q.stats.dropped++;
+    stats.droppedTx++;
+    if (q.policy == TxDropPolicy::DropNewest || q.entries.empty()) {
+      return Error::OutOfMemory;
+    }
+    q.entries.pop_front();
+    txQueued--;
+  }
+
+  q.entries.push_back(entry);
+  q.entries.back().queuedAt = std::chrono::steady_clock::now();
+  txQueued++;
+  q.stats.depth    = q.entries.size();
+  q.stats.maxDepth = std::max(q.stats.maxDepth, q.stats.depth);
+  return Error::Success;
+}
+
+// Remove the first n queued frames in priority order. Called with txMtx held.
+void LinuxCoDev::popTxEntries(size_t n, bool sent)
+{
+  auto now = std::chrono::steady_clock::now();
+
+  for (auto &q : txQueues) {
+    for (; n && !q.entries.empty(); --n) {
+      if (sent) {
+        uint64_t us = std::chrono::duration_cast<std::chrono::microseconds>(now - q.entries.front().queuedAt).count();
+        q.stats.sent++;
+        q.stats.totalLatencyUs += us;
+        q.stats.maxLatencyUs = std::max(q.stats.maxLatencyUs, us);
+      }
+      else {
+        q.stats.dropped++;
+        stats.droppedTx++;
+      }
+      q.entries.pop_front();
+      txQueued--;
+    }
+    q.stats.depth = q.entries.size();
+  }
+}
+
+// Called with txMtx held
+Error LinuxCoDev::drainTxQueues()
+{
+  constexpr size_t MaxTxBatch = 64;
+  Error err                   = Error::Success;
+
+  while (txQueued.load(std::memory_order_relaxed)) {
+    // Batch in priority order, so whatever the socket doesn't take is the
+    // lowest priority. The queues don't change until sendmmsg() returns, so
+    // frames are sent from where they sit.
+    txIovs.clear();
+    for (auto &q : txQueues) {
+      for (auto e = q.entries.begin(); e != q.entries.end() && txIovs.size() < MaxTxBatch; ++e) {
+        txIovs.push_back({&e->frame, e->fd ? CANFD_MTU : CAN_MTU});
+      }
+    }
+    txMsgs.resize(txIovs.size());
+    for (size_t i = 0; i < txIovs.size(); ++i) {
+      txMsgs[i]                    = {};
+      txMsgs[i].msg_hdr.msg_iov    = &txIovs[i];
+      txMsgs[i].msg_hdr.msg_iovlen = 1;
+    }
+
+    int n = sendmmsg(s, txMsgs.data(), txMsgs.size(), MSG_DONTWAIT);
+    if (n < 0) {
+      // Device queue full: keep everything until the socket polls writable
+      if (errno == ENOBUFS || errno == EAGAIN) break;
+
+      // Drop the frame the kernel refused and carry on with the rest
+      LogDebug("can socket write: errno %d", errno);
+      popTxEntries(1, /* sent */ false);
+      err = Error::HwError;
+      continue;
+    }
+
+    recordBatch(batchStats.txBatches, batchStats.txFrames, batchStats.txMaxBatch, n);
+    popTxEntries(n, /* sent */ true);
+  }
+
+  return err;
+}
+
+LinuxCoDev::TxEntry LinuxCoDev::toEntry(const Msg &msg) const
 {
-  struct can_frame frame = {0};
-  assert(msg.len <= sizeof(frame.data));
+  TxEntry entry             = {};
+  struct canfd_frame &frame = entry.frame;
+
+  // CAN FD has no remote frames
+  entry.fd = !msg.rtr && (msg.fd || msg.len > MaxClassicLen);
+  assert(msg.len <= (entry.fd ? MaxFdLen : MaxClassicLen));
 
   frame.can_id = msg.id & ((1 << 29) - 1);
   if (frame.can_id >= 0x800)
     frame.can_id |= CAN_EFF_FLAG;
-  frame.can_dlc = msg.len;
+  frame.len = msg.len;
+  if (entry.fd && brs)
+    frame.flags |= CANFD_BRS;
   if (msg.rtr)
     frame.can_id |= CAN_RTR_FLAG;
   else
     memcpy(frame.data, msg.data, msg.len);
 
-  if (async) {
-    asyncFrames.push_back(frame);
-  }
-  else if (ssize_t written = ::write(s, &frame, sizeof(frame)); written < 0) {
-    LogDebug("can socket write: errno %d", errno);
-    stats.droppedTx++;
-    return Error::HwError;
-  }
+  return entry;
+}
 
-  return Error::Success;
+Error LinuxCoDev::write(const Msg &msg, bool async)
+{
+  TxEntry entry = toEntry(msg);
+  std::lock_guard g(txMtx);
+
+  Error e = enqueue(classify(entry.frame.can_id), entry);
+  if (async) return e;
+
+  Error d = drainTxQueues();
+  return e != Error::Success ? e : d;
+}
+
+Error LinuxCoDev::writePriority(const Msg &msg)
+{
+  TxEntry entry = toEntry(msg);
+  std::lock_guard g(txMtx);
+
+  Error e = enqueue(TxClass::NmtEmcy, entry);
+  Error d = drainTxQueues();
+  return e != Error::Success ? e : d;
 }
 
 void LinuxCoDev::flushAsyncFrames()
 {
-  for (const struct can_frame& frame : asyncFrames) {
-    if (ssize_t written = ::write(s, &frame, sizeof(frame)); written < 0) {
-      LogDebug("can socket write (async): errno %d", errno);
-      stats.droppedTx++;
+  std::lock_guard g(txMtx);
+  drainTxQueues();
+}
+
+void LinuxCoDev::setTxQueueLimit(TxClass c, size_t maxFrames, TxDropPolicy policy)
+{
+  std::lock_guard g(txMtx);
+  TxQueue &q = txQueues[static_cast<size_t>(c)];
+  q.limit    = maxFrames;
+  q.policy   = policy;
+}
+
+LinuxCoDev::TxClassStats LinuxCoDev::getTxClassStats(TxClass c)
+{
+  std::lock_guard g(txMtx);
+  return txQueues[static_cast<size_t>(c)].stats;
+}
+
+Error LinuxCoDev::read(std::vector<RxFrame> &frames, size_t maxFrames, bool nonblock)
+{
+  // Appended after anything already in frames
+  size_t start = frames.size();
+  frames.resize(start + maxFrames);
+  rxMsgs.resize(maxFrames);
+  rxIovs.resize(maxFrames);
+  rxControl.resize(maxFrames);
+  for (size_t i = 0; i < maxFrames; ++i) {
+    rxIovs[i]                        = {&frames[start + i].frame, CANFD_MTU};
+    rxMsgs[i]                        = {};
+    rxMsgs[i].msg_hdr.msg_iov        = &rxIovs[i];
+    rxMsgs[i].msg_hdr.msg_iovlen     = 1;
+    rxMsgs[i].msg_hdr.msg_control    = &rxControl[i];
+    rxMsgs[i].msg_hdr.msg_controllen = sizeof(RxControl);
+  }
+
+  int n = recvmmsg(s, rxMsgs.data(), maxFrames, nonblock ? MSG_DONTWAIT : MSG_WAITFORONE, nullptr);
+
+  if (n < 0) {
+    frames.resize(start);
+    if (errno != EAGAIN) {
+      perror("can raw socket read");
+      return Error::HwError;
     }
+    return Error::Timeout;
+  }
+
+  frames.resize(start + n);
+  for (int i = 0; i < n; ++i) {
+    // Without CAN_RAW_FD_FRAMES the kernel only delivers classic frames
+    frames[start + i].fd        = rxMsgs[i].msg_len == CANFD_MTU;
+    rxTimestamps(rxMsgs[i].msg_hdr, frames[start + i]);
   }
-  asyncFrames.clear();
+  if (n > 0) {
+    recordBatch(batchStats.rxBatches, batchStats.rxFrames, batchStats.rxMaxBatch, n);
+  }
+  return n > 0 ? Error::Success : Error::Timeout;
+}
+
+LinuxCoDev::BatchStats LinuxCoDev::getBatchStats()
+{
+  BatchStats b;
+  b.rxBatches  = batchStats.rxBatches.load(std::memory_order_relaxed);
+  b.rxFrames   = batchStats.rxFrames.load(std::memory_order_relaxed);
+  b.rxMaxBatch = batchStats.rxMaxBatch.load(std::memory_order_relaxed);
+  b.txBatches  = batchStats.txBatches.load(std::memory_order_relaxed);
+  b.txFrames   = batchStats.txFrames.load(std::memory_order_relaxed);
+  b.txMaxBatch = batchStats.txMaxBatch.load(std::memory_order_relaxed);
+  return b;
 }
 
 //******************************************************************************
@@ -245,80 +829,263 @@ LinuxCo::LinuxCo(LinuxCoDev &d, uint8_t nodeId, const char *deviceName, uint32_t
 LinuxCo::~LinuxCo()
 {
   shutdown.store(true);
+  wakeMainThread();
   if (mainThread) mainThread->join();
   if (recvThread) recvThread->join();
+
+  for (int fd : {epollFd, timerFd, wakeFd, txWakeFd, txBackoffFd}) {
+    if (fd != -1) close(fd);
+  }
 }
 
-Error LinuxCo::start(const char *dev)
+Error LinuxCo::start(const char *dev, Engine engine)
 {
+  auto &linuxDev = static_cast<LinuxCoDev &>(bus);
+  this->engine   = engine;
+
   if (Error e = LocalNode::init(); e != Error::Success) return e;
-  if (Error e = static_cast<LinuxCoDev &>(bus).open(dev); e != Error::Success) return e;
-  mainThread    = std::make_unique<std::thread>([=]() { this->runMainThread(); });
-  recvThread    = std::make_unique<std::thread>([=]() { this->runRecvThread(); });
+  if (Error e = linuxDev.open(dev); e != Error::Success) return e;
+
+  if (engine == Engine::Epoll) {
+    epollFd     = epoll_create1(EPOLL_CLOEXEC);
+    timerFd     = timerfd_create(CLOCK_MONOTONIC, TFD_NONBLOCK | TFD_CLOEXEC);
+    wakeFd      = eventfd(0, EFD_NONBLOCK | EFD_CLOEXEC);
+    txBackoffFd = timerfd_create(CLOCK_MONOTONIC, TFD_NONBLOCK | TFD_CLOEXEC);
+
+    if (epollFd == -1 || timerFd == -1 || wakeFd == -1 || txBackoffFd == -1) {
+      perror("event loop setup failed");
+      return Error::HwError;
+    }
+
+    for (int fd : {linuxDev.getFd(), linuxDev.getBcmFd(), timerFd, wakeFd, txBackoffFd}) {
+      if (fd == -1) continue;  // No BCM socket
+      struct epoll_event ev = {};
+      ev.events             = EPOLLIN;
+      ev.data.fd            = fd;
+      if (epoll_ctl(epollFd, EPOLL_CTL_ADD, fd, &ev) == -1) {
+        perror("epoll_ctl failed");
+        return Error::HwError;
+      }
+    }
+
+    mainThread = std::make_unique<std::thread>([=]() { this->runEventLoop(); });
+  }
+  else {
+    txWakeFd = eventfd(0, EFD_NONBLOCK | EFD_CLOEXEC);
+    if (txWakeFd == -1) {
+      perror("eventfd failed");
+      return Error::HwError;
+    }
+
+    mainThread = std::make_unique<std::thread>([=]() { this->runMainThread(); });
+    recvThread = std::make_unique<std::thread>([=]() { this->runRecvThread(); });
+  }
+
   // Just to aid debugging
   std::string name;
   if (od.get(0x1008, 0, name) == Error::Success) {
     std::string mainName = name + ".main";
     pthread_setname_np(mainThread->native_handle(), mainName.c_str());
-    std::string recvName = name + ".recv";
-    pthread_setname_np(recvThread->native_handle(), recvName.c_str());
+    if (recvThread) {
+      std::string recvName = name + ".recv";
+      pthread_setname_np(recvThread->native_handle(), recvName.c_str());
+    }
   }
   return Error::Success;
 }
 
+void LinuxCo::wakeMainThread()
+{
+  if (engine == Engine::Epoll) {
+    uint64_t one = 1;
+    if (wakeFd != -1 && ::write(wakeFd, &one, sizeof(one)) < 0 && errno != EAGAIN) {
+      LogDebug("eventfd write: errno %d", errno);
+    }
+  }
+  else {
+    {
+      std::lock_guard w(wakeMtx);
+      wakePending = true;
+    }
+    mainThreadWakeup.notify_one();
+  }
+}
+
+// Called once the socket polls writable with frames backlogged. Returns false
+// if it still took none: the device queue itself is full (ENOBUFS), which
+// POLLOUT doesn't reflect, so callers stop polling for it for TxBackoffMs
+// rather than spin.
+bool LinuxCo::retryTx(size_t backlog)
+{
+  auto &linuxDev = static_cast<LinuxCoDev &>(bus);
+  linuxDev.flushAsyncFrames();
+  return linuxDev.txBacklog() < backlog;
+}
+
+static inline Msg toMsg(LinuxCoDev::RxFrame &rx)
+{
+  Msg msg;
+  msg.id          = rx.frame.can_id & CAN_EFF_MASK;
+  msg.len         = rx.frame.len;
+  msg.data        = rx.frame.data;
+  msg.rtr         = !!(rx.frame.can_id & CAN_RTR_FLAG);
+  msg.timestamp   = rx.timestamp;
+  msg.hwTimestamp = rx.hwTimestamp;
+  msg.fd          = rx.fd;
+  return msg;
+}
+
+void LinuxCo::dispatchFrame(LinuxCoDev::RxFrame &rx)
+{
+  if (rx.frame.can_id & LinuxCoDev::RxTimeoutFlag) {
+    processRxTimeout(rx.frame.can_id & CAN_EFF_MASK);
+    return;
+  }
+
+  if (rx.timestamp) {
+    struct timespec now;
+    clock_gettime(CLOCK_REALTIME, &now);
+    uint64_t nowNs = (uint64_t)now.tv_sec * 1000000000 + now.tv_nsec;
+    // Clock stepped backwards
+    if (nowNs >= rx.timestamp) rxLatency.record(nowNs - rx.timestamp);
+  }
+
+  processFrame(toMsg(rx));
+}
+
+void LinuxCo::processFrames(std::vector<LinuxCoDev::RxFrame> &frames)
+{
+  for (auto &rx : frames) {
+    dispatchFrame(rx);
+  }
+}
+
+void LinuxCo::drainRxRing()
+{
+  LinuxCoDev::RxFrame rx;
+  size_t n = 0;
+
+  // Bounded so a flood of frames can't starve timers
+  while (n < rxRing.capacity() && rxRing.pop(rx)) {
+    dispatchFrame(rx);
+    n++;
+  }
+
+  // Pairs with the fence in runRecvThread(): either it sees the space we just
+  // freed, or we see that it's stalled
+  std::atomic_thread_fence(std::memory_order_seq_cst);
+  if (n && recvStalled.load(std::memory_order_relaxed)) {
+    std::lock_guard w(wakeMtx);
+    recvThreadWakeup.notify_one();
+  }
+}
+
+void LinuxCo::runCommands()
+{
+  constexpr size_t MaxCommandsPerBatch = 256;
+  std::function<void()> f;
+  size_t n = 0;
+
+  // Bounded like the rx ring, so a flood of posts can't starve frames and
+  // timers. Whatever is left runs next iteration.
+  while (n < MaxCommandsPerBatch && commands.pop(f)) {
+    f();
+    n++;
+  }
+
+  if (n == MaxCommandsPerBatch && !commands.empty()) wakeMainThread();
+}
+
 void LinuxCo::runMainThread()
 {
   while (!shutdown.load()) {
-    std::unique_lock u(mtx);
-    unsigned gen = sys.getTimerGeneration();
-    auto deadline = std::min(sys.nextTimerDeadline(), std::chrono::steady_clock::now() + std::chrono::milliseconds(500));
-    mainThreadWakeup.wait_until(u, deadline, [&]() {
-      return !pendingFrames.empty() || gen != sys.getTimerGeneration() || !pendingTpdos.empty();
-    });
-    sys.serviceTimers();
-    for (auto& frame : pendingFrames) {
-      Msg msg;
-      msg.id   = frame.can_id & CAN_EFF_MASK;
-      msg.len  = frame.can_dlc;
-      msg.data = frame.data;
-      msg.rtr  = !!(frame.can_id & CAN_RTR_FLAG);
-      processFrame(msg);
-    }
-    if (!pendingFrames.empty()) {
-      recvThreadWakeup.notify_one();
-    }
-    pendingFrames.clear();
-    pendingTpdos.clear();
-    u.unlock();
-    static_cast<LinuxCoDev &>(bus).flushAsyncFrames();
+    std::chrono::steady_clock::time_point deadline;
+    {
+      std::lock_guard g(mtx);
+      deadline = std::min(sys.nextTimerDeadline(), std::chrono::steady_clock::now() + std::chrono::milliseconds(500));
+    }
+    {
+      std::unique_lock w(wakeMtx);
+      mainThreadWakeup.wait_until(w, deadline, [&]() { return wakePending; });
+      wakePending = false;
+    }
+    {
+      std::lock_guard g(mtx);
+      sys.serviceTimers();
+      drainRxRing();
+      runCommands();
+      pendingTpdos.clear();
+    }
+
+    auto &linuxDev = static_cast<LinuxCoDev &>(bus);
+    linuxDev.flushAsyncFrames();
+
+    // Leave the rest to the recv thread, which is already polling the socket
+    uint64_t one = 1;
+    if (linuxDev.txBacklog() && ::write(txWakeFd, &one, sizeof(one)) < 0 && errno != EAGAIN) {
+      LogDebug("eventfd write: errno %d", errno);
+    }
   }
 }
 
 void LinuxCo::runRecvThread()
 {
   constexpr size_t MAX_FRAMES_PER_BATCH = 64;
-  std::vector<can_frame> frames;
+  auto &linuxDev                        = static_cast<LinuxCoDev &>(bus);
+  std::vector<LinuxCoDev::RxFrame> frames;
+  std::chrono::steady_clock::time_point txBackoffUntil;
   while (!shutdown.load()) {
-    {
-      std::unique_lock u(mtx);
-      // Wait until all frames have been processed before reading another batch
-      if (!recvThreadWakeup.wait_for(u, std::chrono::milliseconds(500), [&]() {return pendingFrames.empty();})) continue;
-    }
-    struct can_frame frame = {0};
-    bool nonblock = false;
-    Error e;
-    while ((e = static_cast<LinuxCoDev &>(bus).read(frame, nonblock)) == Error::Success) {
-      // Allow the first read to block for SO_RCVTMEO so we don't spin, then grab anything else in the queue ASAP to minimize batch latency
-      nonblock = true;
-      frames.push_back(frame);
-      // Don't starve the node or allocate unbounded messages under heavy traffic
-      if (frames.size() >= MAX_FRAMES_PER_BATCH) break;
+    // Wait for frames on the raw and BCM sockets, and for room on the raw
+    // socket while frames are backlogged, then grab everything queued ASAP to
+    // minimize batch latency. Batches are bounded so we don't starve the node
+    // under heavy traffic. Never takes the node lock, so the socket keeps
+    // draining while callbacks run.
+    size_t backlog      = linuxDev.txBacklog();
+    bool backingOff     = backlog && std::chrono::steady_clock::now() < txBackoffUntil;
+    short rawEvents     = backlog && !backingOff ? POLLIN | POLLOUT : POLLIN;
+    struct pollfd fds[] = {
+        {.fd = linuxDev.getFd(), .events = rawEvents, .revents = 0},
+        {.fd = txWakeFd, .events = POLLIN, .revents = 0},
+        {.fd = linuxDev.getBcmFd(), .events = POLLIN, .revents = 0},  // Ignored if -1
+    };
+    poll(fds, 3, backingOff ? TxBackoffMs : 500);
+
+    if (fds[1].revents & POLLIN) {
+      uint64_t count;
+      if (::read(txWakeFd, &count, sizeof(count)) < 0 && errno != EAGAIN) {
+        LogDebug("eventfd read: errno %d", errno);
+      }
+    }
+    if ((fds[0].revents & POLLOUT) && !retryTx(backlog)) {
+      txBackoffUntil = std::chrono::steady_clock::now() + std::chrono::milliseconds(TxBackoffMs);
     }
+
+    Error e = Error::Timeout;
+    frames.clear();
+    if (fds[0].revents & POLLIN) {
+      e = linuxDev.read(frames, MAX_FRAMES_PER_BATCH, /* nonblock */ true);
+    }
+    if (fds[2].revents & POLLIN) {
+      linuxDev.readBcm(frames);
+    }
+
+    for (auto &frame : frames) {
+      if (rxRing.push(frame)) continue;
+
+      // Only stall when the main thread has fallen a full ring behind
+      rxRingFull.fetch_add(1, std::memory_order_relaxed);
+      wakeMainThread();
+      std::unique_lock w(wakeMtx);
+      recvStalled.store(true, std::memory_order_relaxed);
+      std::atomic_thread_fence(std::memory_order_seq_cst);
+      while (!rxRing.push(frame) && !shutdown.load()) {
+        recvThreadWakeup.wait_for(w, std::chrono::milliseconds(500), [&]() { return !rxRing.full() || shutdown.load(); });
+      }
+      recvStalled.store(false, std::memory_order_relaxed);
+    }
+
     if (!frames.empty()) {
-      std::lock_guard g(mtx);
-      assert(pendingFrames.empty());
-      pendingFrames.swap(frames);
-      mainThreadWakeup.notify_one();
+      wakeMainThread();
     }
     if (e != Error::Success && e != Error::Timeout) {
       // Don't spin on unexpected errors
@@ -327,6 +1094,107 @@ void LinuxCo::runRecvThread()
   }
 }
 
+void LinuxCo::runEventLoop()
+{
+  constexpr size_t MAX_FRAMES_PER_BATCH = 64;
+  auto &linuxDev                        = static_cast<LinuxCoDev &>(bus);
+  std::vector<LinuxCoDev::RxFrame> frames;
+  std::chrono::steady_clock::time_point armedDeadline;
+  bool pollingOut = false;  // Socket registered for EPOLLOUT as well
+  bool backingOff = false;  // txBackoffFd armed, EPOLLOUT left off until it fires
+
+  while (!shutdown.load()) {
+    {
+      std::lock_guard g(mtx);
+      auto deadline = sys.nextTimerDeadline();
+
+      // steady_clock is CLOCK_MONOTONIC, so deadlines can be armed as-is
+      if (deadline != armedDeadline) {
+        auto ns               = std::chrono::duration_cast<std::chrono::nanoseconds>(deadline.time_since_epoch()).count();
+        struct itimerspec its = {};
+        its.it_value.tv_sec   = ns / 1000000000;
+        its.it_value.tv_nsec  = ns % 1000000000;
+        if (its.it_value.tv_sec == 0 && its.it_value.tv_nsec == 0) its.it_value.tv_nsec = 1;  // 0 would disarm
+        timerfd_settime(timerFd, TFD_TIMER_ABSTIME, &its, nullptr);
+        armedDeadline = deadline;
+      }
+    }
+
+    struct epoll_event events[8];
+    int n = epoll_wait(epollFd, events, 8, -1);
+    if (n < 0) {
+      if (errno != EINTR) {
+        perror("epoll_wait");
+        std::this_thread::sleep_for(std::chrono::milliseconds(500));
+      }
+      continue;
+    }
+
+    bool readable    = false;
+    bool writable    = false;
+    bool bcmReadable = false;
+    for (int i = 0; i < n; ++i) {
+      uint64_t count;
+      if (events[i].data.fd == linuxDev.getFd()) {
+        readable = events[i].events & EPOLLIN;
+        writable |= !!(events[i].events & EPOLLOUT);
+      }
+      else if (events[i].data.fd == linuxDev.getBcmFd()) {
+        bcmReadable = true;
+      }
+      else if (events[i].data.fd == txBackoffFd) {
+        backingOff = false;
+        writable   = true;
+        if (::read(txBackoffFd, &count, sizeof(count)) < 0 && errno != EAGAIN) {
+          LogDebug("event loop fd read: errno %d", errno);
+        }
+      }
+      else if (::read(events[i].data.fd, &count, sizeof(count)) < 0 && errno != EAGAIN) {
+        LogDebug("event loop fd read: errno %d", errno);
+      }
+    }
+
+    // Rather than sleep here, ahead of rx and timers, wait out a full device
+    // queue with EPOLLOUT off and a timer armed
+    if (writable && linuxDev.txBacklog() && !retryTx(linuxDev.txBacklog())) {
+      struct itimerspec its = {};
+      its.it_value.tv_nsec  = TxBackoffMs * 1000000;
+      timerfd_settime(txBackoffFd, 0, &its, nullptr);
+      backingOff = true;
+    }
+
+    // Drain the socket outside the lock, same as the recv thread
+    if (readable) {
+      linuxDev.read(frames, MAX_FRAMES_PER_BATCH, /* nonblock */ true);
+    }
+    if (bcmReadable) {
+      linuxDev.readBcm(frames);
+    }
+
+    {
+      std::lock_guard g(mtx);
+      sys.serviceTimers();
+      processFrames(frames);
+      runCommands();
+      pendingTpdos.clear();
+    }
+
+    frames.clear();
+    linuxDev.flushAsyncFrames();
+
+    // Only wait for room on the socket while frames are backlogged
+    if (bool backlog = linuxDev.txBacklog() && !backingOff; backlog != pollingOut) {
+      struct epoll_event ev = {};
+      ev.events             = backlog ? EPOLLIN | EPOLLOUT : EPOLLIN;
+      ev.data.fd            = linuxDev.getFd();
+      if (epoll_ctl(epollFd, EPOLL_CTL_MOD, linuxDev.getFd(), &ev) == -1) {
+        perror("epoll_ctl failed");
+      }
+      pollingOut = backlog;
+    }
+  }
+}
+
 Error LinuxCo::triggerTPDOOnce(uint16_t pdoNum)
 {
   if (pendingTpdos.find(pdoNum) != pendingTpdos.end()) return Error::Success;
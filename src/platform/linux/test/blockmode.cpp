@@ -56,6 +56,12 @@ int main()
     Error e = client.blockingWrite(SERVER_NODE_ID, TEST_IDX, TEST_SUBIDX, OdBuffer{srcData, sizeof srcData});
     assert(e == Error::Success);
     assert(memcmp(srcData, dstData, sizeof dstData) == 0);
+
+    // And back again with a block upload
+    vector<uint8_t> readback;
+    e = client.blockingRead(SERVER_NODE_ID, TEST_IDX, TEST_SUBIDX, readback);
+    assert(e == Error::Success);
+    assert(readback.size() == sizeof dstData && memcmp(readback.data(), dstData, sizeof dstData) == 0);
   });
 
   t.join();
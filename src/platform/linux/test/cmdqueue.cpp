@@ -0,0 +1,71 @@
+#include <chrono>
+#include <cstdio>
+#include <functional>
+#include <thread>
+#include <vector>
+#include "canfetti/MpscQueue.h"
+#include "canfetti/System.h"
+
+using namespace std;
+using namespace canfetti;
+
+// Pushes commands into the MPSC queue from several threads while one thread
+// runs them, and checks none are lost or duplicated and that each producer's
+// commands run in order.
+int main()
+{
+  constexpr size_t NumProducers = 4;
+  constexpr uint32_t PerProducer = 250000;
+
+  // Single threaded: FIFO, and empty after draining
+  {
+    MpscQueue<int> q;
+    int v;
+    assert(q.empty());
+    assert(!q.pop(v));
+    for (int i = 0; i < 10; ++i) q.push(i);
+    for (int i = 0; i < 10; ++i) {
+      assert(q.pop(v));
+      assert(v == i);
+    }
+    assert(q.empty());
+
+    // Destroyed with items still queued
+    q.push(1);
+  }
+
+  MpscQueue<function<void()>> q;
+  vector<uint32_t> next(NumProducers, 0);
+  size_t ran = 0;
+  auto start = chrono::steady_clock::now();
+
+  vector<thread> producers;
+  for (size_t p = 0; p < NumProducers; ++p) {
+    producers.emplace_back([&, p]() {
+      for (uint32_t i = 0; i < PerProducer; ++i) {
+        q.push([&, p, i]() {
+          assert(next[p] == i);
+          next[p]++;
+        });
+      }
+    });
+  }
+
+  function<void()> f;
+  while (ran < NumProducers * PerProducer) {
+    if (!q.pop(f)) {
+      this_thread::yield();
+      continue;
+    }
+    f();
+    ran++;
+  }
+  for (auto &t : producers) t.join();
+  assert(q.empty());
+  for (auto n : next) assert(n == PerProducer);
+
+  auto ns = chrono::duration_cast<chrono::nanoseconds>(chrono::steady_clock::now() - start).count();
+  printf("%zu commands from %zu threads: %.1f ns per command\n", ran, NumProducers, (double)ns / ran);
+  printf("OK\n");
+  return 0;
+}
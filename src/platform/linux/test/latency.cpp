@@ -0,0 +1,112 @@
+#include <pthread.h>
+#include <sys/ioctl.h>
+#include <sys/socket.h>
+#include <unistd.h>
+#include <algorithm>
+#include <chrono>
+#include <cstdio>
+#include <cstring>
+#include <vector>
+#include "canfetti/LinuxCo.h"
+#include "linux/can/raw.h"
+#include "net/if.h"
+
+using namespace std::chrono_literals;
+using namespace std;
+using namespace canfetti;
+
+// Measures RPDO -> TPDO round trip latency through a LinuxCo node on vcan0 for
+// each engine. A raw socket sends an RPDO; the node echoes it back as a TPDO
+// from the RPDO's OD callback.
+
+static constexpr uint8_t NODE_ID        = 5;
+static constexpr uint16_t RPDO_COBID    = 0x205;
+static constexpr uint16_t TPDO_COBID    = 0x185;
+static constexpr uint16_t ECHO_IDX      = 0x2000;
+static constexpr size_t NUM_ROUND_TRIPS = 5000;
+
+static int openRawSocket(const char *dev)
+{
+  struct sockaddr_can addr = {};
+  struct ifreq ifr         = {};
+
+  int s = socket(PF_CAN, SOCK_RAW, CAN_RAW);
+  assert(s != -1);
+
+  strcpy(ifr.ifr_name, dev);
+  assert(ioctl(s, SIOCGIFINDEX, &ifr) != -1);
+
+  addr.can_family  = AF_CAN;
+  addr.can_ifindex = ifr.ifr_ifindex;
+  assert(bind(s, (struct sockaddr *)&addr, sizeof(addr)) != -1);
+
+  struct can_filter filter = {.can_id = TPDO_COBID, .can_mask = CAN_SFF_MASK};
+  assert(setsockopt(s, SOL_CAN_RAW, CAN_RAW_FILTER, &filter, sizeof(filter)) != -1);
+
+  struct timeval tv = {.tv_sec = 1, .tv_usec = 0};
+  assert(setsockopt(s, SOL_SOCKET, SO_RCVTIMEO, &tv, sizeof(tv)) != -1);
+
+  return s;
+}
+
+static void bench(const char *name, LinuxCo::Engine engine)
+{
+  uint32_t echo = 0;
+
+  LinuxCoDev dev(125000);
+  LinuxCo co(dev, NODE_ID, "latency");
+  assert(co.start("vcan0", engine) == Error::Success);
+
+  co.doWithLock([&]() {
+    co.od.insert(ECHO_IDX, 0, Access::RW, _p(echo), [&](uint16_t, uint8_t) { co.triggerTPDO(1); });
+    co.addRPDO(RPDO_COBID, {{ECHO_IDX, 0}});
+    co.addTPDO(1, TPDO_COBID, {{ECHO_IDX, 0}});
+    co.setState(State::Operational);
+  });
+
+  int s = openRawSocket("vcan0");
+  vector<double> rtts;
+  rtts.reserve(NUM_ROUND_TRIPS);
+
+  for (uint32_t i = 0; i < NUM_ROUND_TRIPS; ++i) {
+    struct can_frame tx = {};
+    tx.can_id           = RPDO_COBID;
+    tx.can_dlc          = sizeof(i);
+    memcpy(tx.data, &i, sizeof(i));
+
+    auto start = chrono::steady_clock::now();
+    assert(::write(s, &tx, sizeof(tx)) == sizeof(tx));
+
+    struct can_frame rx;
+    uint32_t got = ~i;
+    while (got != i) {
+      if (::read(s, &rx, sizeof(rx)) != sizeof(rx)) {
+        printf("%s: timed out waiting for echo %u\n", name, i);
+        close(s);
+        return;
+      }
+      memcpy(&got, rx.data, sizeof(got));
+    }
+
+    rtts.push_back(chrono::duration<double, micro>(chrono::steady_clock::now() - start).count());
+  }
+
+  close(s);
+  sort(rtts.begin(), rtts.end());
+  auto pct = [&](double p) { return rtts[min(rtts.size() - 1, (size_t)(p * rtts.size()))]; };
+  printf("%-10s RTT us: p50 %7.1f  p90 %7.1f  p99 %7.1f  max %7.1f\n", name, pct(0.5), pct(0.9), pct(0.99), rtts.back());
+
+  auto rx = co.getRxLatency();
+  printf("%-10s kernel rx -> dispatch us: p50 <%5llu  p99 <%5llu  max %7.1f  (%llu frames)\n", name, (unsigned long long)rx.percentileUs(0.5),
+         (unsigned long long)rx.percentileUs(0.99), rx.maxNs / 1000.0, (unsigned long long)rx.count);
+}
+
+int main()
+{
+  pthread_setname_np(pthread_self(), "main");
+
+  bench("threaded", LinuxCo::Engine::Threaded);
+  bench("epoll", LinuxCo::Engine::Epoll);
+
+  return 0;
+}
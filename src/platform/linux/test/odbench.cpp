@@ -0,0 +1,70 @@
+#include <chrono>
+#include <cstdio>
+#include <map>
+#include <random>
+#include <tuple>
+#include <vector>
+#include "canfetti/ObjDict.h"
+
+using namespace std;
+using namespace canfetti;
+
+// Compares ObjDict lookups against the nested std::map layout the OD used to
+// be built on, over an OD with a few thousand entries.
+int main()
+{
+  constexpr uint16_t NumIndices = 512;
+  constexpr uint8_t NumSubIdxs  = 8;
+  constexpr size_t NumLookups   = 4000000;
+
+  ObjDict od;
+  map<uint16_t, map<uint8_t, uint32_t>> nested;
+  vector<tuple<uint16_t, uint8_t>> keys;
+
+  for (uint16_t idx = 0x2000; idx < 0x2000 + NumIndices; idx++) {
+    for (uint8_t subIdx = 0; subIdx < NumSubIdxs; subIdx++) {
+      od.insert(idx, subIdx, Access::RW, _u32(idx + subIdx));
+      nested[idx].emplace(subIdx, idx + subIdx);
+      keys.emplace_back(idx, subIdx);
+    }
+  }
+
+  mt19937 prng;  // use default seed
+  vector<tuple<uint16_t, uint8_t>> order(NumLookups);
+  for (auto &k : order) {
+    k = keys[prng() % keys.size()];
+  }
+
+  auto bench = [&](const char *name, auto &&f) {
+    uint64_t sum = 0;
+    auto start   = chrono::steady_clock::now();
+    for (auto &[idx, subIdx] : order) {
+      sum += f(idx, subIdx);
+    }
+    auto ns = chrono::duration_cast<chrono::nanoseconds>(chrono::steady_clock::now() - start).count();
+    printf("%-24s %6.1f ns/lookup (checksum %llu)\n", name, (double)ns / order.size(), (unsigned long long)sum);
+  };
+
+  printf("%zu entries, %zu random lookups\n", keys.size(), order.size());
+
+  bench("nested std::map", [&](uint16_t idx, uint8_t subIdx) -> uint32_t {
+    if (auto i = nested.find(idx); i != nested.end()) {
+      if (auto s = i->second.find(subIdx); s != i->second.end()) {
+        return s->second;
+      }
+    }
+    return 0;
+  });
+
+  bench("ObjDict::entryExists", [&](uint16_t idx, uint8_t subIdx) -> uint32_t {
+    return od.entryExists(idx, subIdx);
+  });
+
+  bench("ObjDict::get", [&](uint16_t idx, uint8_t subIdx) -> uint32_t {
+    uint32_t v = 0;
+    od.get(idx, subIdx, v);
+    return v;
+  });
+
+  return 0;
+}
@@ -0,0 +1,193 @@
+#include <chrono>
+#include <cstdlib>
+#include <cstdio>
+#include <random>
+#include <thread>
+#include <vector>
+#include "canfetti/System.h"
+
+using namespace std::chrono_literals;
+using namespace std;
+using namespace canfetti;
+
+// Exercises the Linux timer service without a CAN interface: ordering,
+// cancellation, recycling, and the cost of servicing a large timer set.
+int main()
+{
+  constexpr size_t NumTimers = 2000;
+
+  System sys;
+  mt19937 prng;  // use default seed
+
+  // One-shots fire in deadline order
+  {
+    vector<int> fired;
+    System::TimerHdl hdls[4];
+    hdls[0] = sys.scheduleDelayed(30, [&]() { fired.push_back(30); });
+    hdls[1] = sys.scheduleDelayed(10, [&]() { fired.push_back(10); });
+    hdls[2] = sys.scheduleDelayed(20, [&]() { fired.push_back(20); });
+    hdls[3] = sys.scheduleDelayed(15, [&]() { fired.push_back(15); });
+    assert(sys.getTimerCount() == 4);
+
+    sys.deleteTimer(hdls[3]);
+    assert(hdls[3] == System::InvalidTimer);
+    assert(sys.getTimerCount() == 3);
+
+    while (fired.size() < 3) {
+      this_thread::sleep_until(sys.nextTimerDeadline());
+      sys.serviceTimers();
+    }
+    assert((fired == vector<int>{10, 20, 30}));
+
+    for (auto &h : hdls) sys.deleteTimer(h);
+    assert(sys.getTimerCount() == 0);
+  }
+
+  // A timer can delete itself and be replaced from its own callback
+  {
+    System::TimerHdl self, next;
+    int n = 0;
+    self  = sys.scheduleDelayed(0, [&]() {
+      sys.deleteTimer(self);
+      next = sys.scheduleDelayed(0, [&]() { n++; });
+      n++;
+    });
+    sys.serviceTimers();
+    sys.serviceTimers();
+    assert(n == 2);
+    sys.deleteTimer(next);
+    assert(sys.getTimerCount() == 0);
+  }
+
+  // Disabled timers don't fire until reset
+  {
+    int n    = 0;
+    auto hdl = sys.scheduleDelayed(0, [&]() { n++; });
+    sys.disableTimer(hdl);
+    sys.serviceTimers();
+    assert(n == 0);
+    sys.resetTimer(hdl);
+    sys.serviceTimers();
+    assert(n == 1);
+
+    // A fired one-shot can be re-armed from its own callback, and only
+    // deleted timers can't be re-armed at all
+    System::TimerHdl rearm;
+    rearm = sys.scheduleDelayed(0, [&]() {
+      if (++n < 4) assert(sys.resetTimer(rearm, 0) == rearm);
+    });
+    for (int i = 0; i < 4; ++i) sys.serviceTimers();
+    assert(n == 4);
+    assert(sys.resetTimer(hdl, 0) == hdl);
+    sys.deleteTimer(hdl);
+    sys.deleteTimer(rearm);
+    assert(sys.resetTimer(hdl, 0) == System::InvalidTimer);
+    assert(sys.getTimerCount() == 0);
+  }
+
+  // Timers sharing a period are spread evenly across it
+  static_assert(PhaseSlots::offset(0, 100) == 0);
+  static_assert(PhaseSlots::offset(1, 100) == 50);
+  static_assert(PhaseSlots::offset(2, 100) == 25);
+  static_assert(PhaseSlots::offset(3, 100) == 75);
+  {
+    constexpr auto Period = 40ms;
+    chrono::steady_clock::time_point first[4];
+    System::TimerHdl hdls[4];
+
+    for (size_t i = 0; i < 4; ++i) {
+      hdls[i] = sys.schedulePeriodic(Period.count(), [&, i]() {
+        if (first[i] == chrono::steady_clock::time_point{}) first[i] = chrono::steady_clock::now();
+      });
+    }
+
+    auto end = chrono::steady_clock::now() + 3 * Period;
+    while (chrono::steady_clock::now() < end) {
+      this_thread::sleep_until(min(end, sys.nextTimerDeadline()));
+      sys.serviceTimers();
+    }
+
+    // Phases relative to the first timer land on quarters of the period
+    auto quarters = 0u;
+    for (size_t i = 1; i < 4; ++i) {
+      auto phase = chrono::duration_cast<chrono::milliseconds>(first[i] - first[0]) % Period;
+      if (phase < 0ms) phase += Period;
+      auto q = (phase + Period / 8) / (Period / 4);
+      assert(abs((phase - q * Period / 4).count()) <= 3);
+      quarters |= 1 << (q % 4);
+    }
+    assert(quarters == 0b1110);
+
+    for (auto &h : hdls) sys.deleteTimer(h);
+  }
+
+  // Deleted timers give their slot back, so re-created ones start over at the
+  // widest spacing
+  {
+    PhaseSlots slots;
+    assert(slots.acquire(100) == 0);
+    assert(slots.acquire(100) == 1);
+    assert(slots.acquire(100) == 2);
+    assert(slots.acquire(50) == 0);
+    slots.release(100, 1);
+    slots.release(100, 0);
+    assert(slots.acquire(100) == 0);
+    assert(slots.acquire(100) == 1);
+    assert(slots.acquire(100) == 3);
+
+    for (uint8_t i = 1; i < PhaseSlots::MaxSlots; ++i) slots.acquire(50);
+    assert(slots.acquire(50) == PhaseSlots::NoSlot);
+    for (uint32_t p = 1; p < PhaseSlots::MaxPeriods - 1; ++p) assert(slots.acquire(p) == 0);
+    assert(slots.acquire(1000) == PhaseSlots::NoSlot);
+    slots.release(1, 0);
+    assert(slots.acquire(1000) == 0);
+  }
+
+  // Late servicing skips periods instead of drifting or bursting
+  {
+    size_t n = 0;
+    auto hdl = sys.schedulePeriodic(10, [&]() { n++; }, false);
+    this_thread::sleep_for(35ms);
+    sys.serviceTimers();
+    assert(n == 1);
+    assert(sys.getTimerOverruns() == 2);
+    sys.serviceTimers();
+    assert(n == 1);
+
+    // Next deadline stays on the original 10 ms grid
+    this_thread::sleep_until(sys.nextTimerDeadline());
+    sys.serviceTimers();
+    assert(n == 2);
+    sys.deleteTimer(hdl);
+  }
+
+  // Large timer sets, churned the way PDO and SDO timers are
+  vector<System::TimerHdl> hdls(NumTimers);
+  size_t fires = 0;
+  for (auto &h : hdls) {
+    h = sys.schedulePeriodic(1 + prng() % 100, [&]() { fires++; });
+  }
+  assert(sys.getTimerCount() == NumTimers);
+
+  auto start = chrono::steady_clock::now();
+  size_t ops = 0;
+  while (chrono::steady_clock::now() - start < 1s) {
+    auto &h = hdls[prng() % hdls.size()];
+    sys.deleteTimer(h);
+    h = sys.scheduleDelayed(prng() % 100, [&]() { fires++; });
+    sys.nextTimerDeadline();
+    sys.serviceTimers();
+    ops++;
+  }
+  auto ns = chrono::duration_cast<chrono::nanoseconds>(chrono::steady_clock::now() - start).count();
+
+  assert(sys.getTimerCount() == NumTimers);
+  printf("%zu timers: %.0f ns per cancel+schedule+service (%zu fires)\n", NumTimers, (double)ns / ops, fires);
+
+  for (auto &h : hdls) sys.deleteTimer(h);
+  assert(sys.getTimerCount() == 0);
+  assert(sys.nextTimerDeadline() > chrono::steady_clock::now() + 30min);
+
+  printf("OK\n");
+  return 0;
+}
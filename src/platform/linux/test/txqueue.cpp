@@ -0,0 +1,135 @@
+#include <sys/socket.h>
+#include <unistd.h>
+#include <cstdio>
+#include <vector>
+#include "canfetti/LinuxCo.h"
+
+using namespace std;
+using namespace canfetti;
+
+// Runs LinuxCoDev's transmit queues over a socketpair, so class order, drop
+// policies and backpressure can be checked without a CAN interface.
+
+using TxClass      = LinuxCoDev::TxClass;
+using TxDropPolicy = LinuxCoDev::TxDropPolicy;
+
+struct Pair {
+  int tx, rx;
+  LinuxCoDev dev{125000};
+
+  Pair()
+  {
+    int sv[2];
+    assert(socketpair(AF_UNIX, SOCK_DGRAM | SOCK_NONBLOCK, 0, sv) == 0);
+    tx = sv[0];
+    rx = sv[1];
+    assert(dev.open(tx) == Error::Success);
+  }
+
+  ~Pair()
+  {
+    close(tx);
+    close(rx);
+  }
+
+  void write(uint32_t id, uint8_t tag = 0)
+  {
+    uint8_t d[1] = {tag};
+    Msg m        = {.id = id, .rtr = false, .len = 1, .data = d};
+    assert(dev.write(m, /* async */ true) == Error::Success);
+  }
+
+  // Ids received, in order, until the socket is empty
+  vector<uint32_t> received()
+  {
+    vector<uint32_t> ids;
+    struct canfd_frame f;
+    while (recv(rx, &f, sizeof(f), 0) > 0) ids.push_back(f.can_id & CAN_EFF_MASK);
+    return ids;
+  }
+};
+
+static void classOrder()
+{
+  Pair p;
+
+  // Written lowest priority first; 29 bit ids go with PDOs
+  for (uint32_t id : {0x601u, 0x581u, 0x12345u, 0x181u, 0x100u, 0x080u, 0x705u, 0x081u, 0x000u}) p.write(id);
+  assert(p.dev.txBacklog() == 9);
+  p.dev.flushAsyncFrames();
+
+  vector<uint32_t> want = {0x705, 0x081, 0x000, 0x100, 0x080, 0x12345, 0x181, 0x601, 0x581};
+  assert(p.received() == want);
+  assert(p.dev.txBacklog() == 0);
+  assert(p.dev.getTxClassStats(TxClass::NmtEmcy).sent == 3);
+  assert(p.dev.getTxClassStats(TxClass::Sync).sent == 2);
+  assert(p.dev.getTxClassStats(TxClass::Pdo).sent == 2);
+  assert(p.dev.getTxClassStats(TxClass::Sdo).sent == 2);
+}
+
+static void dropPolicies()
+{
+  {
+    Pair p;
+    p.dev.setTxQueueLimit(TxClass::Pdo, 2, TxDropPolicy::DropOldest);
+    for (uint32_t id : {0x181u, 0x182u, 0x183u}) p.write(id);
+    p.dev.flushAsyncFrames();
+    assert(p.received() == vector<uint32_t>({0x182, 0x183}));
+
+    auto s = p.dev.getTxClassStats(TxClass::Pdo);
+    assert(s.dropped == 1 && s.sent == 2 && s.maxDepth == 2);
+    assert(p.dev.stats.droppedTx == 1);
+  }
+
+  {
+    Pair p;
+    p.dev.setTxQueueLimit(TxClass::Pdo, 2, TxDropPolicy::DropNewest);
+    p.write(0x181);
+    p.write(0x182);
+    uint8_t d[1] = {};
+    Msg m        = {.id = 0x183, .rtr = false, .len = 1, .data = d};
+    assert(p.dev.write(m, true) == Error::OutOfMemory);
+    p.dev.flushAsyncFrames();
+    assert(p.received() == vector<uint32_t>({0x181, 0x182}));
+    assert(p.dev.getTxClassStats(TxClass::Pdo).dropped == 1);
+  }
+}
+
+// A full socket leaves frames queued, in order, rather than dropping them
+static void backpressure()
+{
+  constexpr size_t NumFrames = 2000;
+  Pair p;
+  p.dev.setTxQueueLimit(TxClass::Sdo, NumFrames, TxDropPolicy::DropNewest);
+
+  for (size_t i = 0; i < NumFrames; ++i) p.write(0x581, i & 0xff);
+  p.dev.flushAsyncFrames();
+  assert(p.dev.txBacklog() > 0);
+  assert(p.dev.txBacklog() < NumFrames);
+
+  size_t got = 0, rounds = 0;
+  struct canfd_frame f;
+  while (got < NumFrames) {
+    assert(++rounds < NumFrames);
+    while (recv(p.rx, &f, sizeof(f), 0) > 0) {
+      assert(f.can_id == 0x581);
+      assert(f.data[0] == (got & 0xff));
+      got++;
+    }
+    p.dev.flushAsyncFrames();
+  }
+
+  assert(p.dev.txBacklog() == 0);
+  auto s = p.dev.getTxClassStats(TxClass::Sdo);
+  assert(s.sent == NumFrames && s.dropped == 0 && s.depth == 0);
+  printf("backpressure: %zu frames in %zu rounds, max depth %zu\n", NumFrames, rounds, s.maxDepth);
+}
+
+int main()
+{
+  classOrder();
+  dropPolicies();
+  backpressure();
+  printf("OK\n");
+  return 0;
+}
@@ -40,11 +40,25 @@ void System::timerHelper(TimerData *td)
   td->cb();
 }
 
+System::TimerHdl System::resetTimer(System::TimerHdl &hdl, uint32_t delayMs)
+{
+  if (!hdl || hdl->available) return System::InvalidTimer;
+
+  timerCancel.invoke(hdl->handle);
+  hdl->handle = timer.invoke((float)delayMs / 1000.0f, MEMBER_CB(hdl, trigger));
+  if (!hdl->handle) {
+    LogInfo("Timer recreation failed");
+  }
+
+  return hdl;
+}
+
 void System::deleteTimer(System::TimerHdl &hdl)
 {
   if (hdl) {
     timerCancel.invoke(hdl->handle);
     hdl->available = true;
+    hdl            = System::InvalidTimer;
   }
 }
 
@@ -23,8 +23,15 @@ void System::service()
   for (auto td = timers.begin(); td != timers.end(); ++td) {
     if (td->enable && (now - td->lastFireTime) >= td->delay) {
       if (td->period) {
-        td->lastFireTime = now;
+        uint32_t late    = now - td->lastFireTime - td->delay;
+        td->lastFireTime += td->delay;
         td->delay        = td->period;
+
+        // Skip missed periods rather than firing them back to back
+        if (late >= td->period) {
+          td->lastFireTime += late / td->period * td->period;
+          overruns += late / td->period;
+        }
       }
       else {
         td->enable = false;
@@ -34,10 +41,21 @@ void System::service()
   }
 }
 
+System::TimerHdl System::resetTimer(System::TimerHdl &hdl, uint32_t delayMs)
+{
+  if (hdl >= timers.size() || timers[hdl].available) return System::InvalidTimer;
+  timers[hdl].lastFireTime = millis();
+  timers[hdl].delay        = delayMs;
+  timers[hdl].enable       = true;
+  return hdl;
+}
+
 void System::deleteTimer(System::TimerHdl &hdl)
 {
   if (hdl != System::InvalidTimer) {
     assert(hdl < timers.size());
+    phaseSlots.release(timers[hdl].period, timers[hdl].phaseSlot);
+    timers[hdl].phaseSlot = PhaseSlots::NoSlot;
     timers[hdl].enable    = false;
     timers[hdl].available = true;
     hdl                   = System::InvalidTimer;
@@ -73,28 +91,39 @@ System::TimerHdl System::scheduleDelayed(uint32_t delayMs, std::function<void()>
 
 System::TimerHdl System::schedulePeriodic(uint32_t periodMs, std::function<void()> cb, bool staggeredStart)
 {
-  uint32_t staggeredDelay = staggeredStart ? random(periodMs << 1) : 0;
+  uint32_t now        = millis();
+  uint32_t firstDelay = periodMs;
+  uint8_t slot        = PhaseSlots::NoSlot;
+
+  // Delay until the next point on this timer's phase grid
+  if (staggeredStart && periodMs) {
+    slot           = phaseSlots.acquire(periodMs);
+    uint32_t phase = slot == PhaseSlots::NoSlot ? 0 : PhaseSlots::offset(slot, periodMs);
+    firstDelay     = periodMs - (now % periodMs + periodMs - phase) % periodMs;
+  }
 
   for (size_t i = 0; i < timers.size(); i++) {
     TimerData &td = timers[i];
     if (td.available) {
-      td.lastFireTime = millis();
-      td.delay        = periodMs + staggeredDelay;
+      td.lastFireTime = now;
+      td.delay        = firstDelay;
       td.enable       = true;
       td.available    = false;
       td.period       = periodMs;
       td.cb           = cb;
+      td.phaseSlot    = slot;
       return i;
     }
   }
 
   timers.push_back({
-      .lastFireTime = millis(),
-      .delay        = periodMs + staggeredDelay,
+      .lastFireTime = now,
+      .delay        = firstDelay,
       .period       = periodMs,
       .cb           = cb,
       .enable       = true,
       .available    = false,
+      .phaseSlot    = slot,
   });
 
   return timers.size() - 1;
@@ -14,6 +14,7 @@ namespace {
   class MockSystem : public canfetti::System {
   public:
     MOCK_METHOD(System::TimerHdl, resetTimer, (System::TimerHdl & hdl), (override));
+    MOCK_METHOD(System::TimerHdl, resetTimer, (System::TimerHdl & hdl, uint32_t delayMs), (override));
     MOCK_METHOD(void, deleteTimer, (System::TimerHdl & hdl), (override));
     MOCK_METHOD(void, disableTimer, (System::TimerHdl & hdl), (override));
     MOCK_METHOD(System::TimerHdl, scheduleDelayed, (uint32_t delayMs, std::function<void()> cb), (override));
@@ -48,7 +49,7 @@ TEST(LinuxCoTest, emcyCallback)
 
   co.registerEmcyCallback(mcb.AsStdFunction());
 
-  EXPECT_CALL(co.dev, write(FieldsAre(0x081, false, 8, _), _)).WillOnce(Invoke(&co, &MockLocalNode::sendResponse));
+  EXPECT_CALL(co.dev, write(FieldsAre(0x081, false, 8, _, _, _, _), _)).WillOnce(Invoke(&co, &MockLocalNode::sendResponse));
 
   co.sendEmcy(0x1234);
 }
@@ -19,6 +19,7 @@ namespace {
   class MockSystem : public canfetti::System {
   public:
     MOCK_METHOD(System::TimerHdl, resetTimer, (System::TimerHdl & hdl), (override));
+    MOCK_METHOD(System::TimerHdl, resetTimer, (System::TimerHdl & hdl, uint32_t delayMs), (override));
     MOCK_METHOD(void, deleteTimer, (System::TimerHdl & hdl), (override));
     MOCK_METHOD(void, disableTimer, (System::TimerHdl & hdl), (override));
     MOCK_METHOD(System::TimerHdl, scheduleDelayed, (uint32_t delayMs, std::function<void()> cb), (override));
@@ -71,7 +72,7 @@ TEST(LinuxCoTest, readAsyncExpedited)
   EXPECT_EQ(co.addSDOClient(node, node), Error::Success);
 
   bool sentInit = false;
-  EXPECT_CALL(co.dev, write(FieldsAre(0x605, false, 8, _), _))
+  EXPECT_CALL(co.dev, write(FieldsAre(0x605, false, 8, _, _, _, _), _))
       .WillOnce(
           Invoke([&](const Msg& m, bool /* async */) {
             sentInit = true;
@@ -263,3 +263,142 @@ TEST(ObjDict, Generation)
     gen = g;
   }
 }
+
+TEST(ObjDict, ManyEntries)
+{
+  ObjDict od;
+
+  for (uint16_t idx = 0x2000; idx < 0x2200; idx++) {
+    for (uint8_t subIdx = 0; subIdx < 8; subIdx++) {
+      ASSERT_EQ(od.insert(idx, subIdx, canfetti::Access::RW, _u32(idx << 8 | subIdx)), Error::Success);
+    }
+  }
+
+  for (uint16_t idx = 0x2000; idx < 0x2200; idx++) {
+    for (uint8_t subIdx = 0; subIdx < 8; subIdx++) {
+      uint32_t v = 0;
+      EXPECT_EQ(od.get(idx, subIdx, v), Error::Success);
+      EXPECT_EQ(v, (uint32_t)(idx << 8 | subIdx));
+    }
+    EXPECT_FALSE(od.entryExists(idx, 8));
+  }
+
+  auto [err, key] = od.autoInsert(canfetti::Access::RW, _u8(1), nullptr, 0x2100);
+  EXPECT_EQ(err, Error::Success);
+  EXPECT_EQ(std::get<0>(key), 0x2200);
+}
+
+TEST(ObjDict, Resolve)
+{
+  ObjDict od;
+  EXPECT_EQ(od.insert(0x2000, 0, canfetti::Access::RW, _u16(7)), Error::Success);
+
+  {
+    auto [e, ref] = od.resolve<uint32_t>(0x2000, 0);
+    EXPECT_EQ(e, Error::ParamIncompatibility);
+    EXPECT_FALSE(ref);
+  }
+
+  {
+    auto [e, ref] = od.resolve<uint16_t>(0x2001, 0);
+    EXPECT_EQ(e, Error::IndexNotFound);
+    EXPECT_FALSE(ref);
+  }
+
+  auto [e, ref] = od.resolve<uint16_t>(0x2000, 0);
+  ASSERT_EQ(e, Error::Success);
+  ASSERT_TRUE(ref);
+
+  uint16_t v = 0;
+  EXPECT_EQ(ref.get(v), Error::Success);
+  EXPECT_EQ(v, 7);
+
+  // Same generation and callback behavior as ObjDict::set
+  ::testing::MockFunction<void(uint16_t idx, uint8_t subIdx)> mcb;
+  EXPECT_CALL(mcb, Call(0x2000, 0)).Times(1);
+  EXPECT_EQ(od.registerCallback(0x2000, 0, mcb.AsStdFunction()), Error::Success);
+
+  unsigned gen = ref.generation();
+  EXPECT_EQ(ref.set(99), Error::Success);
+  EXPECT_NE(gen, ref.generation());
+  EXPECT_EQ(od.get(0x2000, 0, v), Error::Success);
+  EXPECT_EQ(v, 99);
+
+  // Locked entries are honored
+  {
+    auto [pe, p] = od.makeProxy(0x2000, 0);
+    ASSERT_EQ(pe, Error::Success);
+    EXPECT_EQ(ref.get(v), Error::Timeout);
+    EXPECT_EQ(ref.set(1), Error::Timeout);
+  }
+}
+
+namespace {
+  uint32_t staticCounter = 1234;
+  uint8_t staticArray[3] = {1, 2, 3};
+
+  constexpr auto StaticTable = makeStaticOd({
+      odEntry(0x2100, 0, canfetti::Access::RW, _u16(10)),
+      odRef(0x2000, 1, canfetti::Access::RW, staticCounter),
+      odRef(0x2000, 2, canfetti::Access::RO, staticArray),
+      odEntry(0x2000, 0, canfetti::Access::RO, _u8(2)),
+  });
+
+  static_assert(StaticTable[0].key == 0x200000, "Static tables are sorted at compile time");
+  static_assert(findStaticOdEntry(StaticTable.data(), StaticTable.size(), 0x2100, 0) == &StaticTable[3]);
+  static_assert(findStaticOdEntry(StaticTable.data(), StaticTable.size(), 0x2100, 1) == nullptr);
+}
+
+TEST(ObjDict, StaticTable)
+{
+  static StaticOdStorage<StaticTable.size()> storage;
+  ObjDict od;
+
+  EXPECT_EQ(od.insert(0x3000, 0, canfetti::Access::RW, _u8(5)), Error::Success);
+  ASSERT_EQ(od.attachStatic(StaticTable, storage), Error::Success);
+  EXPECT_EQ(od.attachStatic(StaticTable, storage), Error::Error);
+
+  uint16_t v16 = 0;
+  EXPECT_EQ(od.get(0x2100, 0, v16), Error::Success);
+  EXPECT_EQ(v16, 10);
+  EXPECT_EQ(od.set(0x2100, 0, _u16(11)), Error::Success);
+  EXPECT_EQ(od.get(0x2100, 0, v16), Error::Success);
+  EXPECT_EQ(v16, 11);
+
+  // References go straight to the variable
+  {
+    auto [e, p] = od.makeProxy(0x2000, 1);
+    ASSERT_EQ(e, Error::Success);
+    uint32_t v = 5678;
+    EXPECT_EQ(p.copyFrom((uint8_t*)&v, sizeof(v)), Error::Success);
+  }
+  EXPECT_EQ(staticCounter, 5678);
+  EXPECT_EQ(od.entrySize(0x2000, 2), 3);
+
+  // Static and runtime entries share one namespace
+  EXPECT_EQ(od.insert(0x2000, 0, canfetti::Access::RO, _u8(1)), Error::Error);
+  EXPECT_EQ(od.insert(0x2000, 3, canfetti::Access::RO, _u8(1)), Error::Success);
+  EXPECT_TRUE(od.entryExists(0x2000, 3));
+  EXPECT_TRUE(od.entryExists(0x3000, 0));
+
+  ::testing::MockFunction<void(uint16_t idx, uint8_t subIdx)> mcb;
+  EXPECT_CALL(mcb, Call(0x2100, 0)).Times(2);
+  EXPECT_EQ(od.registerCallback(0x2100, 0, mcb.AsStdFunction()), Error::Success);
+  EXPECT_EQ(od.set(0x2100, 0, _u16(12)), Error::Success);
+
+  // Rows are indexed in place, and typed handles go straight to their values
+  EXPECT_EQ(od.lookup(0x2100, 0), &storage.rows[3]);
+  auto [e, ref] = od.resolve<uint16_t>(0x2100, 0);
+  ASSERT_EQ(e, Error::Success);
+  unsigned gen = ref.generation();
+  EXPECT_EQ(ref.set(13), Error::Success);
+  EXPECT_NE(ref.generation(), gen);
+  EXPECT_EQ(od.get(0x2100, 0, v16), Error::Success);
+  EXPECT_EQ(v16, 13);
+  EXPECT_EQ(std::get<0>(od.resolve<uint8_t>(0x2100, 0)), Error::ParamIncompatibility);
+
+  // A row costs its lock, generation, timestamp and callback slot, plus room
+  // for a scalar value, well short of a runtime entry's OdVariant
+  EXPECT_LE(sizeof(StaticOdRow), 48u);
+  EXPECT_LT(sizeof(StaticOdRow) * 4, sizeof(OdRuntimeEntry));
+}
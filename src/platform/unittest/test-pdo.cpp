@@ -0,0 +1,703 @@
+#include <algorithm>
+#include <cstring>
+#include <vector>
+#include "test.h"
+
+using namespace canfetti;
+using namespace std;
+
+using ::testing::_;
+using ::testing::Invoke;
+using ::testing::MockFunction;
+using ::testing::NiceMock;
+
+namespace {
+  class MockSystem : public canfetti::System {
+  public:
+    MockSystem()
+    {
+      // Like the real ones, only live timers can be re-armed
+      ON_CALL(*this, resetTimer(_, _)).WillByDefault([](System::TimerHdl &hdl, uint32_t) { return hdl; });
+    }
+    MOCK_METHOD(System::TimerHdl, resetTimer, (System::TimerHdl & hdl), (override));
+    MOCK_METHOD(System::TimerHdl, resetTimer, (System::TimerHdl & hdl, uint32_t delayMs), (override));
+    MOCK_METHOD(void, deleteTimer, (System::TimerHdl & hdl), (override));
+    MOCK_METHOD(void, disableTimer, (System::TimerHdl & hdl), (override));
+    MOCK_METHOD(System::TimerHdl, scheduleDelayed, (uint32_t delayMs, std::function<void()> cb), (override));
+    MOCK_METHOD(System::TimerHdl, schedulePeriodic, (uint32_t periodMs, std::function<void()> cb, bool staggeredStart), (override));
+  };
+
+  class MockCanDevice : public CanDevice {
+  public:
+    MockCanDevice()
+    {
+      ON_CALL(*this, writeCyclic).WillByDefault(::testing::Return(Error::UnsupportedAccess));
+      ON_CALL(*this, setRxChangeFilter).WillByDefault(::testing::Return(Error::UnsupportedAccess));
+    }
+    MOCK_METHOD(Error, write, (const Msg &msg, bool /* async */), (override));
+    MOCK_METHOD(void, flush, (), (override));
+    MOCK_METHOD(Error, writeCyclic, (const Msg &msg, uint32_t periodMs), (override));
+    MOCK_METHOD(void, stopCyclic, (uint32_t id), (override));
+    MOCK_METHOD(Error, setRxChangeFilter, (uint32_t id, uint8_t len, uint32_t timeoutMs), (override));
+    MOCK_METHOD(void, clearRxChangeFilter, (uint32_t id), (override));
+    MOCK_METHOD(void, setRxFilters, (const vector<RxFilter> &filters), (override));
+    MOCK_METHOD(bool, fdEnabled, (), (const, override));
+  };
+
+  class MockLocalNode : public LocalNode {
+  public:
+    MockLocalNode() : LocalNode(dev, sys, 1, "Test Device", 0) {}
+    void receive(uint32_t id, vector<uint8_t> payload, uint64_t timestamp = 0)
+    {
+      Msg m = {.id = id, .rtr = false, .len = (uint8_t)payload.size(), .data = payload.data(), .timestamp = timestamp};
+      processFrame(m);
+    }
+    using LocalNode::processRxTimeout;
+    NiceMock<MockSystem> sys;
+    NiceMock<MockCanDevice> dev;
+  };
+
+  vector<uint8_t> sent;
+
+  Error capture(const Msg &m, bool /* async */)
+  {
+    sent.assign(m.data, m.data + m.len);
+    return Error::Success;
+  }
+}
+
+TEST(Pdo, TxPacking)
+{
+  MockLocalNode co;
+  co.init();
+
+  uint16_t a = 0x1122;
+  uint32_t b = 0x33445566;
+  EXPECT_EQ(co.od.insert(0x2000, 0, Access::RO, OdBuffer{&a, sizeof(a)}), Error::Success);
+  EXPECT_EQ(co.od.insert(0x2001, 0, Access::RO, b), Error::Success);
+  EXPECT_EQ(co.addTPDO(1, 0x181, {{0x2000, 0}, {0x2001, 0}}), Error::Success);
+
+  EXPECT_CALL(co.dev, write(_, _)).WillRepeatedly(Invoke(capture));
+
+  EXPECT_EQ(co.triggerTPDO(1), Error::Success);
+  EXPECT_EQ(sent, (vector<uint8_t>{0x22, 0x11, 0x66, 0x55, 0x44, 0x33}));
+
+  // Plans pick up new values without being rebuilt
+  a = 0x7788;
+  EXPECT_EQ(co.od.set(0x2001, 0, _u32(0x01020304)), Error::Success);
+  EXPECT_EQ(co.triggerTPDO(1), Error::Success);
+  EXPECT_EQ(sent, (vector<uint8_t>{0x88, 0x77, 0x04, 0x03, 0x02, 0x01}));
+
+  // Changing the mapping rebuilds the plan
+  EXPECT_EQ(co.od.set(0x1A01, 0, _u8(1)), Error::Success);
+  EXPECT_EQ(co.triggerTPDO(1), Error::Success);
+  EXPECT_EQ(sent, (vector<uint8_t>{0x88, 0x77}));
+
+  EXPECT_EQ(co.od.set(0x1A01, 1, _u32(0x20010020)), Error::Success);
+  EXPECT_EQ(co.triggerTPDO(1), Error::Success);
+  EXPECT_EQ(sent, (vector<uint8_t>{0x04, 0x03, 0x02, 0x01}));
+
+  // Locked entries fail the whole PDO
+  {
+    auto [e, p] = co.od.makeProxy(0x2001, 0);
+    ASSERT_EQ(e, Error::Success);
+    EXPECT_EQ(co.triggerTPDO(1), Error::DataXferLocal);
+  }
+
+  // Disabling goes through the communication parameters
+  EXPECT_EQ(co.disableTPDO(1), Error::Success);
+  EXPECT_EQ(co.triggerTPDO(1), Error::DataXfer);
+}
+
+TEST(Pdo, Fd)
+{
+  uint8_t bytes[10] = {1, 2, 3, 4, 5, 6, 7, 8, 9, 10};
+  uint32_t words[16] = {};
+  vector<tuple<uint16_t, uint8_t>> byteMap, wordMap;
+
+  // Classic CAN stops at 8 bytes
+  {
+    MockLocalNode co;
+    co.init();
+    for (uint8_t i = 0; i < 10; ++i) {
+      EXPECT_EQ(co.od.insert(0x2000, i, Access::RW, _p(bytes[i])), Error::Success);
+      byteMap.emplace_back(0x2000, i);
+    }
+    EXPECT_CALL(co.dev, write(_, _)).Times(0);
+    co.addTPDO(1, 0x181, byteMap.data(), byteMap.size());
+    EXPECT_EQ(co.triggerTPDO(1), Error::PdoSizeViolation);
+  }
+
+  MockLocalNode co;
+  ON_CALL(co.dev, fdEnabled).WillByDefault(::testing::Return(true));
+  co.init();
+  co.setState(State::Operational);
+
+  for (uint8_t i = 0; i < 10; ++i) {
+    EXPECT_EQ(co.od.insert(0x2000, i, Access::RW, _p(bytes[i])), Error::Success);
+  }
+  for (uint8_t i = 0; i < 16; ++i) {
+    EXPECT_EQ(co.od.insert(0x2001, i, Access::RW, _p(words[i])), Error::Success);
+    wordMap.emplace_back(0x2001, i);
+  }
+  EXPECT_EQ(co.addTPDO(1, 0x181, byteMap.data(), byteMap.size()), Error::Success);
+  EXPECT_EQ(co.addRPDO(0x201, wordMap.data(), wordMap.size()), Error::Success);
+
+  // Sent as FD, padded to the next FD frame length
+  bool fd = false;
+  EXPECT_CALL(co.dev, write(_, _)).WillOnce(Invoke([&](const Msg &m, bool async) {
+    fd = m.fd;
+    return capture(m, async);
+  }));
+  EXPECT_EQ(co.triggerTPDO(1), Error::Success);
+  EXPECT_TRUE(fd);
+  EXPECT_EQ(sent, (vector<uint8_t>{1, 2, 3, 4, 5, 6, 7, 8, 9, 10, 0, 0}));
+
+  // 64 byte RPDOs
+  vector<uint8_t> payload(64);
+  for (size_t i = 0; i < payload.size(); ++i) payload[i] = i;
+  co.receive(0x201, payload);
+  EXPECT_EQ(words[0], 0x03020100u);
+  EXPECT_EQ(words[15], 0x3f3e3d3cu);
+
+  static_assert(fdPayloadLen(8) == 8 && fdPayloadLen(9) == 12 && fdPayloadLen(21) == 24 && fdPayloadLen(25) == 32 && fdPayloadLen(33) == 48 && fdPayloadLen(49) == 64);
+}
+
+TEST(Pdo, RxApply)
+{
+  MockLocalNode co;
+  co.init();
+
+  uint8_t a  = 0;
+  uint16_t b = 0;
+  string s   = "xy";
+  EXPECT_EQ(co.od.insert(0x2000, 0, Access::WO, OdBuffer{&a, sizeof(a)}), Error::Success);
+  EXPECT_EQ(co.od.insert(0x2001, 0, Access::RW, b), Error::Success);
+  EXPECT_EQ(co.od.insert(0x2002, 0, Access::RW, s), Error::Success);
+  EXPECT_EQ(co.addRPDO(0x201, {{0x2000, 0}, {0x2001, 0}}), Error::Success);
+  EXPECT_EQ(co.addRPDO(0x202, {{0x2001, 0}, {0x2002, 0}}), Error::Success);
+
+  MockFunction<void(uint16_t idx, uint8_t subIdx)> mcb;
+  EXPECT_EQ(co.od.registerCallback(0x2001, 0, mcb.AsStdFunction()), Error::Success);
+
+  // Not operational
+  EXPECT_CALL(mcb, Call(_, _)).Times(0);
+  co.receive(0x201, {1, 2, 3});
+  EXPECT_EQ(a, 0);
+
+  co.setState(State::Operational);
+
+  unsigned gen;
+  EXPECT_EQ(co.od.generation(0x2001, 0, gen), Error::Success);
+
+  ::testing::Mock::VerifyAndClearExpectations(&mcb);
+  EXPECT_CALL(mcb, Call(0x2001, 0)).Times(2);
+  co.receive(0x201, {1, 2, 3});
+  EXPECT_EQ(a, 1);
+
+  unsigned g;
+  EXPECT_EQ(co.od.get(0x2001, 0, b), Error::Success);
+  EXPECT_EQ(b, 0x0302);
+  EXPECT_EQ(co.od.generation(0x2001, 0, g), Error::Success);
+  EXPECT_NE(gen, g);
+
+  // Too short
+  co.receive(0x201, {9, 9});
+  EXPECT_EQ(a, 1);
+
+  // Resizable entries go through an OdProxy
+  co.receive(0x202, {4, 5, 'a', 'b'});
+  EXPECT_EQ(co.od.get(0x2001, 0, b), Error::Success);
+  EXPECT_EQ(b, 0x0504);
+  EXPECT_EQ(co.od.get(0x2002, 0, s), Error::Success);
+  EXPECT_EQ(s, "ab");
+}
+
+TEST(Pdo, RxDispatch)
+{
+  MockLocalNode co;
+  co.init();
+  co.setState(State::Operational);
+
+  uint8_t a = 0, b = 0;
+  EXPECT_EQ(co.od.insert(0x2000, 0, Access::RW, a), Error::Success);
+  EXPECT_EQ(co.od.insert(0x2001, 0, Access::RW, b), Error::Success);
+  EXPECT_EQ(co.addRPDO(0x201, {{0x2000, 0}}), Error::Success);
+  EXPECT_EQ(co.addRPDO(0x201, {{0x2001, 0}}), Error::Success);
+
+  // RPDOs sharing a COB-ID are all applied
+  co.receive(0x201, {7});
+  EXPECT_EQ(co.od.get(0x2000, 0, a), Error::Success);
+  EXPECT_EQ(co.od.get(0x2001, 0, b), Error::Success);
+  EXPECT_EQ(a, 7);
+  EXPECT_EQ(b, 7);
+
+  // Remapping a COB-ID updates dispatch
+  EXPECT_EQ(co.od.set(0x1401, 1, _u32(0x301)), Error::Success);
+  co.receive(0x201, {8});
+  co.receive(0x301, {9});
+  EXPECT_EQ(co.od.get(0x2000, 0, a), Error::Success);
+  EXPECT_EQ(co.od.get(0x2001, 0, b), Error::Success);
+  EXPECT_EQ(a, 8);
+  EXPECT_EQ(b, 9);
+
+  // Disabled RPDOs are dropped from dispatch
+  EXPECT_EQ(co.od.set(0x1400, 1, _u32(0x80000201)), Error::Success);
+  co.receive(0x201, {10});
+  EXPECT_EQ(co.od.get(0x2000, 0, a), Error::Success);
+  EXPECT_EQ(a, 8);
+
+  // IDs outside the direct-indexed range
+  EXPECT_EQ(co.od.set(0x1400, 1, _u32(0x10000201)), Error::Success);
+  co.receive(0x10000201, {11});
+  EXPECT_EQ(co.od.get(0x2000, 0, a), Error::Success);
+  EXPECT_EQ(a, 11);
+}
+
+TEST(Pdo, RxTimestamp)
+{
+  MockLocalNode co;
+  co.init();
+  co.setState(State::Operational);
+
+  uint8_t a = 0, c = 0;
+  string s  = "x";
+  EXPECT_EQ(co.od.insert(0x2000, 0, Access::RW, a), Error::Success);
+  EXPECT_EQ(co.od.insert(0x2001, 0, Access::RW, s), Error::Success);
+  EXPECT_EQ(co.od.insert(0x2002, 0, Access::RW, c), Error::Success);
+  EXPECT_EQ(co.addRPDO(0x201, {{0x2000, 0}}), Error::Success);
+  EXPECT_EQ(co.addRPDO(0x202, {{0x2001, 0}}), Error::Success);
+  EXPECT_EQ(co.addRPDO(0x203, {{0x2002, 0}}), Error::Success);
+  EXPECT_EQ(co.setRpdoTransmissionType(0x203, 1), Error::Success);
+
+  uint64_t ts = 1;
+  EXPECT_EQ(co.od.rxTimestamp(0x2000, 0, ts), Error::Success);
+  EXPECT_EQ(ts, 0u);
+  EXPECT_EQ(co.od.rxTimestamp(0x2fff, 0, ts), Error::IndexNotFound);
+
+  // Visible to callbacks of the entry being written
+  uint64_t seen = 0;
+  EXPECT_EQ(co.od.registerCallback(0x2000, 0, [&](uint16_t idx, uint8_t subIdx) { co.od.rxTimestamp(idx, subIdx, seen); }), Error::Success);
+  co.receive(0x201, {1}, 1000);
+  EXPECT_EQ(seen, 1000u);
+
+  // Through an OdProxy
+  co.receive(0x202, {'a', 'b'}, 2000);
+  EXPECT_EQ(co.od.rxTimestamp(0x2001, 0, ts), Error::Success);
+  EXPECT_EQ(ts, 2000u);
+
+  // Synchronous RPDOs keep the time the frame arrived, not the SYNC
+  co.receive(0x203, {3}, 3000);
+  EXPECT_EQ(co.od.rxTimestamp(0x2002, 0, ts), Error::Success);
+  EXPECT_EQ(ts, 0u);
+  co.receive(0x080, {}, 4000);
+  EXPECT_EQ(co.od.rxTimestamp(0x2002, 0, ts), Error::Success);
+  EXPECT_EQ(ts, 3000u);
+
+  // Local writes leave it alone
+  EXPECT_EQ(co.od.set(0x2000, 0, (uint8_t)5), Error::Success);
+  EXPECT_EQ(co.od.rxTimestamp(0x2000, 0, ts), Error::Success);
+  EXPECT_EQ(ts, 1000u);
+}
+
+TEST(Pdo, Sync)
+{
+  MockLocalNode co;
+  co.init();
+  co.setState(State::Operational);
+
+  uint8_t in = 0, out = 0x42;
+  vector<uint32_t> ids;
+  EXPECT_EQ(co.od.insert(0x2000, 0, Access::RW, in), Error::Success);
+  EXPECT_EQ(co.od.insert(0x2001, 0, Access::RW, out), Error::Success);
+  EXPECT_EQ(co.addRPDO(0x201, {{0x2000, 0}}), Error::Success);
+  EXPECT_EQ(co.addTPDO(1, 0x181, {{0x2001, 0}}), Error::Success);
+  EXPECT_EQ(co.setRpdoTransmissionType(0x201, 1), Error::Success);
+  EXPECT_EQ(co.setTpdoTransmissionType(1, 2), Error::Success);
+  EXPECT_EQ(co.setTpdoTransmissionType(1, 0xFC), Error::ValueRange);
+
+  EXPECT_CALL(co.dev, write(_, _)).WillRepeatedly(Invoke([&](const Msg &m, bool async) {
+    ids.push_back(m.id);
+    return capture(m, async);
+  }));
+
+  // Synchronous RPDOs are latched until the next SYNC
+  co.receive(0x201, {5});
+  EXPECT_EQ(co.od.get(0x2000, 0, in), Error::Success);
+  EXPECT_EQ(in, 0);
+
+  co.receive(0x080, {});
+  EXPECT_EQ(co.od.get(0x2000, 0, in), Error::Success);
+  EXPECT_EQ(in, 5);
+  EXPECT_TRUE(ids.empty());
+
+  // Type 2 TPDOs go out every 2nd SYNC
+  co.receive(0x080, {});
+  EXPECT_EQ(ids, (vector<uint32_t>{0x181}));
+  EXPECT_EQ(sent, (vector<uint8_t>{0x42}));
+  co.receive(0x080, {});
+  co.receive(0x080, {});
+  EXPECT_EQ(ids, (vector<uint32_t>{0x181, 0x181}));
+
+  // Producer sends a counter and synchronizes the local node too
+  function<void()> producer;
+  EXPECT_CALL(co.sys, schedulePeriodic(10, _, _)).WillOnce(Invoke([&](uint32_t, function<void()> cb, bool) {
+    producer = cb;
+    return System::InvalidTimer;
+  }));
+  EXPECT_EQ(co.setSyncProducer(10, 3), Error::Success);
+  ASSERT_TRUE(producer);
+
+  ids.clear();
+  producer();
+  EXPECT_EQ(ids, (vector<uint32_t>{0x080}));
+  EXPECT_EQ(sent, (vector<uint8_t>{1}));
+  producer();
+  EXPECT_EQ(ids, (vector<uint32_t>{0x080, 0x080, 0x181}));
+  producer();
+  producer();
+  EXPECT_EQ(sent, (vector<uint8_t>{0x42}));
+  EXPECT_EQ(ids.size(), 6u);
+  ids.clear();
+  producer();
+  EXPECT_EQ(sent, (vector<uint8_t>{2}));
+
+  EXPECT_EQ(co.setSyncProducer(0, 3), Error::Success);
+  EXPECT_EQ(co.setSyncProducer(10, 1), Error::ValueRange);
+}
+
+TEST(Pdo, ChangeOfState)
+{
+  MockLocalNode co;
+  co.init();
+
+  uint16_t v = 0;
+  vector<uint32_t> ids;
+  function<void()> eventTimer, inhibitTimer;
+  unsigned eventResets = 0, inhibitResets = 0;
+  EXPECT_EQ(co.od.insert(0x2000, 0, Access::RW, v), Error::Success);
+  EXPECT_EQ(co.addTPDO(1, 0x181, {{0x2000, 0}}, 100), Error::Success);
+  EXPECT_EQ(co.setTpdoInhibitTime(1, 45), Error::Success);  // 4.5 ms
+  EXPECT_EQ(co.setTpdoChangeOfState(1, true), Error::Success);
+  EXPECT_EQ(co.setTpdoChangeOfState(2, true), Error::IndexNotFound);
+
+  EXPECT_CALL(co.dev, write(_, _)).WillRepeatedly(Invoke([&](const Msg &m, bool async) {
+    ids.push_back(m.id);
+    return capture(m, async);
+  }));
+  // Each timer is created once and then re-armed in place
+  EXPECT_CALL(co.sys, schedulePeriodic(100, _, _)).WillOnce(Invoke([&](uint32_t, function<void()> cb, bool) {
+    eventTimer = cb;
+    return 1;
+  }));
+  EXPECT_CALL(co.sys, scheduleDelayed(5, _)).WillOnce(Invoke([&](uint32_t, function<void()> cb) {
+    inhibitTimer = cb;
+    return 2;
+  }));
+  EXPECT_CALL(co.sys, resetTimer(_, _)).WillRepeatedly(Invoke([&](System::TimerHdl &hdl, uint32_t delayMs) {
+    if (hdl == 1 && delayMs == 100) eventResets++;
+    if (hdl == 2 && delayMs == 5) inhibitResets++;
+    return hdl;
+  }));
+
+  // Not operational
+  EXPECT_EQ(co.od.set(0x2000, 0, _u16(1)), Error::Success);
+  EXPECT_TRUE(ids.empty());
+
+  co.setState(State::Operational);
+  ASSERT_TRUE(eventTimer);
+
+  // A change goes out immediately and restarts the event timer
+  EXPECT_EQ(co.od.set(0x2000, 0, _u16(2)), Error::Success);
+  EXPECT_EQ(ids.size(), 1u);
+  EXPECT_EQ(sent, (vector<uint8_t>{2, 0}));
+  EXPECT_EQ(eventResets, 1u);
+  ASSERT_TRUE(inhibitTimer);
+
+  // Changes within the inhibit time are coalesced
+  EXPECT_EQ(co.od.set(0x2000, 0, _u16(3)), Error::Success);
+  EXPECT_EQ(co.od.set(0x2000, 0, _u16(4)), Error::Success);
+  EXPECT_EQ(ids.size(), 1u);
+
+  inhibitTimer();
+  EXPECT_EQ(ids.size(), 2u);
+  EXPECT_EQ(sent, (vector<uint8_t>{4, 0}));
+  EXPECT_EQ(eventResets, 2u);
+  EXPECT_EQ(inhibitResets, 1u);
+  inhibitTimer();
+  EXPECT_EQ(ids.size(), 2u);
+
+  // Callbacks without a new generation don't count as a change
+  EXPECT_EQ(co.od.fireCallbacks(0x2000, 0), Error::Success);
+  EXPECT_EQ(ids.size(), 2u);
+
+  // Event timer is still a fallback
+  eventTimer();
+  EXPECT_EQ(ids.size(), 3u);
+}
+
+TEST(Pdo, RxTimeout)
+{
+  MockLocalNode co;
+  co.init();
+
+  uint8_t a = 0, b = 0;
+  unsigned timeoutsA = 0, timeoutsB = 0;
+  function<void()> sweep;
+  EXPECT_EQ(co.od.insert(0x2000, 0, Access::RW, a), Error::Success);
+  EXPECT_EQ(co.od.insert(0x2001, 0, Access::RW, b), Error::Success);
+
+  // Several supervised RPDOs may share a COB-ID
+  EXPECT_EQ(co.addRPDO(0x201, {{0x2000, 0}}, 100, [&](uint16_t cobid) { EXPECT_EQ(cobid, 0x201); timeoutsA++; }), Error::Success);
+  EXPECT_EQ(co.addRPDO(0x201, {{0x2001, 0}}, 50, [&](uint16_t cobid) { EXPECT_EQ(cobid, 0x201); timeoutsB++; }), Error::Success);
+
+  // One sweep timer ticking at a fraction of the shortest timeout
+  EXPECT_CALL(co.sys, schedulePeriodic(10, _, false)).WillOnce(::testing::Return(1));
+  EXPECT_CALL(co.sys, schedulePeriodic(5, _, false)).WillOnce(Invoke([&](uint32_t, function<void()> cb, bool) {
+    sweep = cb;
+    return 2;
+  }));
+  EXPECT_CALL(co.sys, scheduleDelayed(_, _)).Times(0);
+  co.setState(State::Operational);
+  ASSERT_TRUE(sweep);
+
+  auto tick = [&](int n) {
+    while (n--) sweep();
+  };
+
+  // Never early, and at most a tick late
+  tick(10);
+  EXPECT_EQ(timeoutsB, 0u);
+  tick(1);
+  EXPECT_EQ(timeoutsB, 1u);
+  tick(10);
+  EXPECT_EQ(timeoutsA, 1u);
+  EXPECT_EQ(timeoutsB, 1u);  // Only once per silence
+
+  // Frames push deadlines out without touching timers
+  co.receive(0x201, {1});
+  tick(9);
+  co.receive(0x201, {2});
+  tick(10);
+  EXPECT_EQ(timeoutsB, 1u);
+  tick(1);
+  EXPECT_EQ(timeoutsB, 2u);
+  EXPECT_EQ(timeoutsA, 1u);
+  tick(10);
+  EXPECT_EQ(timeoutsA, 2u);
+
+  // Supervision stops with PDO events
+  EXPECT_CALL(co.sys, deleteTimer(_)).Times(::testing::AtLeast(1));
+  co.setState(State::PreOperational);
+}
+
+TEST(Pdo, TxBurst)
+{
+  MockLocalNode co;
+  co.init();
+
+  uint8_t a = 1, b = 2;
+  EXPECT_EQ(co.od.insert(0x2000, 0, Access::RO, a), Error::Success);
+  EXPECT_EQ(co.od.insert(0x2001, 0, Access::RO, b), Error::Success);
+  EXPECT_EQ(co.addTPDO(1, 0x181, {{0x2000, 0}}), Error::Success);
+  EXPECT_EQ(co.addTPDO(2, 0x281, {{0x2001, 0}}), Error::Success);
+
+  // All TPDOs are queued, then flushed together
+  ::testing::InSequence seq;
+  EXPECT_CALL(co.dev, write(::testing::Field(&Msg::id, 0x181), true)).WillOnce(::testing::Return(Error::Success));
+  EXPECT_CALL(co.dev, write(::testing::Field(&Msg::id, 0x281), true)).WillOnce(::testing::Return(Error::Success));
+  EXPECT_CALL(co.dev, flush()).Times(1);
+  EXPECT_EQ(co.triggerAllTPDOs(), Error::Success);
+}
+
+TEST(Pdo, RxFilters)
+{
+  using F = CanDevice::RxFilter;
+  MockLocalNode co;
+  vector<F> filters;
+  ON_CALL(co.dev, setRxFilters(_)).WillByDefault([&](const vector<F> &f) { filters = f; });
+  auto has = [&](F f) { return find(filters.begin(), filters.end(), f) != filters.end(); };
+
+  co.init();
+  EXPECT_TRUE(has(F::exact(0x000)));  // NMT
+  EXPECT_TRUE(has(F::exact(0x080)));  // SYNC
+  EXPECT_TRUE(has(F::exact(0x601)));  // Default SDO server
+  EXPECT_FALSE(has(F{0x080, 0x780}));
+  EXPECT_FALSE(has(F{0x700, 0x780}));
+
+  uint32_t v = 0;
+  EXPECT_EQ(co.od.insert(0x2000, 0, Access::RW, v), Error::Success);
+  EXPECT_EQ(co.addRPDO(0x201, {{0x2000, 0}}), Error::Success);
+  EXPECT_EQ(co.addRPDO(0x203, {{0x2000, 0}}), Error::Success);
+  EXPECT_EQ(co.od.set(0x1401, 1, _u32(0x10000201)), Error::Success);
+  EXPECT_EQ(co.addTPDO(1, 0x181, {{0x2000, 0}}), Error::Success);
+  EXPECT_EQ(co.addSDOClient(5, 5), Error::Success);
+  EXPECT_EQ(co.setRemoteTimeout(7, 100), Error::Success);
+  EXPECT_TRUE(has(F::exact(0x201)));
+  EXPECT_TRUE(has(F{0x10000201, 0x1FFFFFFF}));
+  EXPECT_TRUE(has(F::exact(0x181)));  // RTR
+  EXPECT_TRUE(has(F::exact(0x585)));
+  EXPECT_TRUE(has(F::exact(0x707)));
+  EXPECT_FALSE(has(F::exact(0x705)));
+
+  // Reapplied as COB-IDs change
+  EXPECT_EQ(co.od.set(0x1400, 1, _u32(0x202)), Error::Success);
+  EXPECT_FALSE(has(F::exact(0x201)));
+  EXPECT_TRUE(has(F::exact(0x202)));
+  EXPECT_EQ(co.disableTPDO(1), Error::Success);
+  EXPECT_FALSE(has(F::exact(0x181)));
+
+  EXPECT_EQ(co.registerEmcyCallback([](uint8_t, uint16_t, array<uint8_t, 5> &) {}), Error::Success);
+  EXPECT_EQ(co.registerRemoteStateCb([](uint8_t, State) {}), Error::Success);
+  EXPECT_TRUE(has(F{0x080, 0x780}));
+  EXPECT_TRUE(has(F{0x700, 0x780}));
+  EXPECT_FALSE(has(F::exact(0x707)));
+
+  EXPECT_TRUE(is_sorted(filters.begin(), filters.end()));
+  EXPECT_EQ(adjacent_find(filters.begin(), filters.end()), filters.end());
+}
+
+TEST(Pdo, CyclicOffload)
+{
+  MockLocalNode co;
+  co.init();
+
+  vector<tuple<uint32_t, uint32_t, vector<uint8_t>>> cyclic;
+  ON_CALL(co.dev, writeCyclic(_, _)).WillByDefault([&](const Msg &m, uint32_t periodMs) {
+    cyclic.emplace_back(m.id, periodMs, vector<uint8_t>(m.data, m.data + m.len));
+    return Error::Success;
+  });
+
+  uint16_t a = 0x1122;
+  EXPECT_EQ(co.od.insert(0x2000, 0, Access::RW, a), Error::Success);
+  EXPECT_EQ(co.addTPDO(1, 0x181, {{0x2000, 0}}, 10), Error::Success);
+
+  // Handed to the device instead of a timer of ours
+  EXPECT_CALL(co.sys, schedulePeriodic(_, _, _)).Times(0);
+  co.setState(State::Operational);
+  ASSERT_EQ(cyclic.size(), 1u);
+  EXPECT_EQ(cyclic[0], make_tuple(0x181u, 10u, vector<uint8_t>{0x22, 0x11}));
+
+  // Content updated in place when a mapped entry changes
+  EXPECT_EQ(co.od.set(0x2000, 0, _u16(0x3344)), Error::Success);
+  ASSERT_EQ(cyclic.size(), 2u);
+  EXPECT_EQ(cyclic[1], make_tuple(0x181u, 0u, vector<uint8_t>{0x44, 0x33}));
+
+  // New period restarts the device's cycle
+  EXPECT_EQ(co.updateTpdoEventTime(1, 20), Error::Success);
+  ASSERT_EQ(cyclic.size(), 3u);
+  EXPECT_EQ(get<1>(cyclic[2]), 20u);
+  ::testing::Mock::VerifyAndClearExpectations(&co.sys);
+
+  // Change-of-state TPDOs restart their event timer on every send, so they come back to us
+  EXPECT_CALL(co.dev, stopCyclic(0x181u));
+  EXPECT_CALL(co.sys, schedulePeriodic(20, _, _));
+  EXPECT_EQ(co.setTpdoChangeOfState(1, true), Error::Success);
+  ::testing::Mock::VerifyAndClearExpectations(&co.dev);
+
+  EXPECT_EQ(co.setTpdoChangeOfState(1, false), Error::Success);
+  ASSERT_EQ(cyclic.size(), 4u);
+  EXPECT_CALL(co.dev, stopCyclic(0x181u));
+  co.setState(State::PreOperational);
+}
+
+TEST(Pdo, CyclicOffloadBuffer)
+{
+  MockLocalNode co;
+  co.init();
+
+  // The app writes b directly, so the device's copy would go stale
+  uint16_t b = 0x1122;
+  EXPECT_EQ(co.od.insert(0x2000, 0, Access::RW, _p(b)), Error::Success);
+  EXPECT_EQ(co.addTPDO(1, 0x181, {{0x2000, 0}}, 10), Error::Success);
+
+  EXPECT_CALL(co.dev, writeCyclic(_, _)).Times(0);
+  EXPECT_CALL(co.sys, schedulePeriodic(10, _, _));
+  co.setState(State::Operational);
+}
+
+TEST(Pdo, RxChangeFilter)
+{
+  MockLocalNode co;
+  vector<CanDevice::RxFilter> filters;
+  ON_CALL(co.dev, setRxFilters(_)).WillByDefault([&](const vector<CanDevice::RxFilter> &f) { filters = f; });
+  ON_CALL(co.dev, setRxChangeFilter(_, _, _)).WillByDefault(::testing::Return(Error::Success));
+  co.init();
+
+  uint32_t a = 0;
+  int timeouts = 0;
+  EXPECT_EQ(co.od.insert(0x2000, 0, Access::RW, a), Error::Success);
+  EXPECT_EQ(co.addRPDO(0x201, {{0x2000, 0}}, 100, [&](uint16_t cobid) {
+    EXPECT_EQ(cobid, 0x201);
+    timeouts++;
+  }), Error::Success);
+
+  // Handed to the device on entering Operational, which then supervises the
+  // timeout instead of our sweep
+  EXPECT_CALL(co.dev, setRxChangeFilter(0x201u, 4, 100u));
+  EXPECT_CALL(co.sys, schedulePeriodic(_, _, _)).Times(0);
+  co.setState(State::Operational);
+  ::testing::Mock::VerifyAndClearExpectations(&co.sys);
+  EXPECT_EQ(find(filters.begin(), filters.end(), CanDevice::RxFilter::exact(0x201)), filters.end());
+
+  co.receive(0x201, {1, 0, 0, 0});
+  EXPECT_EQ(co.od.get(0x2000, 0, a), Error::Success);
+  EXPECT_EQ(a, 1u);
+
+  // Reported once until frames resume
+  co.processRxTimeout(0x201);
+  co.processRxTimeout(0x201);
+  EXPECT_EQ(timeouts, 1);
+  co.receive(0x201, {1, 0, 0, 0});
+  co.processRxTimeout(0x201);
+  EXPECT_EQ(timeouts, 2);
+
+  // A new timeout replaces the device's filter
+  EXPECT_CALL(co.dev, clearRxChangeFilter(0x201u));
+  EXPECT_CALL(co.dev, setRxChangeFilter(0x201u, 4, 50u));
+  EXPECT_EQ(co.od.set(0x1400, 5, _u16(50)), Error::Success);
+  ::testing::Mock::VerifyAndClearExpectations(&co.dev);
+
+  // So does remapping, even with the COB-ID left alone
+  uint8_t b = 0;
+  EXPECT_EQ(co.od.insert(0x2001, 0, Access::RW, b), Error::Success);
+  EXPECT_CALL(co.dev, clearRxChangeFilter(0x201u));
+  EXPECT_CALL(co.dev, setRxChangeFilter(0x201u, 1, 50u));
+  EXPECT_EQ(co.od.set(0x1600, 1, _u32(0x20010008)), Error::Success);
+  ::testing::Mock::VerifyAndClearExpectations(&co.dev);
+
+  EXPECT_CALL(co.dev, clearRxChangeFilter(0x201u));
+  co.setState(State::PreOperational);
+  EXPECT_NE(find(filters.begin(), filters.end(), CanDevice::RxFilter::exact(0x201)), filters.end());
+}
+
+TEST(Pdo, RxTimeoutMidTick)
+{
+  MockLocalNode co;
+  co.init();
+
+  uint8_t a         = 0;
+  unsigned timeouts = 0;
+  function<void()> sweep;
+  EXPECT_EQ(co.od.insert(0x2000, 0, Access::RW, a), Error::Success);
+  EXPECT_EQ(co.addRPDO(0x201, {{0x2000, 0}}, 1, [&](uint16_t) { timeouts++; }), Error::Success);
+
+  // A 1 ms timeout sweeps every 1 ms, so the timeout is a single tick
+  EXPECT_CALL(co.sys, schedulePeriodic(1, _, false)).WillOnce(Invoke([&](uint32_t, function<void()> cb, bool) {
+    sweep = cb;
+    return 1;
+  }));
+  co.setState(State::Operational);
+  ASSERT_TRUE(sweep);
+
+  // A frame landing just before a tick hasn't been silent for 1 ms at it
+  sweep();
+  co.receive(0x201, {1});
+  sweep();
+  EXPECT_EQ(timeouts, 0u);
+  sweep();
+  EXPECT_EQ(timeouts, 1u);
+
+  EXPECT_CALL(co.sys, deleteTimer(_)).Times(::testing::AtLeast(1));
+  co.setState(State::PreOperational);
+}
@@ -0,0 +1,858 @@
+#include <cstring>
+#include <deque>
+#include <map>
+#include <numeric>
+#include <random>
+#include <string>
+#include <vector>
+#include "canfetti/Crc16.h"
+#include "test.h"
+
+using namespace canfetti;
+using namespace std;
+
+namespace {
+  // Timers run off a simulated clock advanced by the test
+  class FakeSystem : public canfetti::System {
+   public:
+    TimerHdl resetTimer(TimerHdl &hdl) override { return hdl; }
+    TimerHdl resetTimer(TimerHdl &hdl, uint32_t delayMs) override { return hdl; }
+    void deleteTimer(TimerHdl &hdl) override
+    {
+      timers.erase(hdl);
+      hdl = InvalidTimer;
+    }
+    void disableTimer(TimerHdl &hdl) override { timers.erase(hdl); }
+    TimerHdl scheduleDelayed(uint32_t delayMs, std::function<void()> cb) override
+    {
+      timers[nextHdl] = {nowMs + delayMs, std::move(cb)};
+      return nextHdl++;
+    }
+    TimerHdl schedulePeriodic(uint32_t, std::function<void()>, bool) override { return nextHdl++; }
+
+    void advance(uint32_t ms)
+    {
+      nowMs += ms;
+      for (auto i = timers.begin(); i != timers.end();) {
+        if (i->second.first <= nowMs) {
+          auto cb = std::move(i->second.second);
+          timers.erase(i);
+          cb();
+          i = timers.begin();
+        }
+        else {
+          ++i;
+        }
+      }
+    }
+
+    uint64_t nowMs = 0;
+
+   private:
+    TimerHdl nextHdl = 1;
+    std::map<TimerHdl, std::pair<uint64_t, std::function<void()>>> timers;
+  };
+
+  struct Frame {
+    uint32_t id;
+    uint8_t len;
+    uint8_t data[8];
+    const void *sender;
+  };
+
+  // Frames are queued and delivered by pump(), never from inside write(), so a
+  // node isn't re-entered while it is still processing the frame that
+  // triggered the reply
+  class Bus {
+   public:
+    // About one 8 byte frame at 1 Mbit/s
+    static constexpr uint64_t FrameNs = 111000;
+
+    std::deque<Frame> frames;
+    size_t framesSent = 0;
+    uint64_t nowNs    = 1;  // Frames are timestamped as they come off the bus
+    // Sees every frame written and may alter it; returning false drops it
+    std::function<bool(Frame &)> tamper;
+  };
+
+  class LoopbackDev : public CanDevice {
+   public:
+    LoopbackDev(Bus &bus) : bus(bus) {}
+
+    Error write(const Msg &msg, bool) override
+    {
+      Frame f = {.id = msg.id, .len = msg.len, .data = {}, .sender = this};
+      memcpy(f.data, msg.data, msg.len);
+      bus.framesSent++;
+      if (bus.tamper && !bus.tamper(f)) return Error::Success;
+      bus.frames.push_back(f);
+      return Error::Success;
+    }
+
+   private:
+    Bus &bus;
+  };
+
+  class TestNode : public LocalNode {
+   public:
+    TestNode(Bus &bus, uint8_t nodeId) : LocalNode(dev, sys, nodeId, "Test Device", 0), dev(bus)
+    {
+      init();
+    }
+
+    void deliver(const Frame &f, uint64_t timestamp)
+    {
+      if (f.sender == &dev) return;
+      uint8_t data[8];
+      memcpy(data, f.data, f.len);
+      Msg m = {.id = f.id, .rtr = false, .len = f.len, .data = data, .timestamp = timestamp};
+      processFrame(m);
+    }
+
+    FakeSystem sys;
+    LoopbackDev dev;
+  };
+
+  constexpr uint8_t SERVER_NODE_ID = 5;
+  constexpr uint8_t CLIENT_NODE_ID = 8;
+  constexpr uint16_t TEST_IDX      = 0x2022;
+
+  struct SdoPair {
+    Bus bus;
+    TestNode server{bus, SERVER_NODE_ID};
+    TestNode client{bus, CLIENT_NODE_ID};
+
+    SdoPair()
+    {
+      client.addSDOClient(SERVER_NODE_ID, SERVER_NODE_ID);
+    }
+
+    // Deliver frames until the bus goes quiet
+    void pump()
+    {
+      while (!bus.frames.empty()) {
+        Frame f = bus.frames.front();
+        bus.frames.pop_front();
+        bus.nowNs += Bus::FrameNs;
+        server.deliver(f, bus.nowNs);
+        client.deliver(f, bus.nowNs);
+      }
+    }
+
+    // Pump, letting segment timeouts expire whenever the bus stalls
+    void run(const bool &done)
+    {
+      for (int stalls = 0; !done && stalls < 20; ++stalls) {
+        pump();
+        if (done) break;
+        bus.nowNs += SdoService::DefaultSegmentXferTimeoutMs * 1000000ull;
+        server.sys.advance(SdoService::DefaultSegmentXferTimeoutMs);
+        client.sys.advance(SdoService::DefaultSegmentXferTimeoutMs);
+      }
+      pump();
+    }
+  };
+
+  // Drops a random fraction of the data segments, other than the last, sent on
+  // segmentId, and of the block acks sent on ackId. Segments are the only
+  // frames with the top bit clear in both directions.
+  std::function<bool(Frame &)> loseFrames(uint32_t segmentId, uint32_t ackId, double lossRate, size_t &lost)
+  {
+    auto rng = std::make_shared<std::mt19937>(1234);
+    return [=, &lost](Frame &f) {
+      bool segment = f.id == segmentId && !(f.data[0] & 0x80);
+      bool ack     = f.id == ackId && f.data[0] == ((5 << 5) | 2);
+      if (!segment && !ack) return true;
+      if (std::bernoulli_distribution(lossRate)(*rng)) {
+        lost++;
+        return false;
+      }
+      return true;
+    };
+  }
+}  // namespace
+
+TEST(Sdo, BlockUpload)
+{
+  SdoPair p;
+
+  vector<uint8_t> src(2000);
+  iota(src.begin(), src.end(), 0);
+  p.server.od.insert(TEST_IDX, 0, Access::RO, src);
+
+  bool done = false;
+  Error err = Error::Error;
+  vector<uint8_t> dst;
+
+  EXPECT_EQ(p.client.read<vector<uint8_t>>(SERVER_NODE_ID, TEST_IDX, 0, [&](Error e, vector<uint8_t> &v) {
+    done = true;
+    err  = e;
+    dst  = v;
+  }),
+            Error::Success);
+
+  p.pump();
+
+  ASSERT_TRUE(done);
+  EXPECT_EQ(err, Error::Success);
+  EXPECT_EQ(dst, src);
+  EXPECT_EQ(p.client.getActiveTransactionCount(), 0);
+  EXPECT_EQ(p.server.getActiveTransactionCount(), 0);
+
+  // 2000 bytes is 286 segments: initiate, start, 3 sub-blocks with acks and
+  // the end handshake, rather than a request per segment
+  EXPECT_LT(p.bus.framesSent, 300);
+}
+
+// The last segment's first byte is 0x80 | seqNo, which for seqNo up to 31 has
+// the abort command specifier
+TEST(Sdo, BlockUploadLastSegmentNotAbort)
+{
+  for (size_t len : {1, 7, 100, 217, 218, 889, 1100}) {
+    SdoPair p;
+
+    vector<uint8_t> src(len);
+    iota(src.begin(), src.end(), 1);
+    p.server.od.insert(TEST_IDX, 0, Access::RO, src);
+
+    bool done = false;
+    Error err = Error::Error;
+    vector<uint8_t> dst;
+
+    EXPECT_EQ(p.client.read<vector<uint8_t>>(SERVER_NODE_ID, TEST_IDX, 0, [&](Error e, vector<uint8_t> &v) {
+      done = true;
+      err  = e;
+      dst  = v;
+    }),
+              Error::Success);
+
+    p.pump();
+
+    ASSERT_TRUE(done) << len;
+    EXPECT_EQ(err, Error::Success) << len;
+    EXPECT_EQ(dst, src) << len;
+  }
+}
+
+TEST(Sdo, BlockUploadEmpty)
+{
+  SdoPair p;
+
+  // A single empty segment, with the end message saying none of it is data
+  p.server.od.insert(TEST_IDX, 0, Access::RO, string());
+
+  bool done = false;
+  Error err = Error::Error;
+  string dst = "stale";
+
+  EXPECT_EQ(p.client.read<string>(SERVER_NODE_ID, TEST_IDX, 0, [&](Error e, string &v) {
+    done = true;
+    err  = e;
+    dst  = v;
+  }),
+            Error::Success);
+
+  p.pump();
+
+  ASSERT_TRUE(done);
+  EXPECT_EQ(err, Error::Success);
+  EXPECT_EQ(dst, "");
+}
+
+TEST(Sdo, BlockUploadSwitchesToSegmented)
+{
+  SdoPair p;
+
+  // Under the protocol switch threshold the server answers with a normal upload
+  string src = "short but not expedited";
+  p.server.od.insert(TEST_IDX, 0, Access::RO, src);
+
+  bool done = false;
+  Error err = Error::Error;
+  string dst;
+
+  EXPECT_EQ(p.client.read<string>(SERVER_NODE_ID, TEST_IDX, 0, [&](Error e, string &v) {
+    done = true;
+    err  = e;
+    dst  = v;
+  }),
+            Error::Success);
+
+  p.pump();
+
+  ASSERT_TRUE(done);
+  EXPECT_EQ(err, Error::Success);
+  EXPECT_EQ(dst, src);
+}
+
+TEST(Sdo, BlockUploadTooBig)
+{
+  SdoPair p;
+
+  vector<uint8_t> src(500, 0xAB);
+  p.server.od.insert(TEST_IDX, 0, Access::RO, src);
+
+  uint8_t small[200] = {0};
+  bool done          = false;
+  Error err          = Error::Success;
+
+  EXPECT_EQ(p.client.readData(SERVER_NODE_ID, TEST_IDX, 0, OdBuffer{small, sizeof small}, [&](Error e) {
+    done = true;
+    err  = e;
+  }),
+            Error::Success);
+
+  p.pump();
+
+  ASSERT_TRUE(done);
+  EXPECT_EQ(err, Error::ParamLengthLow);
+  EXPECT_EQ(p.server.getActiveTransactionCount(), 0);
+}
+
+TEST(Sdo, BlockUploadCrcMismatch)
+{
+  SdoPair p;
+
+  vector<uint8_t> src(1000, 0x55);
+  p.server.od.insert(TEST_IDX, 0, Access::RO, src);
+
+  // Flip a bit in the 20th segment, keeping its sequence number intact
+  size_t serverFrames = 0;
+  p.bus.tamper        = [&](Frame &f) {
+    if (f.id == 0x580 + SERVER_NODE_ID && ++serverFrames == 21) f.data[4] ^= 0x10;
+    return true;
+  };
+
+  bool done = false;
+  Error err = Error::Success;
+
+  EXPECT_EQ(p.client.read<vector<uint8_t>>(SERVER_NODE_ID, TEST_IDX, 0, [&](Error e, vector<uint8_t> &) {
+    done = true;
+    err  = e;
+  }),
+            Error::Success);
+
+  p.pump();
+
+  ASSERT_TRUE(done);
+  EXPECT_EQ(err, Error::CrcError);
+  EXPECT_EQ(p.server.getActiveTransactionCount(), 0);
+}
+
+TEST(Sdo, BlockDownload)
+{
+  SdoPair p;
+
+  vector<uint8_t> dst;
+  p.server.od.insert(TEST_IDX, 0, Access::RW, dst);
+
+  vector<uint8_t> src(1500);
+  iota(src.begin(), src.end(), 7);
+
+  bool done = false;
+  Error err = Error::Error;
+
+  EXPECT_EQ(p.client.write(SERVER_NODE_ID, TEST_IDX, 0, src, [&](Error e) {
+    done = true;
+    err  = e;
+  }),
+            Error::Success);
+
+  p.pump();
+
+  ASSERT_TRUE(done);
+  EXPECT_EQ(err, Error::Success);
+  vector<uint8_t> written;
+  EXPECT_EQ(p.server.od.get(TEST_IDX, 0, written), Error::Success);
+  EXPECT_EQ(written, src);
+}
+
+TEST(Sdo, BlockDownloadResize)
+{
+  SdoPair p;
+
+  // Resizable targets take the indicated size, shrinking included
+  vector<uint8_t> dst(3000, 0xAA);
+  p.server.od.insert(TEST_IDX, 0, Access::RW, dst);
+
+  // Fixed size ones abort up front if the data won't fit
+  uint8_t small[10] = {};
+  p.server.od.insert(TEST_IDX, 1, Access::RW, _p(small));
+
+  vector<uint8_t> src(1500);
+  iota(src.begin(), src.end(), 7);
+
+  Error err0 = Error::Error, err1 = Error::Success;
+  EXPECT_EQ(p.client.write(SERVER_NODE_ID, TEST_IDX, 0, src, [&](Error e) { err0 = e; }), Error::Success);
+  EXPECT_EQ(p.client.write(SERVER_NODE_ID, TEST_IDX, 1, src, [&](Error e) { err1 = e; }), Error::Success);
+  p.pump();
+
+  EXPECT_EQ(err0, Error::Success);
+  vector<uint8_t> written;
+  EXPECT_EQ(p.server.od.get(TEST_IDX, 0, written), Error::Success);
+  EXPECT_EQ(written, src);
+
+  EXPECT_EQ(err1, Error::ParamLength);
+  EXPECT_EQ(p.server.getActiveTransactionCount(), 0);
+}
+
+TEST(Sdo, BlockDownloadUnknownObject)
+{
+  SdoPair p;
+
+  // Answered with an abort straight away, rather than left to time out
+  bool done = false;
+  Error err = Error::Success;
+  EXPECT_EQ(p.client.write(SERVER_NODE_ID, TEST_IDX, 0, vector<uint8_t>(500), [&](Error e) {
+    done = true;
+    err  = e;
+  }),
+            Error::Success);
+  p.pump();
+
+  ASSERT_TRUE(done);
+  EXPECT_EQ(err, Error::IndexNotFound);
+  EXPECT_EQ(p.server.getActiveTransactionCount(), 0);
+}
+
+TEST(Sdo, BlockDownloadEndRequest)
+{
+  SdoPair p;
+
+  vector<uint8_t> dst;
+  p.server.od.insert(TEST_IDX, 0, Access::RW, dst);
+
+  // The client's last frame ends the download: ccs 6, cs 1
+  Frame last   = {};
+  p.bus.tamper = [&](Frame &f) {
+    if (f.id == 0x600 + SERVER_NODE_ID) last = f;
+    return true;
+  };
+
+  Error err = Error::Error;
+  EXPECT_EQ(p.client.write(SERVER_NODE_ID, TEST_IDX, 0, vector<uint8_t>(200, 1), [&](Error e) { err = e; }), Error::Success);
+  p.pump();
+
+  EXPECT_EQ(err, Error::Success);
+  EXPECT_EQ(last.data[0] & 0xE3, 0xC1);
+  EXPECT_EQ((last.data[0] >> 2) & 7, 7 - 200 % 7);  // Bytes of the last segment that aren't data
+}
+
+TEST(Sdo, BlockDownloadCrcMismatch)
+{
+  SdoPair p;
+
+  vector<uint8_t> dst;
+  p.server.od.insert(TEST_IDX, 0, Access::RW, dst);
+
+  size_t clientFrames = 0;
+  p.bus.tamper        = [&](Frame &f) {
+    if (f.id == 0x600 + SERVER_NODE_ID && ++clientFrames == 50) f.data[7] ^= 0x01;
+    return true;
+  };
+
+  vector<uint8_t> src(1500, 0x33);
+  bool done = false;
+  Error err = Error::Success;
+
+  EXPECT_EQ(p.client.write(SERVER_NODE_ID, TEST_IDX, 0, src, [&](Error e) {
+    done = true;
+    err  = e;
+  }),
+            Error::Success);
+
+  p.pump();
+
+  ASSERT_TRUE(done);
+  EXPECT_EQ(err, Error::CrcError);
+  EXPECT_EQ(p.server.getActiveTransactionCount(), 0);
+}
+
+TEST(Crc16, Ccitt)
+{
+  const char *check = "123456789";
+  EXPECT_EQ(Crc16::compute(reinterpret_cast<const uint8_t *>(check), 9), 0x31C3);
+  EXPECT_EQ(Crc16::compute(nullptr, 0), 0);
+
+  // Any split into pieces gives the same result as a bit at a time
+  std::mt19937 rng(1);
+  vector<uint8_t> data(1000);
+  for (auto &b : data) b = rng();
+
+  uint16_t ref = 0;
+  for (uint8_t b : data) {
+    ref ^= b << 8;
+    for (int bit = 0; bit < 8; ++bit) {
+      ref = (ref & 0x8000) ? (ref << 1) ^ 0x1021 : ref << 1;
+    }
+  }
+
+  for (size_t piece : {1, 2, 3, 7, 8, 9, 64}) {
+    Crc16 crc;
+    for (size_t off = 0; off < data.size(); off += piece) {
+      crc.update(&data[off], std::min(piece, data.size() - off));
+    }
+    EXPECT_EQ(crc.value(), ref) << "piece " << piece;
+  }
+}
+
+TEST(Sdo, BlockUploadTailLoss)
+{
+  SdoPair p;
+
+  // 1000 bytes is 143 segments, the 16th of the 2nd sub-block carrying c
+  vector<uint8_t> src(1000);
+  iota(src.begin(), src.end(), 3);
+  p.server.od.insert(TEST_IDX, 0, Access::RO, src);
+
+  bool dropped = false;
+  p.bus.tamper = [&](Frame &f) {
+    if (f.id != 0x580 + SERVER_NODE_ID || f.data[0] != (0x80 | 16) || dropped) return true;
+    dropped = true;
+    return false;
+  };
+
+  bool done = false;
+  Error err = Error::Error;
+  vector<uint8_t> dst;
+
+  EXPECT_EQ(p.client.read<vector<uint8_t>>(SERVER_NODE_ID, TEST_IDX, 0, [&](Error e, vector<uint8_t> &v) {
+    done = true;
+    err  = e;
+    dst  = v;
+  }),
+            Error::Success);
+
+  // Nothing marks the end of the sub-block, so once the server times out it
+  // sends that segment again and the client acks it
+  p.run(done);
+
+  ASSERT_TRUE(dropped);
+  ASSERT_TRUE(done);
+  EXPECT_EQ(err, Error::Success);
+  EXPECT_EQ(dst, src);
+  EXPECT_EQ(p.server.getActiveTransactionCount(), 0);
+}
+
+// Each ack lost, including the last, costs the sender a timeout, after which
+// it sends the sub-block's last segment again and the receiver repeats the ack
+static void lostAcks(bool upload)
+{
+  SdoPair p;
+
+  vector<uint8_t> src(2000);
+  iota(src.begin(), src.end(), 7);
+  vector<uint8_t> remote = upload ? src : vector<uint8_t>();
+  p.server.od.insert(TEST_IDX, 0, upload ? Access::RO : Access::RW, remote);
+
+  uint32_t segmentId = upload ? 0x580 + SERVER_NODE_ID : 0x600 + SERVER_NODE_ID;
+  uint32_t ackId     = upload ? 0x600 + SERVER_NODE_ID : 0x580 + SERVER_NODE_ID;
+  int acks           = 0;
+  int dropped        = 0;
+  bool finalSent     = false;
+  bool finalAckLost  = false;
+  p.bus.tamper       = [&](Frame &f) {
+    if (f.id == segmentId) finalSent = f.data[0] & 0x80;
+    if (f.id != ackId || f.data[0] != ((5 << 5) | 2)) return true;
+
+    // The first ack and its repeat, and the ack for the final segment
+    bool drop = ++acks <= 2 || (finalSent && !finalAckLost);
+    finalAckLost |= finalSent;
+    dropped += drop;
+    return !drop;
+  };
+
+  bool done = false;
+  Error err = Error::Error;
+  vector<uint8_t> dst;
+
+  if (upload) {
+    EXPECT_EQ(p.client.read<vector<uint8_t>>(SERVER_NODE_ID, TEST_IDX, 0, [&](Error e, vector<uint8_t> &v) {
+      done = true;
+      err  = e;
+      dst  = v;
+    }),
+              Error::Success);
+  }
+  else {
+    EXPECT_EQ(p.client.write(SERVER_NODE_ID, TEST_IDX, 0, src, [&](Error e) {
+      done = true;
+      err  = e;
+    }),
+              Error::Success);
+  }
+
+  p.run(done);
+
+  EXPECT_EQ(dropped, 3);
+  EXPECT_TRUE(finalAckLost);
+  ASSERT_TRUE(done);
+  EXPECT_EQ(err, Error::Success);
+  if (!upload) p.server.od.get(TEST_IDX, 0, dst);
+  EXPECT_EQ(dst, src);
+  EXPECT_EQ(p.server.getActiveTransactionCount(), 0);
+
+  auto &tx = (upload ? p.server : p.client).getSdoStats().recent.back();
+  EXPECT_EQ(tx.result, Error::Success);
+  EXPECT_EQ(tx.block.resentSegments, 3);
+}
+
+TEST(Sdo, BlockUploadLostAck)
+{
+  lostAcks(true);
+}
+
+TEST(Sdo, BlockDownloadLostAck)
+{
+  lostAcks(false);
+}
+
+// Under 1% segment and ack loss, a 20 kB transfer that aborted on the first lost
+// frame would almost never get through: all 2858 segments arrive in one go with
+// probability 0.99^2858, about 3e-13. With each lost segment only costing the
+// rest of its sub-block, each lost ack a timeout and one segment, and
+// sub-blocks shrinking as losses show up, it completes in not much more than
+// the lossless number of frames.
+static void lossyTransfer(bool upload, double lossRate)
+{
+  constexpr double MinEfficiency = 0.8;
+
+  constexpr size_t Len = 20000;
+
+  vector<uint8_t> src(Len);
+  std::mt19937 rng(42);
+  for (auto &b : src) b = rng();
+
+  size_t losslessFrames = 0;
+
+  for (double loss : {0.0, lossRate}) {
+    SdoPair p;
+    vector<uint8_t> remote = upload ? src : vector<uint8_t>();
+    p.server.od.insert(TEST_IDX, 0, upload ? Access::RO : Access::RW, remote);
+
+    size_t lost  = 0;
+    p.bus.tamper = loseFrames(upload ? 0x580 + SERVER_NODE_ID : 0x600 + SERVER_NODE_ID,
+                              upload ? 0x600 + SERVER_NODE_ID : 0x580 + SERVER_NODE_ID, loss, lost);
+
+    bool done = false;
+    Error err = Error::Error;
+    vector<uint8_t> dst;
+
+    if (upload) {
+      EXPECT_EQ(p.client.read<vector<uint8_t>>(SERVER_NODE_ID, TEST_IDX, 0, [&](Error e, vector<uint8_t> &v) {
+        done = true;
+        err  = e;
+        dst  = v;
+      }),
+                Error::Success);
+    }
+    else {
+      EXPECT_EQ(p.client.write(SERVER_NODE_ID, TEST_IDX, 0, src, [&](Error e) {
+        done = true;
+        err  = e;
+      }),
+                Error::Success);
+    }
+
+    p.run(done);
+
+    ASSERT_TRUE(done);
+    ASSERT_EQ(err, Error::Success);
+    if (!upload) p.server.od.get(TEST_IDX, 0, dst);
+    EXPECT_EQ(dst, src);
+
+    auto &rx = (upload ? p.client : p.server).getSdoStats().recent.back();
+    auto &tx = (upload ? p.server : p.client).getSdoStats().recent.back();
+
+    EXPECT_EQ(rx.bytes, Len);
+    EXPECT_GT(rx.bytesPerSecond(), 0);
+
+    if (loss == 0) {
+      losslessFrames = p.bus.framesSent;
+      EXPECT_EQ(rx.block.minBlockSize, 127);
+      EXPECT_EQ(tx.block.resentSegments, 0);
+    }
+    else {
+      EXPECT_GT(lost, 10);
+      double efficiency = (double)losslessFrames / p.bus.framesSent;
+      ::testing::Test::RecordProperty("lost_frames", lost);
+      ::testing::Test::RecordProperty("frames_lossless", losslessFrames);
+      ::testing::Test::RecordProperty("frames_lossy", p.bus.framesSent);
+      ::testing::Test::RecordProperty("bytes_per_second", static_cast<int>(rx.bytesPerSecond()));
+      EXPECT_GT(efficiency, MinEfficiency) << lost << " frames lost, " << p.bus.framesSent << " frames vs " << losslessFrames;
+
+      // The receiver backed off from the largest block size, and the sender
+      // followed
+      EXPECT_LT(rx.block.minBlockSize, 127);
+      EXPECT_EQ(tx.block.minBlockSize, rx.block.minBlockSize);
+      EXPECT_GE(tx.block.resentSegments, lost);
+    }
+  }
+}
+
+TEST(Sdo, BlockUploadLoss)
+{
+  lossyTransfer(true, 0.01);
+}
+
+TEST(Sdo, BlockDownloadLoss)
+{
+  lossyTransfer(false, 0.01);
+}
+
+TEST(Sdo, BlockSizeControl)
+{
+  Sdo::BlockSizeControl ctl;
+  uint64_t t = 1000;
+
+  auto subBlock = [&](uint8_t n, bool lost) {
+    t += 2 * Bus::FrameNs;  // Round trip of 2 segment times
+    for (uint8_t i = 0; i < n; ++i, t += Bus::FrameNs) ctl.segment(t);
+    return ctl.subBlockDone(n, lost);
+  };
+
+  EXPECT_EQ(ctl.size(), 127);
+  EXPECT_EQ(subBlock(127, false), 127);
+  EXPECT_EQ(subBlock(127, false), 127);
+
+  // A loss in every 100 segments settles near sqrt(2 * 2 / 0.01) = 20
+  uint8_t n = subBlock(127, true);
+  EXPECT_LT(n, 127);
+  for (int i = 0, sinceLoss = 0; i < 200; ++i) {
+    sinceLoss += n;
+    bool lost = sinceLoss >= 100;
+    if (lost) sinceLoss -= 100;
+    n = subBlock(n, lost);
+  }
+  EXPECT_GE(n, 12);
+  EXPECT_LE(n, 30);
+
+  // And grows back once losses stop
+  for (int i = 0; i < 100; ++i) n = subBlock(n, false);
+  EXPECT_EQ(n, 127);
+}
+
+TEST(Sdo, QueuedTransactionsRunInOrder)
+{
+  SdoPair p;
+
+  uint32_t vals[3] = {11, 22, 33};
+  for (uint8_t i = 0; i < 3; ++i) p.server.od.insert(TEST_IDX, i, Access::RO, vals[i]);
+
+  vector<uint32_t> got;
+  for (uint8_t i = 0; i < 3; ++i) {
+    EXPECT_EQ(p.client.read<uint32_t>(SERVER_NODE_ID, TEST_IDX, i, [&](Error e, uint32_t &v) {
+      EXPECT_EQ(e, Error::Success);
+      got.push_back(v);
+    }),
+              Error::Success);
+  }
+
+  p.pump();
+
+  EXPECT_EQ(got, vector<uint32_t>({11, 22, 33}));
+  EXPECT_EQ(p.client.getActiveTransactionCount(), 0);
+
+  auto &stats = p.client.getSdoStats();
+  EXPECT_EQ(stats.transfers, 3);
+  EXPECT_EQ(stats.queued, 2);
+  EXPECT_EQ(stats.maxQueueDepth, 2);
+}
+
+TEST(Sdo, QueueFull)
+{
+  SdoPair p;
+  p.client.setSdoQueueDepth(1);
+  p.server.od.insert(TEST_IDX, 0, Access::RO, _u32(7));
+
+  size_t done = 0;
+  auto cb     = [&](Error e, uint32_t &v) {
+    EXPECT_EQ(e, Error::Success);
+    EXPECT_EQ(v, 7);
+    done++;
+  };
+
+  EXPECT_EQ(p.client.read<uint32_t>(SERVER_NODE_ID, TEST_IDX, 0, cb), Error::Success);
+  EXPECT_EQ(p.client.read<uint32_t>(SERVER_NODE_ID, TEST_IDX, 0, cb), Error::Success);
+  EXPECT_EQ(p.client.read<uint32_t>(SERVER_NODE_ID, TEST_IDX, 0, cb), Error::OutOfMemory);
+
+  p.pump();
+
+  EXPECT_EQ(done, 2);
+  EXPECT_EQ(p.client.getSdoStats().queueFull, 1);
+}
+
+TEST(Sdo, QueueTimeout)
+{
+  SdoPair p;
+  p.server.od.insert(TEST_IDX, 0, Access::RO, _u32(7));
+
+  // The server never answers, so the first read holds the channel until its
+  // segment timeout
+  p.bus.tamper = [](Frame &f) { return f.id != 0x580 + SERVER_NODE_ID; };
+
+  Error first = Error::Success, second = Error::Success;
+  EXPECT_EQ(p.client.read<uint32_t>(SERVER_NODE_ID, TEST_IDX, 0, [&](Error e, uint32_t &) { first = e; }), Error::Success);
+  EXPECT_EQ(p.client.read<uint32_t>(SERVER_NODE_ID, TEST_IDX, 0, [&](Error e, uint32_t &) { second = e; }, SdoService::DefaultSegmentXferTimeoutMs, 20),
+            Error::Success);
+  p.pump();
+
+  p.client.sys.advance(20);
+  EXPECT_EQ(second, Error::Timeout);
+  EXPECT_EQ(first, Error::Success);
+  EXPECT_EQ(p.client.getActiveTransactionCount(), 1);
+
+  p.client.sys.advance(SdoService::DefaultSegmentXferTimeoutMs);
+  EXPECT_EQ(first, Error::Timeout);
+  EXPECT_EQ(p.client.getActiveTransactionCount(), 0);
+  EXPECT_EQ(p.client.getSdoStats().queueTimeouts, 1);
+}
+
+TEST(Sdo, CancelTransaction)
+{
+  SdoPair p;
+
+  vector<uint8_t> src(2000);
+  p.server.od.insert(TEST_IDX, 0, Access::RO, src);
+  p.server.od.insert(TEST_IDX, 1, Access::RO, _u32(7));
+
+  // Hold the block upload at its initiate response
+  bool quiet   = true;
+  p.bus.tamper = [&](Frame &f) { return !quiet || f.id != 0x580 + SERVER_NODE_ID; };
+
+  SdoService::TransactionId a = 0, b = 0, c = 0;
+  Error errA = Error::Success, errB = Error::Error, errC = Error::Success;
+  uint32_t valB = 0;
+
+  EXPECT_EQ(p.client.read<vector<uint8_t>>(SERVER_NODE_ID, TEST_IDX, 0, [&](Error e, vector<uint8_t> &) { errA = e; }, SdoService::DefaultSegmentXferTimeoutMs, 0, &a),
+            Error::Success);
+  p.pump();
+  EXPECT_EQ(p.server.getActiveTransactionCount(), 1);
+
+  EXPECT_EQ(p.client.read<uint32_t>(SERVER_NODE_ID, TEST_IDX, 1, [&](Error e, uint32_t &v) {
+    errB = e;
+    valB = v;
+  }, SdoService::DefaultSegmentXferTimeoutMs, 0, &b),
+            Error::Success);
+  EXPECT_EQ(p.client.read<uint32_t>(SERVER_NODE_ID, TEST_IDX, 1, [&](Error e, uint32_t &) { errC = e; }, SdoService::DefaultSegmentXferTimeoutMs, 0, &c),
+            Error::Success);
+  EXPECT_NE(a, b);
+  EXPECT_NE(b, c);
+
+  // Still queued, so it just goes away
+  EXPECT_EQ(p.client.cancelSdo(c), Error::Success);
+  EXPECT_EQ(errC, Error::DataXferLocal);
+
+  // In progress: the server is sent an abort and b starts behind it
+  quiet = false;
+  EXPECT_EQ(p.client.cancelSdo(a), Error::Success);
+  EXPECT_EQ(errA, Error::DataXferLocal);
+  p.pump();
+
+  EXPECT_EQ(errB, Error::Success);
+  EXPECT_EQ(valB, 7);
+  EXPECT_EQ(p.client.cancelSdo(a), Error::Error);
+  EXPECT_EQ(p.client.getActiveTransactionCount(), 0);
+  EXPECT_EQ(p.server.getActiveTransactionCount(), 0);
+  EXPECT_EQ(p.client.getSdoStats().cancelled, 2);
+}
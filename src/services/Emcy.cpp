@@ -74,9 +74,16 @@ canfetti::Error EmcyService::registerCallback(EmcyCallback cb)
 {
   if (this->cb) return Error::Error;  // Only allow 1 for now
   this->cb = cb;
+  co.rxFiltersChanged();
   return Error::Success;
 }
 
+void EmcyService::addRxFilters(std::vector<CanDevice::RxFilter> &filters)
+{
+  // Every node's EMCY, only once someone is listening
+  if (cb) filters.push_back({0x080, 0x780});
+}
+
 canfetti::Error EmcyService::processMsg(const canfetti::Msg &msg)
 {
   if (msg.len != 8 || msg.rtr) {
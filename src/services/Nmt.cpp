@@ -12,6 +12,7 @@ canfetti::Error NmtService::addRemoteStateCb(uint8_t node, RemoteStateCb cb)
     if (!x.cb) {
       x.cb   = cb;
       x.node = node;
+      co.rxFiltersChanged();
       return Error::Success;
     }
   }
@@ -67,6 +68,7 @@ canfetti::Error NmtService::setRemoteTimeout(uint8_t node, uint16_t timeoutMs)
               peerStates[node].state      = canfetti::State::Offline;
               peerStates[node].generation = gen;
               peerStates[node].timeoutMs  = time;
+              co.rxFiltersChanged();
             }
             else {
               co.sys.deleteTimer(peerStates[node].timer);
@@ -84,6 +86,28 @@ canfetti::Error NmtService::setRemoteTimeout(uint8_t node, uint16_t timeoutMs)
   return e;
 }
 
+void NmtService::addRxFilters(std::vector<CanDevice::RxFilter> &filters)
+{
+  // NMT commands
+  filters.push_back(CanDevice::RxFilter::exact(0x000));
+
+  for (auto &&x : slaveStateCbs) {
+    if (x.cb && x.node == AllNodes) {
+      filters.push_back({0x700, 0x780});
+      return;
+    }
+  }
+
+  for (auto &&x : slaveStateCbs) {
+    if (x.cb) filters.push_back(CanDevice::RxFilter::exact(0x700 + x.node));
+  }
+
+  for (auto &&[node, state] : peerStates) {
+    (void)state;  // Silence unused variable warning
+    filters.push_back(CanDevice::RxFilter::exact(0x700 + node));
+  }
+}
+
 void NmtService::resetNode()
 {
 }
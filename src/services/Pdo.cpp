@@ -1,10 +1,10 @@
 #include "canfetti/services/Pdo.h"
+#include <algorithm>
+#include <cstring>
 #include <optional>
 
 using namespace canfetti;
 
-static constexpr size_t MAX_MAPPINGS = 8;  // 1 per payload byte in classic CAN
-
 //******************************************************************************
 // Private Helpers
 //******************************************************************************
@@ -24,6 +24,23 @@ static inline bool isRtrAllowed(uint32_t cobid)
   return !(cobid & (1 << 30));
 }
 
+static inline bool isEventDriven(uint8_t transmissionType)
+{
+  // Event-driven  means  that  the  PDO  may  be  received  at  any  time.
+  // The  CANopen  device will actualize the data immediately.
+
+  // 0xFE - event-driven (manufacturer-specific)
+  // 0xFF - event-driven (device-profile and application profile specific)
+  return transmissionType == 0xFE || transmissionType == 0xFF;
+}
+
+static inline bool isSynchronous(uint8_t transmissionType)
+{
+  // 0x00       - synchronous (acyclic)
+  // 0x01..0xF0 - synchronous (cyclic every n SYNCs)
+  return transmissionType <= 0xF0;
+}
+
 static bool isEventDriven(ObjDict &od, uint16_t paramIdx)
 {
   uint8_t transmissionType = 0;
@@ -32,12 +49,7 @@ static bool isEventDriven(ObjDict &od, uint16_t paramIdx)
     assert(0 && "OD not configured properly");
   }
 
-  // Event-driven  means  that  the  PDO  may  be  received  at  any  time.
-  // The  CANopen  device will actualize the data immediately.
-
-  // 0xFE - event-driven (manufacturer-specific)
-  // 0xFF - event-driven (device-profile and application profile specific)
-  return transmissionType == 0xFE || transmissionType == 0xFF;
+  return isEventDriven(transmissionType);
 }
 
 //******************************************************************************
@@ -60,18 +72,21 @@ Error PdoService::addPdoEntry(uint16_t paramIdx, uint32_t cobid, uint16_t eventT
   cobid |= ((!enabled) << 31) | ((!rtrAllowed) << 30);
 
   uint16_t mappingIdx = paramIdx + 0x200;
+  auto invalidate     = [this, paramIdx](uint16_t, uint8_t) { invalidatePlan(paramIdx); };
 
   // Create Params entry
   co.od.insert(paramIdx, 0, canfetti::Access::RO, _u8(5));
-  co.od.insert(paramIdx, 1, canfetti::Access::RO, cobid, changedCb);
-  co.od.insert(paramIdx, 2, canfetti::Access::RO, _u8(0xFE));             // Transmission type
-  co.od.insert(paramIdx, 3, canfetti::Access::RO, _u16(0));               // Inhibit time
-  co.od.insert(paramIdx, 4, canfetti::Access::RO, _u8(0));                // unused
-  co.od.insert(paramIdx, 5, canfetti::Access::RW, eventTime, changedCb);  // Event timer
+  co.od.insert(paramIdx, 1, canfetti::Access::RO, cobid, invalidate);
+  co.od.insert(paramIdx, 2, canfetti::Access::RO, _u8(0xFE), invalidate);  // Transmission type
+  co.od.insert(paramIdx, 3, canfetti::Access::RO, _u16(0), invalidate);    // Inhibit time
+  co.od.insert(paramIdx, 4, canfetti::Access::RO, _u8(0));                 // unused
+  co.od.insert(paramIdx, 5, canfetti::Access::RW, eventTime, changedCb);   // Event timer
+  co.od.registerCallback(paramIdx, 1, changedCb);
+  co.od.registerCallback(paramIdx, 2, changedCb);
 
   // Create Mapping entry
   size_t subIdx = 0;
-  co.od.insert(mappingIdx, subIdx++, canfetti::Access::RO, _u8(numMapping));
+  co.od.insert(mappingIdx, subIdx++, canfetti::Access::RO, _u8(numMapping), invalidate);
 
   for (size_t i = 0; i < numMapping; ++i) {
     uint16_t refIdx   = std::get<0>(mapping[i]);
@@ -80,24 +95,328 @@ Error PdoService::addPdoEntry(uint16_t paramIdx, uint32_t cobid, uint16_t eventT
     assert(co.od.entryExists(refIdx, refSubIdx) && "Variable for PDO doesnt exist");
 
     uint32_t val = (refIdx << 16) | (refSubIdx << 8) | ((co.od.entrySize(refIdx, refSubIdx) * 8) & 0xff);
-    co.od.insert(mappingIdx, subIdx++, canfetti::Access::RO, val);
+    co.od.insert(mappingIdx, subIdx++, canfetti::Access::RO, val, invalidate);
   }
 
   return Error::Success;
 }
 
+void PdoService::invalidatePlan(uint16_t paramIdx)
+{
+  if (auto p = plans.find(paramIdx); p != plans.end()) {
+    p->second.valid = false;
+
+    if (p->second.changeOfState || cyclicTpdos.count(paramIdx)) {
+      watchMappedEntries(paramIdx);
+    }
+
+    // The device's change filter compares the old length
+    if (paramIdx >= RpdoParamBase && paramIdx < RpdoParamBase + 0x200) {
+      updateRxChangeFilters();
+    }
+  }
+}
+
+// Hook every entry currently mapped by a change-of-state or device-cyclic
+// TPDO. Hooks are never removed, so mappedEntryChanged() has to cope with
+// entries no longer mapped.
+void PdoService::watchMappedEntries(uint16_t paramIdx)
+{
+  uint16_t mappingIdx = paramIdx + 0x200;
+  uint8_t numMappings = 0;
+  co.od.get(mappingIdx, 0, numMappings);
+
+  for (uint8_t i = 1; i <= numMappings; ++i) {
+    uint32_t map;
+    if (co.od.get(mappingIdx, i, map) != Error::Success) continue;
+
+    uint64_t key = (static_cast<uint64_t>(paramIdx) << 24) | (map >> 8);
+    if (cosWatches.count(key)) continue;
+
+    uint16_t idx   = (map >> 16) & 0xffff;
+    uint8_t subIdx = (map >> 8) & 0xff;
+    if (co.od.registerCallback(idx, subIdx, [this, paramIdx](uint16_t, uint8_t) { mappedEntryChanged(paramIdx); }) == Error::Success) {
+      cosWatches.insert(key);
+    }
+  }
+}
+
+std::tuple<Error, PdoService::Plan *> PdoService::getPlan(uint16_t paramIdx, bool tx)
+{
+  constexpr uint16_t mappingOffset = 0x200;
+  uint16_t mappingIdx              = paramIdx + mappingOffset;
+  Plan &plan                       = plans[paramIdx];
+  uint8_t numMappings;
+
+  if (plan.valid) {
+    return std::make_tuple(Error::Success, &plan);
+  }
+
+  if (co.od.get(paramIdx, 1, plan.cobid) != Error::Success || co.od.get(paramIdx, 2, plan.transmissionType) != Error::Success) {
+    return std::make_tuple(Error::IndexNotFound, nullptr);
+  }
+
+  if (co.od.get(mappingIdx, 0, numMappings) != Error::Success) {
+    return std::make_tuple(Error::IndexNotFound, nullptr);
+  }
+
+  if (numMappings > MaxMappings) {
+    LogInfo("Too many mappings for PDO %x", paramIdx);
+    return std::make_tuple(Error::PdoSizeViolation, nullptr);
+  }
+
+  if (co.od.get(paramIdx, 3, plan.inhibitTime) != Error::Success) {
+    return std::make_tuple(Error::IndexNotFound, nullptr);
+  }
+
+  plan.direct    = true;
+  plan.len       = 0;
+  plan.numSteps  = numMappings;
+  plan.syncCount = 0;
+  plan.latched   = false;
+
+  for (size_t i = 0; i < numMappings; ++i) {
+    Plan::Step &step = plan.steps[i];
+    uint32_t map;
+
+    if (Error e = co.od.get(mappingIdx, i + 1, map); e != Error::Success) {
+      LogInfo("Failed to look up PDO mapping at %x[%zx]: error 0x%08x", mappingIdx, i + 1, e);
+      return std::make_tuple(e, nullptr);
+    }
+
+    step.idx    = (map >> 16) & 0xffff;
+    step.subIdx = (map >> 8) & 0xff;
+    step.entry  = co.od.lookup(step.idx, step.subIdx);
+
+    if (!step.entry) {
+      LogInfo("PDO %x maps missing entry %x[%x]", paramIdx, step.idx, step.subIdx);
+      return std::make_tuple(Error::IndexNotFound, nullptr);
+    }
+
+    step.sentGeneration = step.entry->generation() - 1;  // Counts as changed until first sent
+
+    if (tx ? step.entry->access == Access::WO : step.entry->access == Access::RO) {
+      LogInfo("PDO %x maps %x[%x] without %s access", paramIdx, step.idx, step.subIdx, tx ? "read" : "write");
+      return std::make_tuple(tx ? Error::ReadViolation : Error::WriteViolation, nullptr);
+    }
+
+    step.data = step.entry->buffer();
+
+    if (step.data) {
+      size_t len = step.entry->size();
+      if (plan.len + len > maxPdoLen()) {
+        LogInfo("PDO %x mappings exceed %zu bytes", paramIdx, maxPdoLen());
+        return std::make_tuple(Error::PdoSizeViolation, nullptr);
+      }
+      step.offset = plan.len;
+      step.len    = len;
+      plan.len += len;
+    }
+    else {
+      plan.direct = false;
+    }
+  }
+
+  plan.valid = true;
+  return std::make_tuple(Error::Success, &plan);
+}
+
+// Payloads past classic CAN's 8 bytes go out as CAN FD, padded to the next
+// length an FD frame can have
+static uint8_t padFdPayload(uint8_t *payload, uint8_t len)
+{
+  uint8_t padded = fdPayloadLen(len);
+  memset(payload + len, 0, padded - len);
+  return padded;
+}
+
+Error PdoService::packTxPdo(Plan &plan, uint8_t *payload, uint8_t &len)
+{
+  if (plan.direct) {
+    size_t locked = 0;
+
+    // Lock everything up front so we don't send a partially updated payload
+    for (; locked < plan.numSteps; ++locked) {
+      if (!plan.steps[locked].entry->lock()) break;
+    }
+
+    if (locked != plan.numSteps) {
+      auto &step = plan.steps[locked];
+      LogInfo("Failed to lock %x[%x] for TPDO 0x%03x", step.idx, step.subIdx, canIdMask(plan.cobid));
+      while (locked--) plan.steps[locked].entry->unlock();
+      return Error::DataXferLocal;
+    }
+
+    for (size_t i = 0; i < plan.numSteps; ++i) {
+      auto &step = plan.steps[i];
+      memcpy(payload + step.offset, step.data, step.len);
+      step.sentGeneration = step.entry->generation();
+      step.entry->unlock();
+    }
+
+    len = padFdPayload(payload, plan.len);
+    return Error::Success;
+  }
+
+  std::optional<OdProxy> proxies[MaxMappings];
+
+  // Create all proxies up front so we don't partially fill the payload if some entries are locked
+  for (size_t i = 0; i < plan.numSteps; ++i) {
+    auto &step = plan.steps[i];
+    if (!step.entry->lock()) {
+      LogInfo("Failed to make proxy at %x[%x] for TPDO 0x%03x: error 0x%08x", step.idx, step.subIdx, canIdMask(plan.cobid), Error::DataXferLocal);
+      return Error::DataXferLocal;
+    }
+    proxies[i].emplace(step.idx, step.subIdx, *step.entry);
+  }
+
+  uint8_t *pdoData = payload;
+  for (size_t i = 0; i < plan.numSteps; ++i) {
+    uint8_t maxPdoRemaining = maxPdoLen() - (pdoData - payload);
+    auto proxyLen           = proxies[i]->remaining();
+    if (proxyLen > maxPdoRemaining) {
+      LogInfo("TPDO 0x%03x mappings exceed %zu bytes", canIdMask(plan.cobid), maxPdoLen());
+      return Error::PdoSizeViolation;
+    }
+    if (Error e = proxies[i]->copyInto(pdoData, proxyLen); e != Error::Success) {
+      LogInfo("Failed to read OD at %x[%x] for TPDO 0x%03x: error 0x%08x", proxies[i]->idx, proxies[i]->subIdx, canIdMask(plan.cobid), e);
+      return e;
+    }
+    plan.steps[i].sentGeneration = plan.steps[i].entry->generation();
+    pdoData += proxyLen;
+  }
+
+  len = padFdPayload(payload, pdoData - payload);
+  return Error::Success;
+}
+
+Error PdoService::applyRxPdo(Plan &plan, const uint8_t *payload, uint8_t len, uint64_t timestamp)
+{
+  if (plan.direct) {
+    size_t locked = 0;
+
+    if (len < plan.len) {
+      LogInfo("RPDO 0x%03x too short (%d < %d)", canIdMask(plan.cobid), len, plan.len);
+      return Error::ParamLength;
+    }
+
+    // Lock everything up front so we don't partially apply the payload
+    for (; locked < plan.numSteps; ++locked) {
+      if (!plan.steps[locked].entry->lock()) break;
+    }
+
+    if (locked != plan.numSteps) {
+      auto &step = plan.steps[locked];
+      LogInfo("Failed to lock %x[%x] for RPDO 0x%03x", step.idx, step.subIdx, canIdMask(plan.cobid));
+      while (locked--) plan.steps[locked].entry->unlock();
+      return Error::DataXferLocal;
+    }
+
+    for (size_t i = 0; i < plan.numSteps; ++i) {
+      auto &step = plan.steps[i];
+      memcpy(step.data, payload + step.offset, step.len);
+      step.entry->rxTimestamp = timestamp;
+      step.entry->unlock();
+      step.entry->bumpGeneration();
+    }
+
+    return Error::Success;
+  }
+
+  std::optional<OdProxy> proxies[MaxMappings];
+
+  // Create all proxies up front so we don't partially apply the payload if some entries are locked
+  for (size_t i = 0; i < plan.numSteps; ++i) {
+    auto &step = plan.steps[i];
+    if (!step.entry->lock()) {
+      LogInfo("Failed to make proxy at %x[%x] for RPDO 0x%03x: error 0x%08x", step.idx, step.subIdx, canIdMask(plan.cobid), Error::DataXferLocal);
+      return Error::DataXferLocal;
+    }
+    proxies[i].emplace(step.idx, step.subIdx, *step.entry);
+  }
+
+  const uint8_t *pdoData = payload;
+  for (size_t i = 0; i < plan.numSteps; ++i) {
+    proxies[i]->suppressCallbacks();  // Defer until mapped entries are unlocked; allow callbacks to access them
+    auto proxyLen = proxies[i]->remaining();
+    if ((size_t)(pdoData - payload) + proxyLen > len) {
+      LogInfo("RPDO 0x%03x too short (%d bytes)", canIdMask(plan.cobid), len);
+      return Error::ParamLength;
+    }
+    if (Error e = proxies[i]->copyFrom(const_cast<uint8_t *>(pdoData), proxyLen); e != Error::Success) {
+      LogInfo("Failed to write OD at %x[%x] for RPDO 0x%03x: error 0x%08x", proxies[i]->idx, proxies[i]->subIdx, canIdMask(plan.cobid), e);
+      return e;
+    }
+    pdoData += proxyLen;
+  }
+
+  for (size_t i = 0; i < plan.numSteps; ++i) {
+    plan.steps[i].entry->rxTimestamp = timestamp;
+  }
+
+  return Error::Success;
+}
+
+void PdoService::rebuildRpdoDispatch()
+{
+  std::vector<std::tuple<uint16_t, uint32_t>> rpdos;
+  uint32_t cobid;
+
+  for (uint16_t paramIdx = RpdoParamBase; co.od.get(paramIdx, 1, cobid) == Error::Success; paramIdx++) {
+    if (!isDisabled(cobid)) {
+      rpdos.emplace_back(paramIdx, canIdMask(cobid));
+    }
+  }
+
+  rpdoByCobid.fill(0);
+  rpdoByExtCobid.clear();
+  nextRpdo.assign(rpdos.empty() ? 0 : std::get<0>(rpdos.back()) - RpdoParamBase + 1, 0);
+
+  // Push in reverse so RPDOs sharing a COB-ID are dispatched in param order
+  for (auto r = rpdos.rbegin(); r != rpdos.rend(); ++r) {
+    auto [paramIdx, busCobid] = *r;
+    uint16_t *head            = busCobid - DirectCobidBase < DirectCobidCount ? &rpdoByCobid[busCobid - DirectCobidBase] : &rpdoByExtCobid[busCobid];
+    nextRpdo[paramIdx - RpdoParamBase] = *head;
+    *head                              = paramIdx;
+  }
+
+  co.rxFiltersChanged();
+}
+
+uint16_t PdoService::findRpdo(uint32_t cobid)
+{
+  if (cobid - DirectCobidBase < DirectCobidCount) {
+    return rpdoByCobid[cobid - DirectCobidBase];
+  }
+
+  auto r = rpdoByExtCobid.find(cobid);
+  return r != rpdoByExtCobid.end() ? r->second : 0;
+}
+
 void PdoService::enableTpdoEvent(uint16_t tpdoIdx)
 {
   if (!pdoEnabled) return;
 
   if (uint32_t cobid; co.od.get(tpdoIdx, 1, cobid) == canfetti::Error::Success) {
     if (uint16_t period; co.od.get(tpdoIdx, 5, period) == canfetti::Error::Success) {
-      // sync PDOs not currently supported
-      if (isEventDriven(co.od, tpdoIdx) && !isDisabled(cobid) && period) {
-        uint16_t busCobid = canIdMask(cobid);
+      uint16_t busCobid = canIdMask(cobid);
+      auto t            = tpdoTimers.find(busCobid);
+      // Synchronous TPDOs are sent from processSync()
+      bool periodic = isEventDriven(co.od, tpdoIdx) && !isDisabled(cobid) && period;
+
+      if (periodic && startCyclicTpdo(tpdoIdx, period)) {
+        if (t != tpdoTimers.end()) {
+          co.sys.deleteTimer(t->second);
+          tpdoTimers.erase(t);
+        }
+        return;
+      }
+
+      stopCyclicTpdo(tpdoIdx);
+
+      if (periodic) {
         // Async because nothing can observe the return value
-        auto hdl          = co.sys.schedulePeriodic(period, std::bind(&PdoService::sendTxPdo, this, tpdoIdx, /* async */ true, /* rtr */ false));
-        auto t            = tpdoTimers.find(busCobid);
+        auto hdl = co.sys.schedulePeriodic(period, std::bind(&PdoService::sendEventTpdo, this, tpdoIdx, /* restartEventTimer */ false));
 
         // Update existing timer
         if (t != tpdoTimers.end()) {
@@ -111,54 +430,218 @@ void PdoService::enableTpdoEvent(uint16_t tpdoIdx)
           LogDebug("Created event-driven TPDO %x @ %d ms", tpdoIdx, period);
         }
       }
+      else if (t != tpdoTimers.end()) {
+        co.sys.deleteTimer(t->second);
+        tpdoTimers.erase(t);
+        LogDebug("Stopped event-driven TPDO %x", tpdoIdx);
+      }
     }
   }
 }
 
+// Hand a plain cyclic TPDO to the device where it supports that. Change-of-state
+// TPDOs restart their event timer on every send, so they stay on ours. The
+// device's copy of the frame is refreshed when a mapped entry changes through
+// the OD, or whenever the TPDO is sent explicitly. Buffer and dynamic entries
+// change without the OD knowing, so TPDOs mapping them stay on our timer too.
+bool PdoService::startCyclicTpdo(uint16_t paramIdx, uint16_t periodMs)
+{
+  auto [err, plan] = getPlan(paramIdx, true);
+  if (err != Error::Success || plan->changeOfState) {
+    return false;
+  }
+
+  for (size_t i = 0; i < plan->numSteps; ++i) {
+    bool outsideOd = false;
+    plan->steps[i].entry->visit([&](auto &&arg) {
+      using T   = std::decay_t<decltype(arg)>;
+      outsideOd = std::is_same_v<T, OdBuffer> || std::is_same_v<T, OdDynamicVar>;
+    });
+    if (outsideOd) return false;
+  }
+
+  uint8_t d[MaxPdoLen];
+  canfetti::Msg msg = {.id = canIdMask(plan->cobid), .rtr = false, .len = 0, .data = d};
+  if (packTxPdo(*plan, d, msg.len) != Error::Success) {
+    return false;
+  }
+  msg.fd = msg.len > MaxClassicLen;
+
+  // Moved to another COB-ID
+  if (auto c = cyclicTpdos.find(paramIdx); c != cyclicTpdos.end() && c->second != msg.id) {
+    stopCyclicTpdo(paramIdx);
+  }
+
+  if (co.bus.writeCyclic(msg, periodMs) != Error::Success) {
+    stopCyclicTpdo(paramIdx);
+    return false;
+  }
+
+  if (cyclicTpdos.emplace(paramIdx, msg.id).second) {
+    LogDebug("Device sending TPDO %x @ %d ms", paramIdx, periodMs);
+  }
+  watchMappedEntries(paramIdx);
+  return true;
+}
+
+void PdoService::stopCyclicTpdo(uint16_t paramIdx)
+{
+  if (auto c = cyclicTpdos.find(paramIdx); c != cyclicTpdos.end()) {
+    co.bus.stopCyclic(c->second);
+    cyclicTpdos.erase(c);
+    LogDebug("Stopped device sending TPDO %x", paramIdx);
+  }
+}
+
 void PdoService::enableRpdoEvent(uint16_t rpdoIdx)
 {
   if (!pdoEnabled) return;
 
+  auto d = rpdoDeadlines.find(rpdoIdx);
+  if (d == rpdoDeadlines.end()) return;
+
   if (uint32_t cobid; co.od.get(rpdoIdx, 1, cobid) == canfetti::Error::Success) {
     if (uint16_t period; co.od.get(rpdoIdx, 5, period) == canfetti::Error::Success) {
-      // sync PDOs not currently supported
-      if (isEventDriven(co.od, rpdoIdx) && !isDisabled(cobid) && period) {
-        uint16_t busCobid = canIdMask(cobid);
-        auto t            = rpdoTimers.find(busCobid);
-
-        if (t != rpdoTimers.end()) {
-          auto &[timer, gen, storedPeriod, cb] = t->second;
-          gen                                  = newGeneration();
-          storedPeriod                         = period;
-
-          if (timer != System::InvalidTimer) {
-            co.sys.deleteTimer(timer);
-            timer = System::InvalidTimer;
-          }
-
-          if (cb) {
-            timer = co.sys.scheduleDelayed(period, std::bind(&PdoService::rpdoTimeout, this, gen, busCobid));
-          }
-
-          LogInfo("Updated event-driven RPDO %x @ %d ms", rpdoIdx, period);
-        }
+      RpdoDeadline &deadline = d->second;
+
+      // Only event-driven RPDOs have an event timer, and the device may be supervising it
+      bool supervised   = isEventDriven(co.od, rpdoIdx) && !isDisabled(cobid) && !rxChangeFilters.count(canIdMask(cobid));
+      deadline.periodMs = supervised ? period : 0;
+      deadline.cobid    = canIdMask(cobid);
+      deadline.expired  = false;
+      updateDeadlineSweep();
+
+      if (deadline.periodMs) {
+        deadline.timeoutTicks = (deadline.periodMs + sweepPeriodMs - 1) / sweepPeriodMs + 1;
+        deadline.deadline     = sweepTick + deadline.timeoutTicks;
+        LogInfo("Updated event-driven RPDO %x @ %d ms", rpdoIdx, period);
       }
     }
   }
 }
 
-void PdoService::rpdoTimeout(unsigned generation, uint16_t idx)
+// Let the device drop RPDOs repeating the last payload, and supervise their
+// timeouts, where it supports that. Diffs what enabled RPDOs need against what
+// the device has, so it can be called after any RPDO change.
+void PdoService::updateRxChangeFilters()
 {
-  if (auto r = rpdoTimers.find(idx); r != rpdoTimers.end()) {
-    auto &[timer, gen, periodMs, cb] = r->second;
-    (void)timer;  // Silence unused variable warning
-    (void)periodMs;
+  std::unordered_map<uint32_t, RxChangeFilter> wanted;
+  uint32_t cobid;
 
-    // Was the timer invalidated before the callback fired?
-    if (generation != gen) return;
+  for (uint16_t paramIdx = RpdoParamBase; pdoEnabled && co.od.get(paramIdx, 1, cobid) == Error::Success; paramIdx++) {
+    if (isDisabled(cobid)) continue;
+
+    auto [err, plan] = getPlan(paramIdx, false);
+    if (err != Error::Success) continue;
+
+    // RPDOs sharing a COB-ID need the union of their bytes and the shortest timeout
+    RxChangeFilter &f = wanted[canIdMask(cobid)];
+    f.len             = std::max(f.len, plan->len);
+
+    uint16_t period;
+    if (rpdoDeadlines.count(paramIdx) && isEventDriven(plan->transmissionType) && co.od.get(paramIdx, 5, period) == Error::Success && period) {
+      f.timeoutMs = f.timeoutMs ? std::min(f.timeoutMs, period) : period;
+    }
+  }
+
+  bool changed = false;
 
-    if (cb) {
-      cb(idx);
+  for (auto f = rxChangeFilters.begin(); f != rxChangeFilters.end();) {
+    if (auto w = wanted.find(f->first); w == wanted.end() || !(w->second == f->second)) {
+      co.bus.clearRxChangeFilter(f->first);
+      f       = rxChangeFilters.erase(f);
+      changed = true;
+    }
+    else {
+      ++f;
+    }
+  }
+
+  for (auto &[busCobid, f] : wanted) {
+    if (!rxChangeFilters.count(busCobid) && co.bus.setRxChangeFilter(busCobid, f.len, f.timeoutMs) == Error::Success) {
+      rxChangeFilters.emplace(busCobid, f);
+      changed = true;
+    }
+  }
+
+  if (!changed) return;
+
+  // Raw reception and our own timeout supervision move to or from the device
+  co.rxFiltersChanged();
+  for (auto &[paramIdx, d] : rpdoDeadlines) {
+    (void)d;  // Silence unused variable warning
+    enableRpdoEvent(paramIdx);
+  }
+}
+
+Error PdoService::processRxTimeout(uint32_t cobid)
+{
+  expiredRpdos.clear();
+
+  for (uint16_t rpdoParamIdx = findRpdo(cobid); rpdoParamIdx; rpdoParamIdx = nextRpdo[rpdoParamIdx - RpdoParamBase]) {
+    if (auto d = rpdoDeadlines.find(rpdoParamIdx); d != rpdoDeadlines.end() && !d->second.expired) {
+      d->second.expired = true;
+      expiredRpdos.push_back(rpdoParamIdx);
+    }
+  }
+
+  // Collect first since callbacks may reconfigure RPDOs
+  for (auto paramIdx : expiredRpdos) {
+    if (auto d = rpdoDeadlines.find(paramIdx); d != rpdoDeadlines.end() && d->second.cb) {
+      d->second.cb(d->second.cobid);
+    }
+  }
+
+  return expiredRpdos.empty() ? Error::IndexNotFound : Error::Success;
+}
+
+// Match the sweep period to the shortest supervised timeout
+void PdoService::updateDeadlineSweep()
+{
+  uint16_t minPeriodMs = 0;
+
+  for (auto &[paramIdx, d] : rpdoDeadlines) {
+    (void)paramIdx;  // Silence unused variable warning
+    if (d.periodMs && (!minPeriodMs || d.periodMs < minPeriodMs)) {
+      minPeriodMs = d.periodMs;
+    }
+  }
+
+  uint16_t periodMs = minPeriodMs ? std::max<uint16_t>(minPeriodMs / SweepsPerTimeout, 1) : 0;
+  if (periodMs == sweepPeriodMs) return;
+
+  // Schedule before freeing the old timer since we may be running in its callback
+  auto old      = sweepTimer;
+  sweepTimer    = periodMs ? co.sys.schedulePeriodic(periodMs, std::bind(&PdoService::sweepRpdoDeadlines, this), false) : System::InvalidTimer;
+  sweepPeriodMs = periodMs;
+  co.sys.deleteTimer(old);
+
+  // Tick length changed
+  for (auto &[paramIdx, d] : rpdoDeadlines) {
+    (void)paramIdx;  // Silence unused variable warning
+    if (d.periodMs) {
+      d.timeoutTicks = (d.periodMs + sweepPeriodMs - 1) / sweepPeriodMs + 1;
+      d.deadline     = sweepTick + d.timeoutTicks;
+    }
+  }
+}
+
+void PdoService::sweepRpdoDeadlines()
+{
+  sweepTick++;
+  expiredRpdos.clear();
+
+  // Collect first since callbacks may reconfigure RPDOs
+  for (auto &[paramIdx, d] : rpdoDeadlines) {
+    if (d.periodMs && !d.expired && static_cast<int32_t>(sweepTick - d.deadline) >= 0) {
+      d.expired = true;
+      expiredRpdos.push_back(paramIdx);
+    }
+  }
+
+  for (auto paramIdx : expiredRpdos) {
+    if (auto d = rpdoDeadlines.find(paramIdx); d != rpdoDeadlines.end() && d->second.cb) {
+      d->second.cb(d->second.cobid);
     }
   }
 }
@@ -173,11 +656,27 @@ Error PdoService::addRPDO(uint16_t cobid, const std::tuple<uint16_t, uint8_t> *m
     i++;
   }
 
-  auto err = addPdoEntry(StartRpdoParamIdx + i, cobid, timeoutMs, mapping, numMapping, true, false, std::bind(&PdoService::enableRpdoEvent, this, std::placeholders::_1));
+  auto changedCb = [this](uint16_t idx, uint8_t subIdx) {
+    if (subIdx == 1) rebuildRpdoDispatch();
+    updateRxChangeFilters();
+    enableRpdoEvent(idx);
+  };
+
+  auto err = addPdoEntry(StartRpdoParamIdx + i, cobid, timeoutMs, mapping, numMapping, true, false, changedCb);
+
+  if (err == Error::Success) {
+    rebuildRpdoDispatch();
+  }
+
+  if (err == Error::Success && cb) {
+    rpdoDeadlines[StartRpdoParamIdx + i].cb = cb;
+  }
+
+  if (err == Error::Success) {
+    updateRxChangeFilters();
+  }
 
   if (err == Error::Success && cb) {
-    assert(rpdoTimers.find(cobid) == rpdoTimers.end() && "Multiple RPDO timers arent supported");
-    rpdoTimers.emplace(std::make_pair(cobid, std::make_tuple(System::InvalidTimer, newGeneration(), timeoutMs, cb)));
     enableRpdoEvent(StartRpdoParamIdx + i);
   }
 
@@ -188,9 +687,15 @@ Error PdoService::addTPDO(uint16_t pdoNum, uint16_t cobid, const std::tuple<uint
 {
   uint16_t paramIdx = 0x1800 + pdoNum;
 
-  auto err = addPdoEntry(paramIdx, cobid, periodMs, mapping, numMapping, enabled, true, std::bind(&PdoService::enableTpdoEvent, this, std::placeholders::_1));
+  auto changedCb = [this](uint16_t idx, uint8_t subIdx) {
+    if (subIdx == 1) co.rxFiltersChanged();  // RTRs are received on the TPDO's COB-ID
+    enableTpdoEvent(idx);
+  };
+
+  auto err = addPdoEntry(paramIdx, cobid, periodMs, mapping, numMapping, enabled, true, changedCb);
   if (err == Error::Success) {
     configuredTPDONums.push_back(pdoNum);
+    co.rxFiltersChanged();
     enableTpdoEvent(paramIdx);
   }
 
@@ -202,6 +707,150 @@ Error PdoService::updateTpdoEventTime(uint16_t paramIdx, uint16_t periodMs)
   return co.od.set(paramIdx, 5, periodMs);
 }
 
+Error PdoService::setTransmissionType(uint16_t paramIdx, uint8_t transmissionType)
+{
+  // RTR-only types (0xFC, 0xFD) aren't supported
+  if (!isSynchronous(transmissionType) && !isEventDriven(transmissionType)) {
+    return Error::ValueRange;
+  }
+
+  return co.od.set(paramIdx, 2, transmissionType);
+}
+
+Error PdoService::setInhibitTime(uint16_t paramIdx, uint16_t inhibitTime100us)
+{
+  return co.od.set(paramIdx, 3, inhibitTime100us);
+}
+
+Error PdoService::setChangeOfState(uint16_t paramIdx, bool enable)
+{
+  if (!co.od.entryExists(paramIdx, 1)) {
+    return Error::IndexNotFound;
+  }
+
+  plans[paramIdx].changeOfState = enable;
+
+  if (enable) {
+    watchMappedEntries(paramIdx);
+  }
+
+  // May move the event timer between the device and us
+  enableTpdoEvent(paramIdx);
+
+  return Error::Success;
+}
+
+void PdoService::mappedEntryChanged(uint16_t paramIdx)
+{
+  if (!pdoEnabled) return;
+
+  auto [err, plan] = getPlan(paramIdx, true);
+  if (err != Error::Success || isDisabled(plan->cobid)) {
+    return;
+  }
+
+  bool cyclic = cyclicTpdos.count(paramIdx);
+  if (!cyclic && (!plan->changeOfState || !isEventDriven(plan->transmissionType))) {
+    return;
+  }
+
+  for (size_t i = 0; i < plan->numSteps; ++i) {
+    auto &step = plan->steps[i];
+    if (step.entry->generation() != step.sentGeneration) {
+      if (cyclic) {
+        // Update the device's copy in place, without restarting its timer
+        uint8_t d[MaxPdoLen];
+        canfetti::Msg msg = {.id = canIdMask(plan->cobid), .rtr = false, .len = 0, .data = d};
+        if (packTxPdo(*plan, d, msg.len) == Error::Success) {
+          msg.fd = msg.len > MaxClassicLen;
+          co.bus.writeCyclic(msg, 0);
+        }
+      }
+      else {
+        sendEventTpdo(paramIdx, /* restartEventTimer */ true);
+      }
+      return;
+    }
+  }
+}
+
+// Sends an event-driven TPDO unless it is within its inhibit time, in which
+// case it goes out once the inhibit time expires
+Error PdoService::sendEventTpdo(uint16_t paramIdx, bool restartEventTimer)
+{
+  auto [err, plan] = getPlan(paramIdx, true);
+  if (err != Error::Success) {
+    return err;
+  }
+
+  if (plan->inhibited) {
+    plan->eventPending = true;
+    return Error::Success;
+  }
+
+  // Async because nothing can observe the return value
+  if (Error e = sendTxPdo(paramIdx, /* async */ true); e != Error::Success) {
+    return e;
+  }
+
+  if (plan->inhibitTime) {
+    uint32_t inhibitMs = (plan->inhibitTime + 9) / 10;  // Round up to timer resolution
+    plan->inhibited    = true;
+
+    // Re-arm in place, which is safe from within its own callback. Only a new
+    // timer needs a new generation and closure.
+    if (co.sys.resetTimer(plan->inhibitTimer, inhibitMs) == System::InvalidTimer) {
+      plan->inhibitGeneration = newGeneration();
+      plan->inhibitTimer      = co.sys.scheduleDelayed(inhibitMs, std::bind(&PdoService::inhibitExpired, this, plan->inhibitGeneration, paramIdx));
+    }
+  }
+
+  // The event timer only fires after a period without any other transmission
+  if (restartEventTimer) {
+    if (auto t = tpdoTimers.find(canIdMask(plan->cobid)); t != tpdoTimers.end()) {
+      if (uint16_t period; co.od.get(paramIdx, 5, period) == Error::Success && period) {
+        co.sys.resetTimer(t->second, period);
+      }
+    }
+  }
+
+  return Error::Success;
+}
+
+void PdoService::inhibitExpired(unsigned generation, uint16_t paramIdx)
+{
+  if (auto p = plans.find(paramIdx); p != plans.end()) {
+    Plan &plan = p->second;
+
+    // Was the timer invalidated before the callback fired?
+    if (generation != plan.inhibitGeneration) return;
+
+    plan.inhibited = false;
+
+    if (plan.eventPending) {
+      plan.eventPending = false;
+      sendEventTpdo(paramIdx, /* restartEventTimer */ true);
+    }
+  }
+}
+
+Error PdoService::setRpdoTransmissionType(uint16_t cobid, uint8_t transmissionType)
+{
+  uint16_t rpdoParamIdx = findRpdo(cobid);
+
+  if (!rpdoParamIdx) {
+    return Error::IndexNotFound;
+  }
+
+  for (; rpdoParamIdx; rpdoParamIdx = nextRpdo[rpdoParamIdx - RpdoParamBase]) {
+    if (Error e = setTransmissionType(rpdoParamIdx, transmissionType); e != Error::Success) {
+      return e;
+    }
+  }
+
+  return Error::Success;
+}
+
 Error PdoService::disablePdo(uint16_t paramIdx)
 {
   uint32_t cobid;
@@ -234,64 +883,28 @@ Error PdoService::enablePdo(uint16_t paramIdx)
 
 canfetti::Error PdoService::sendTxPdo(uint16_t paramIdx, bool async, bool rtr)
 {
-  constexpr uint16_t mappingOffset = 0x200;
-  uint16_t mappingIdx              = paramIdx + mappingOffset;
-  uint8_t numMappings;
-  uint32_t cobid;
-  uint8_t d[8];
+  uint8_t d[MaxPdoLen];
 
-  if (co.od.get(paramIdx, 1, cobid) != canfetti::Error::Success) {
-    return canfetti::Error::IndexNotFound;
+  auto [err, plan] = getPlan(paramIdx, true);
+  if (err != canfetti::Error::Success) {
+    return err;
   }
 
-  if (isDisabled(cobid)) {
+  if (isDisabled(plan->cobid)) {
     return canfetti::Error::DataXfer;
   }
 
-  canfetti::Msg msg = {.id = canIdMask(cobid), .rtr = rtr, .len = 0, .data = d};
-
-  if (co.od.get(mappingIdx, 0, numMappings) != canfetti::Error::Success) {
-    return canfetti::Error::IndexNotFound;
-  }
+  canfetti::Msg msg = {.id = canIdMask(plan->cobid), .rtr = rtr, .len = 0, .data = d};
 
-  if (numMappings > MAX_MAPPINGS) {
-    return canfetti::Error::InternalError;
+  if (Error e = packTxPdo(*plan, d, msg.len); e != canfetti::Error::Success) {
+    return e;
   }
+  msg.fd = msg.len > MaxClassicLen;
 
-  {
-    std::optional<OdProxy> proxies[MAX_MAPPINGS];
-
-    // Create all proxies up front so we don't partially fill the payload if some entries are locked
-    for (size_t i = 0; i < numMappings; ++i) {
-      uint32_t map;
-      if (Error e = co.od.get(mappingIdx, i + 1, map); e != canfetti::Error::Success) {
-        LogInfo("Failed to look up TPDO mapping at %x[%zx] for TPDO 0x%03x: error 0x%08x", mappingIdx, i + 1, msg.id, e);
-        return e;
-      }
-      uint16_t valIdx   = (map >> 16) & 0xffff;
-      uint8_t valSubIdx = (map >> 8) & 0xff;
-      if (auto [e, p] = co.od.makeProxy(valIdx, valSubIdx); e == Error::Success) {
-        proxies[i].emplace(std::move(p));
-      }
-      else {
-        LogInfo("Failed to make proxy at %x[%x] for TPDO 0x%03x: error 0x%08x", valIdx, valSubIdx, msg.id, e);
-        return e;
-      }
-    }
-
-    uint8_t *pdoData = msg.data;
-    for (size_t i = 0; i < numMappings; ++i) {
-      uint8_t maxPdoRemaining = 8 - (pdoData - msg.data);
-      auto len                = proxies[i]->remaining();
-      assert(len <= maxPdoRemaining);  // Catch programming errors.  PDOs can only have 8 bytes
-      (void)maxPdoRemaining;
-      if (Error e = proxies[i]->copyInto(pdoData, len); e != Error::Success) {
-        LogInfo("Failed to read OD at %x[%x] for TPDO 0x%03x: error 0x%08x", proxies[i]->idx, proxies[i]->subIdx, msg.id, e);
-        return e;
-      }
-      pdoData += len;
-      msg.len += len;
-    }
+  // Keep the device's copy current, e.g. for entries that change without
+  // going through the OD
+  if (cyclicTpdos.count(paramIdx)) {
+    co.bus.writeCyclic({.id = msg.id, .rtr = false, .len = msg.len, .data = d, .fd = msg.fd}, 0);
   }
 
   return co.bus.write(msg, async);
@@ -310,6 +923,10 @@ canfetti::Error PdoService::enablePdoEvents()
     enableTpdoEvent(paramIdx);
   }
 
+  // Set up afresh, so the first frame after this is delivered even if
+  // unchanged. Before the RPDO timers, which skip what the device supervises.
+  updateRxChangeFilters();
+
   // RPDO timers
   for (uint16_t paramIdx = 0x1400; co.od.get(paramIdx, 1, cfgCobid) == canfetti::Error::Success; paramIdx++) {
     enableRpdoEvent(paramIdx);
@@ -329,13 +946,28 @@ canfetti::Error PdoService::disablePdoEvents()
   }
   tpdoTimers.clear();
 
-  for (auto &r : rpdoTimers) {
-    auto &[timer, gen, periodMs, cb] = r.second;
-    (void)periodMs;  // Silence unused variable warning
-    (void)cb;
-    gen = newGeneration();
-    co.sys.deleteTimer(timer);
+  for (auto &[paramIdx, cobid] : cyclicTpdos) {
+    (void)paramIdx;  // Silence unused variable warning
+    co.bus.stopCyclic(cobid);
   }
+  cyclicTpdos.clear();
+
+  // RPDOs are ignored until re-enabled anyway
+  updateRxChangeFilters();
+
+  for (auto &[paramIdx, plan] : plans) {
+    (void)paramIdx;  // Silence unused variable warning
+    co.sys.deleteTimer(plan.inhibitTimer);
+    plan.inhibited         = false;
+    plan.eventPending      = false;
+    plan.inhibitGeneration = newGeneration();
+  }
+
+  for (auto &[paramIdx, d] : rpdoDeadlines) {
+    (void)paramIdx;  // Silence unused variable warning
+    d.periodMs = 0;
+  }
+  updateDeadlineSweep();
 
   return canfetti::Error::Success;
 }
@@ -357,17 +989,34 @@ Error PdoService::sendAllTpdos()
       continue;
     }
 
-    if (Error e = sendTxPdo(tpdoParamIdx); e != Error::Success) {
+    // Queue the burst so platforms that batch writes send it in one go
+    if (Error e = sendTxPdo(tpdoParamIdx, /* async */ true); e != Error::Success) {
+      co.bus.flush();
       return e;
     }
   }
 
+  co.bus.flush();
   return Error::Success;
 }
 
+void PdoService::addRxFilters(std::vector<CanDevice::RxFilter> &filters)
+{
+  uint32_t cobid;
+
+  // Unless the device delivers them through its change filter instead
+  for (uint16_t paramIdx = RpdoParamBase; co.od.get(paramIdx, 1, cobid) == Error::Success; paramIdx++) {
+    if (!isDisabled(cobid) && !rxChangeFilters.count(canIdMask(cobid))) filters.push_back(CanDevice::RxFilter::exact(canIdMask(cobid)));
+  }
+
+  for (auto pdoNum : configuredTPDONums) {
+    if (co.od.get(0x1800 + pdoNum, 1, cobid) != Error::Success) continue;
+    if (!isDisabled(cobid) && isRtrAllowed(cobid)) filters.push_back(CanDevice::RxFilter::exact(canIdMask(cobid)));
+  }
+}
+
 Error PdoService::processMsg(const canfetti::Msg &msg)
 {
-  constexpr uint16_t mappingOffset = 0x200;
   uint32_t cfgCobid;
 
   if (co.getState() != canfetti::State::Operational) return canfetti::Error::Success;
@@ -392,95 +1041,96 @@ Error PdoService::processMsg(const canfetti::Msg &msg)
     }
   }
   else {
-    for (uint16_t rpdoParamIdx = 0x1400; co.od.get(rpdoParamIdx, 1, cfgCobid) == canfetti::Error::Success; rpdoParamIdx++) {
-      uint16_t busCobid = canIdMask(cfgCobid);
-      if (busCobid != msg.id) {
-        continue;
+    for (uint16_t rpdoParamIdx = findRpdo(msg.id); rpdoParamIdx; rpdoParamIdx = nextRpdo[rpdoParamIdx - RpdoParamBase]) {
+      uint16_t busCobid = msg.id;
+      auto [err, plan]  = getPlan(rpdoParamIdx, false);
+      if (err != canfetti::Error::Success) {
+        LogInfo("Failed to compile mapping for RPDO 0x%03x: error 0x%08x", busCobid, err);
+        return err;
       }
 
-      if (isDisabled(cfgCobid)) {
-        LogDebug("Ignoring RPDO because it is disabled");
+      bool eventDriven = isEventDriven(plan->transmissionType);
+
+      if (eventDriven) {
+        if (Error e = applyRxPdo(*plan, msg.data, msg.len, msg.timestamp); e != canfetti::Error::Success) {
+          return e;
+        }
+      }
+      else if (isSynchronous(plan->transmissionType)) {
+        // Latch until the next SYNC; a newer frame replaces an unapplied one
+        plan->latchedLen = std::min<size_t>(msg.len, MaxPdoLen);
+        memcpy(plan->latchedData, msg.data, plan->latchedLen);
+        plan->latchedTimestamp = msg.timestamp;
+        if (!plan->latched) {
+          plan->latched = true;
+          latchedRpdos.push_back(rpdoParamIdx);
+        }
+      }
+      else {
+        LogInfo("Unsupported transmission type 0x%x for RPDO 0x%03x", plan->transmissionType, busCobid);
         continue;
       }
 
-      uint8_t numMappings     = 0;
-      uint16_t rpdoMappingIdx = rpdoParamIdx + mappingOffset;
+      // Push out the timeout deadline if supervised here
+      if (auto d = rpdoDeadlines.find(rpdoParamIdx); d != rpdoDeadlines.end()) {
+        if (d->second.periodMs) d->second.deadline = sweepTick + d->second.timeoutTicks;
+        d->second.expired = false;
+      }
 
-      if (co.od.get(rpdoMappingIdx, 0, numMappings) != canfetti::Error::Success) {
-        assert(0 && "OD not configured properly");
-        continue;
+      // Fire callbacks after deadline reset in case they mess with it
+      if (eventDriven) {
+        for (size_t i = 0; i < plan->numSteps; ++i) {
+          plan->steps[i].entry->fireCallbacks();
+        }
       }
+    }
+  }
 
-      // LogInfo("RPDO %x", msg.id);
+  return canfetti::Error::Success;
+}
 
-      if (!isEventDriven(co.od, rpdoParamIdx)) {
-        LogInfo("Only event driven PDO are supported");
-        continue;
-      }
+Error PdoService::processSync(uint8_t /* counter */)
+{
+  Error err = Error::Success;
 
-      if (numMappings > MAX_MAPPINGS) {
-        LogInfo("Too many mappings");
-        continue;
-      }
+  if (co.getState() != canfetti::State::Operational) return canfetti::Error::Success;
 
-      std::tuple<uint16_t, uint8_t> entries[MAX_MAPPINGS];
-
-      {
-        std::optional<OdProxy> proxies[MAX_MAPPINGS];
-
-        // Create all proxies up front so we don't partially apply the payload if some entries are locked
-        for (size_t i = 0; i < numMappings; ++i) {
-          uint32_t map;
-          if (Error e = co.od.get(rpdoMappingIdx, i + 1, map); e != Error::Success) {
-            LogInfo("Failed to look up RPDO mapping at %x[%zx] for RPDO 0x%03x: error 0x%08x", rpdoMappingIdx, i + 1, busCobid, e);
-            return e;
-          }
-          uint16_t valIdx   = (map >> 16) & 0xffff;
-          uint8_t valSubIdx = (map >> 8) & 0xff;
-          entries[i]        = {valIdx, valSubIdx};
-          if (auto [e, p] = co.od.makeProxy(valIdx, valSubIdx); e == Error::Success) {
-            proxies[i].emplace(std::move(p));
-          }
-          else {
-            LogInfo("Failed to make proxy at %x[%x] for RPDO 0x%03x: error 0x%08x", valIdx, valSubIdx, busCobid, e);
-            return e;
-          }
-        }
+  // Apply RPDOs latched during the last cycle. Swap first in case callbacks
+  // end up latching more. Both lists keep their capacity, so steady state
+  // SYNCs don't allocate.
+  applyingRpdos.swap(latchedRpdos);
 
-        uint8_t *pdoData = msg.data;
-        for (size_t i = 0; i < numMappings; ++i) {
-          assert(pdoData - msg.data < 8);   // Catch programming errors.  PDOs can only have 8 bytes
-          proxies[i]->suppressCallbacks();  // Defer until mapped entries are unlocked; allow callbacks to access them
-          auto len = proxies[i]->remaining();
-          if (Error e = proxies[i]->copyFrom(pdoData, len); e != Error::Success) {
-            LogInfo("Failed to write OD at %x[%x] for RPDO 0x%03x: error 0x%08x", proxies[i]->idx, proxies[i]->subIdx, busCobid, e);
-            return e;
-          }
-          pdoData += len;
-        }
-      }
+  for (auto rpdoParamIdx : applyingRpdos) {
+    auto [e, plan] = getPlan(rpdoParamIdx, false);
 
-      // Reset timer if active
-      if (auto r = rpdoTimers.find(busCobid); r != rpdoTimers.end()) {
-        auto &[timer, gen, periodMs, cb] = r->second;
-        (void)cb;  // Silence unused variable warning
-        gen = newGeneration();
-        if (timer != System::InvalidTimer) {
-          co.sys.deleteTimer(timer);
-          timer = co.sys.scheduleDelayed(periodMs, std::bind(&PdoService::rpdoTimeout, this, gen, busCobid));
-        }
-      }
+    // Remapped since it was latched
+    if (e != Error::Success || !plan->latched) continue;
 
-      // Fire callbacks after timer reset in case they mess with it
-      for (size_t i = 0; i < numMappings; ++i) {
-        auto [idx, subIdx] = entries[i];
-        if (Error e = co.od.fireCallbacks(idx, subIdx); e != Error::Success) {
-          LogInfo("Failed to fire callbacks for %x[%x]: error 0x%08x", idx, subIdx, e);
-          return e;
-        }
-      }
+    plan->latched = false;
+    if (e = applyRxPdo(*plan, plan->latchedData, plan->latchedLen, plan->latchedTimestamp); e != Error::Success) {
+      err = e;
+      continue;
+    }
+
+    for (size_t i = 0; i < plan->numSteps; ++i) {
+      plan->steps[i].entry->fireCallbacks();
     }
   }
+  applyingRpdos.clear();
 
-  return canfetti::Error::Success;
+  // Send cyclic synchronous TPDOs that are due
+  for (auto pdoNum : configuredTPDONums) {
+    uint16_t tpdoParamIdx = 0x1800 + pdoNum;
+    auto [e, plan]        = getPlan(tpdoParamIdx, true);
+
+    if (e != Error::Success || isDisabled(plan->cobid) || !plan->transmissionType || !isSynchronous(plan->transmissionType)) continue;
+    if (++plan->syncCount < plan->transmissionType) continue;
+
+    plan->syncCount = 0;
+    if (e = sendTxPdo(tpdoParamIdx, /* async */ true); e != Error::Success) {
+      err = e;
+    }
+  }
+
+  return err;
 }
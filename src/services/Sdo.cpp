@@ -34,9 +34,23 @@ Error SdoService::syncServices()
     servers.emplace(clientToServer, std::make_tuple(serverToClient, node));
   }
 
+  co.rxFiltersChanged();
   return Error::Success;
 }
 
+void SdoService::addRxFilters(std::vector<CanDevice::RxFilter> &filters)
+{
+  for (auto &&[rxCobid, server] : servers) {
+    (void)server;  // Silence unused variable warning
+    filters.push_back(CanDevice::RxFilter::exact(rxCobid));
+  }
+
+  uint16_t serverToClient;
+  for (uint16_t clientIdx = 0x1280; co.od.get(clientIdx, 2, serverToClient) == Error::Success; clientIdx++) {
+    filters.push_back(CanDevice::RxFilter::exact(serverToClient));
+  }
+}
+
 Error SdoService::addSdoEntry(uint16_t paramIdx, uint16_t clientToServer, uint16_t serverToClient, uint8_t node)
 {
   while (co.od.entryExists(paramIdx, 0)) {
@@ -77,7 +91,8 @@ Error SdoService::addSDOClient(uint32_t txCobid, uint16_t rxCobid, uint8_t serve
 }
 
 Error SdoService::clientTransaction(bool read, uint8_t remoteNode, uint16_t idx, uint8_t subIdx,
-                                    OdVariant &data, uint32_t segmentTimeout, FinishCallback cb)
+                                    OdVariant &data, uint32_t segmentTimeout, FinishCallback cb,
+                                    uint32_t queueTimeout, TransactionId *id)
 {
   uint8_t node;
 
@@ -92,33 +107,147 @@ Error SdoService::clientTransaction(bool read, uint8_t remoteNode, uint16_t idx,
       break;
     }
 
-    if (auto i = activeTransactions.find(serverToClient); i != activeTransactions.end()) {
-      LogInfo("Transaction already in progress for node: %d", node);
-      return Error::Error;
+    PendingTransaction t = {
+        .id             = nextId++,
+        .read           = read,
+        .idx            = idx,
+        .subIdx         = subIdx,
+        .data           = &data,
+        .clientToServer = clientToServer,
+        .segmentTimeout = segmentTimeout,
+        .cb             = cb,
+        .queueTimer     = System::InvalidTimer,
+    };
+    if (!t.id) t.id = nextId++;  // 0 is never handed out
+
+    auto p    = pendingTransactions.find(serverToClient);
+    bool busy = activeTransactions.count(serverToClient) || (p != pendingTransactions.end() && !p->second.empty());
+
+    if (!busy) {
+      Error err = startClientTransaction(serverToClient, t);
+      if (err == Error::Success && id) *id = t.id;
+      return err;
     }
 
-    auto [err, client] = read ? Client::initiateRead(idx, subIdx, data, clientToServer, co) : Client::initiateWrite(idx, subIdx, data, clientToServer, co);
+    auto &queue = pendingTransactions[serverToClient];
+    if (queue.size() >= clientQueueDepth) {
+      LogInfo("SDO queue full for node: %d", node);
+      stats.queueFull++;
+      return Error::OutOfMemory;
+    }
 
-    if (client) {
-      unsigned gen           = newGeneration();
-      TransactionState state = {
-          .protocol   = client,
-          .timer      = co.sys.scheduleDelayed(segmentTimeout, std::bind(&SdoService::transactionTimeout, this, gen, serverToClient)),
-          .generation = gen,
-          .cb         = cb,
-      };
-      auto [i, success] = activeTransactions.emplace(serverToClient, state);
-      (void)i;  // Silence unused variable warning
-      if (!success) err = Error::Error;
+    if (queueTimeout) {
+      t.queueTimer = co.sys.scheduleDelayed(queueTimeout, std::bind(&SdoService::queueTimeout, this, serverToClient, t.id));
     }
 
-    return err;
+    if (id) *id = t.id;
+    queue.push_back(std::move(t));
+    stats.queued++;
+    if (queue.size() > stats.maxQueueDepth) stats.maxQueueDepth = queue.size();
+    return Error::Success;
   }
 
   LogInfo("No SDO client found for node: %d", remoteNode);
   return Error::Error;
 }
 
+Error SdoService::startClientTransaction(uint16_t key, PendingTransaction &t)
+{
+  auto [err, client] = t.read ? Client::initiateRead(t.idx, t.subIdx, *t.data, t.clientToServer, co) : Client::initiateWrite(t.idx, t.subIdx, *t.data, t.clientToServer, co);
+
+  if (client) {
+    unsigned gen           = newGeneration();
+    TransactionState state = {
+        .protocol   = client,
+        .timer      = co.sys.scheduleDelayed(t.segmentTimeout, std::bind(&SdoService::transactionTimeout, this, gen, key)),
+        .generation = gen,
+        .cb         = t.cb,
+        .client     = true,
+        .id         = t.id,
+    };
+    auto [i, success] = activeTransactions.emplace(key, state);
+    (void)i;  // Silence unused variable warning
+    if (!success) err = Error::Error;
+  }
+
+  return err;
+}
+
+void SdoService::startNextClientTransaction(uint16_t key)
+{
+  auto p = pendingTransactions.find(key);
+
+  // A callback may already have started the next one
+  while (p != pendingTransactions.end() && !p->second.empty() && !activeTransactions.count(key)) {
+    PendingTransaction t = std::move(p->second.front());
+    p->second.pop_front();
+    co.sys.deleteTimer(t.queueTimer);
+
+    if (Error err = startClientTransaction(key, t); err != Error::Success) {
+      LogInfo("Queued SDO transaction %x[%d] failed to start", t.idx, t.subIdx);
+      if (t.cb) t.cb(err);
+      p = pendingTransactions.find(key);  // cb may have queued more
+    }
+  }
+}
+
+void SdoService::queueTimeout(uint16_t key, TransactionId id)
+{
+  if (auto p = pendingTransactions.find(key); p != pendingTransactions.end()) {
+    auto &queue = p->second;
+    for (auto i = queue.begin(); i != queue.end(); ++i) {
+      if (i->id == id) {
+        auto cb = std::move(i->cb);
+        co.sys.deleteTimer(i->queueTimer);
+        queue.erase(i);
+        stats.queueTimeouts++;
+        if (cb) cb(Error::Timeout);
+        return;
+      }
+    }
+  }
+}
+
+Error SdoService::cancelTransaction(TransactionId id)
+{
+  if (!id) return Error::Error;
+
+  for (auto &&[key, queue] : pendingTransactions) {
+    (void)key;  // Silence unused variable warning
+    for (auto i = queue.begin(); i != queue.end(); ++i) {
+      if (i->id == id) {
+        auto cb = std::move(i->cb);
+        co.sys.deleteTimer(i->queueTimer);
+        queue.erase(i);
+        stats.cancelled++;
+        if (cb) cb(Error::DataXferLocal);
+        return Error::Success;
+      }
+    }
+  }
+
+  for (auto &&[key, state] : activeTransactions) {
+    if (state.client && state.id == id) {
+      stats.cancelled++;
+      state.protocol->finish(Error::DataXferLocal, true);
+      removeTransaction(key);
+      return Error::Success;
+    }
+  }
+
+  return Error::Error;
+}
+
+size_t SdoService::getQueuedTransactionCount()
+{
+  size_t n = 0;
+  for (auto &&[key, queue] : pendingTransactions) {
+    (void)key;  // Silence unused variable warning
+    n += queue.size();
+  }
+  return n;
+}
+
 void SdoService::transactionTimeout(unsigned generation, uint16_t key)
 {
   if (auto i = activeTransactions.find(key); i != activeTransactions.end()) {
@@ -126,6 +255,13 @@ void SdoService::transactionTimeout(unsigned generation, uint16_t key)
     // Was the timer invalidated before the callback fired?
     if (state.generation != generation) return;
 
+    if (state.protocol->resumeAfterTimeout()) {
+      state.generation = newGeneration();
+      co.sys.deleteTimer(state.timer);
+      state.timer = co.sys.scheduleDelayed(serverSegmentTimeoutMs, std::bind(&SdoService::transactionTimeout, this, state.generation, key));
+      return;
+    }
+
     state.protocol->finish(Error::Timeout, true);
     removeTransaction(key);
   }
@@ -142,10 +278,28 @@ void SdoService::removeTransaction(uint16_t key)
       LogInfo("*** Removing a transaction that wasn't finished?? ***");
     }
 
+    TransferStats t = {
+        .idx        = state.protocol->getIdx(),
+        .subIdx     = state.protocol->getSubIdx(),
+        .client     = state.client,
+        .result     = finished ? err : Error::InternalError,
+        .bytes      = state.protocol->bytesTransferred(),
+        .durationNs = state.lastRxNs - state.firstRxNs,
+        .block      = state.protocol->getStats(),
+    };
+
+    stats.transfers++;
+    if (t.result != Error::Success) stats.failed++;
+    stats.resentSegments += t.block.resentSegments;
+    if (stats.recent.size() == MaxRecentTransfers) stats.recent.pop_front();
+    stats.recent.push_back(t);
+
+    bool client = state.client;
     co.sys.deleteTimer(state.timer);
     activeTransactions.erase(i);
 
     if (cb) cb(finished ? err : Error::InternalError);
+    if (client) startNextClientTransaction(key);
   }
 }
 
@@ -157,6 +311,11 @@ Error SdoService::processMsg(const Msg &msg)
   }
 
   if (auto &&c = activeTransactions.find(msg.id); c != activeTransactions.end()) {
+    if (msg.timestamp) {
+      if (!c->second.firstRxNs) c->second.firstRxNs = msg.timestamp;
+      c->second.lastRxNs = msg.timestamp;
+    }
+
     if (c->second.protocol->processMsg(msg)) {
       removeTransaction(msg.id);
     }
@@ -178,6 +337,8 @@ Error SdoService::processMsg(const Msg &msg)
           .timer      = co.sys.scheduleDelayed(serverSegmentTimeoutMs, std::bind(&SdoService::transactionTimeout, this, gen, msg.id)),
           .generation = gen,
           .cb         = nullptr,
+          .firstRxNs  = msg.timestamp,
+          .lastRxNs   = msg.timestamp,
       };
       auto [i, success] = activeTransactions.emplace(msg.id, state);
       (void)i;  // Silence unused variable warning
@@ -0,0 +1,132 @@
+#include "canfetti/services/Sync.h"
+#include <algorithm>
+
+using namespace canfetti;
+
+SyncService::SyncService(Node &co) : Service(co)
+{
+}
+
+canfetti::Error SyncService::init()
+{
+  if (Error e = Service::init(); e != Error::Success) {
+    return e;
+  }
+
+  auto producerChanged = [this](uint16_t, uint8_t) { updateProducer(); };
+
+  // COB-ID SYNC message
+  if (Error e = co.od.insert(0x1005, 0, Access::RW, _u32(DefaultCobid), producerChanged); e != Error::Success) {
+    return e;
+  }
+
+  // Communication cycle period (us)
+  if (Error e = co.od.insert(0x1006, 0, Access::RW, _u32(0), producerChanged); e != Error::Success) {
+    return e;
+  }
+
+  // Synchronous counter overflow value
+  return co.od.insert(0x1019, 0, Access::RW, _u8(0), [this](uint16_t, uint8_t) { counter = 0; });
+}
+
+canfetti::Error SyncService::setProducer(uint16_t periodMs, uint8_t counterOverflow)
+{
+  uint32_t cobid;
+
+  // 1 and 241..255 are reserved
+  if (counterOverflow == 1 || counterOverflow > 240) {
+    return Error::ValueRange;
+  }
+
+  if (Error e = co.od.get(0x1005, 0, cobid); e != Error::Success) {
+    return e;
+  }
+
+  if (Error e = co.od.set(0x1019, 0, counterOverflow); e != Error::Success) {
+    return e;
+  }
+
+  if (Error e = co.od.set(0x1006, 0, _u32(periodMs * 1000)); e != Error::Success) {
+    return e;
+  }
+
+  cobid = periodMs ? cobid | ProducerBit : cobid & ~ProducerBit;
+  return co.od.set(0x1005, 0, cobid);
+}
+
+void SyncService::updateProducer()
+{
+  uint32_t cobid, periodUs;
+
+  co.sys.deleteTimer(producerTimer);
+  producerTimer = System::InvalidTimer;
+
+  if (co.od.get(0x1005, 0, cobid) != Error::Success || co.od.get(0x1006, 0, periodUs) != Error::Success) {
+    return;
+  }
+
+  if (uint32_t busCobid = cobid & ((1 << 29) - 1); busCobid != syncCobid) {
+    syncCobid = busCobid;
+    co.rxFiltersChanged();
+  }
+
+  if ((cobid & ProducerBit) && periodUs) {
+    // Timers have ms resolution
+    uint32_t periodMs = std::max<uint32_t>(periodUs / 1000, 1);
+    LogInfo("Producing SYNC 0x%x every %d ms", syncCobid, periodMs);
+    producerTimer = co.sys.schedulePeriodic(periodMs, std::bind(&SyncService::sendSync, this));
+  }
+}
+
+void SyncService::addRxFilters(std::vector<CanDevice::RxFilter> &filters)
+{
+  filters.push_back(CanDevice::RxFilter::exact(syncCobid));
+}
+
+canfetti::Error SyncService::addSyncCallback(SyncCb cb)
+{
+  for (auto &&x : syncCbs) {
+    if (!x) {
+      x = cb;
+      return Error::Success;
+    }
+  }
+
+  return Error::OutOfMemory;
+}
+
+void SyncService::notifySyncCbs(uint8_t counter)
+{
+  for (auto &&x : syncCbs) {
+    if (x) x(counter);
+  }
+}
+
+canfetti::Error SyncService::sendSync()
+{
+  uint8_t overflow = 0;
+  uint8_t payload  = 0;
+  co.od.get(0x1019, 0, overflow);
+
+  if (overflow) {
+    counter = counter % overflow + 1;
+    payload = counter;
+  }
+
+  canfetti::Msg msg = {.id = syncCobid, .rtr = false, .len = static_cast<uint8_t>(overflow ? 1 : 0), .data = &payload};
+  Error e           = co.bus.write(msg, true);
+
+  // Our own SYNC isn't received, so the local node is synchronized here
+  notifySyncCbs(payload);
+  return e;
+}
+
+canfetti::Error SyncService::processMsg(const canfetti::Msg &msg)
+{
+  if (msg.rtr) {
+    return Error::Success;
+  }
+
+  notifySyncCbs(msg.len ? msg.data[0] : 0);
+  return Error::Success;
+}
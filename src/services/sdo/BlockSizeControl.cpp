@@ -0,0 +1,53 @@
+#include "canfetti/services/sdo/BlockSizeControl.h"
+#include <cmath>
+
+using namespace canfetti::Sdo;
+
+static inline float average(float avg, float sample) { return avg ? avg + (sample - avg) / 8 : sample; }
+
+void BlockSizeControl::segment(uint64_t timestampNs)
+{
+  if (!timestampNs) return;
+
+  if (lastNs && timestampNs > lastNs) {
+    float delta = timestampNs - lastNs;
+
+    // Last segment of one sub-block to the first of the next spans the ack
+    // round trip, plus a segment
+    if (subBlockStarting) {
+      roundTripNs = average(roundTripNs, delta);
+    }
+    else {
+      segmentNs = average(segmentNs, delta);
+    }
+  }
+
+  lastNs           = timestampNs;
+  subBlockStarting = false;
+}
+
+uint8_t BlockSizeControl::subBlockDone(uint8_t segments, bool lost)
+{
+  subBlockStarting = true;
+  lost             = lost || timeouts;
+  timeouts         = false;
+
+  lossEvents   = lossEvents * Decay + lost;
+  segmentsSeen = segmentsSeen * Decay + segments;
+
+  if (lossEvents < 0.01f || segmentsSeen < 1) {
+    blksize = MaxBlockSize;
+    return blksize;
+  }
+
+  float r = DefaultRoundTrip;
+  if (segmentNs && roundTripNs) {
+    r = std::fmax(roundTripNs / segmentNs - 1, 0.5f);
+  }
+
+  float p = lossEvents / segmentsSeen;
+  float n = std::sqrt(2 * r / p);
+
+  blksize = n < MinBlockSize ? MinBlockSize : n > MaxBlockSize ? MaxBlockSize : static_cast<uint8_t>(n);
+  return blksize;
+}
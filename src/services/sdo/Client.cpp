@@ -9,14 +9,18 @@ static inline bool isUploadSegResponse(const canfetti::Msg &m) { return (m.data[
 static inline bool isDownloadResponse(const canfetti::Msg &m) { return (m.data[0] >> 5) == 3; }
 static inline bool isDownloadSegResponse(const canfetti::Msg &m) { return (m.data[0] >> 5) == 1; }
 static inline bool isDownloadBlockResponse(const canfetti::Msg &m) { return (m.data[0] >> 5) == 5; }
+static inline bool isUploadBlockResponse(const canfetti::Msg &m) { return (m.data[0] >> 5) == 6; }
 
 std::tuple<canfetti::Error, std::shared_ptr<Client>> Client::initiateRead(uint16_t idx, uint8_t subIdx,
                                                                           OdVariant &data, uint16_t txCobid, Node &co)
 {
-  LogDebug("Initiating read to cobid %x: %x[%d]", txCobid, idx, subIdx);
-
   OdProxy proxy(idx, subIdx, data);
 
+  // Block mode pays off for large objects, and for resizable ones whose remote
+  // size isn't known yet. The protocol switch threshold lets the server fall
+  // back to a normal upload if the object turns out to be small.
+  bool block = proxy.remaining() >= BlockModeThreshold || proxy.resizable();
+
   uint8_t payload[8] = {
       static_cast<uint8_t>(2 << 5),
       static_cast<uint8_t>(proxy.idx & 0xFF),
@@ -24,8 +28,22 @@ std::tuple<canfetti::Error, std::shared_ptr<Client>> Client::initiateRead(uint16
       proxy.subIdx,
       0, 0, 0, 0};
 
+  if (block) {
+    LogDebug("Initiating block read to cobid %x: %x[%d]", txCobid, idx, subIdx);
+    payload[0] = (5 << 5) | (1 << 2);  // Crc supported, initiate upload request
+    payload[4] = BlockSizeControl::MaxBlockSize;
+    payload[5] = BlockModeThreshold - 1;
+  }
+  else {
+    LogDebug("Initiating read to cobid %x: %x[%d]", txCobid, idx, subIdx);
+  }
+
   auto err = co.bus.write(txCobid, payload);
   auto ptr = err == Error::Success ? std::make_shared<Client>(txCobid, std::move(proxy), co) : nullptr;
+  if (ptr && block) {
+    ptr->blockUpload = BlockUpload::Initiated;
+    ptr->blockSize   = BlockSizeControl::MaxBlockSize;
+  }
   return std::make_tuple(err, ptr);
 }
 
@@ -66,7 +84,7 @@ std::tuple<canfetti::Error, std::shared_ptr<Client>> Client::initiateWrite(uint1
     LogDebug("Initiating block write to cobid %x: %x[%d]", txCobid, proxy.idx, proxy.subIdx);
 
     uint8_t payload[8] = {
-        6 << 5 | 1 << 1,  // Size indicated, no crc, initiate download request
+        6 << 5 | 1 << 2 | 1 << 1,  // Crc supported, size indicated, initiate download request
         static_cast<uint8_t>(proxy.idx & 0xFF),
         static_cast<uint8_t>(proxy.idx >> 8),
         proxy.subIdx};
@@ -92,9 +110,25 @@ void Client::blockSegmentWrite(uint8_t seqno)
   if (canfetti::Error e = proxy.copyInto(&payload[1], lastBlockBytes); e != canfetti::Error::Success) {
     LogInfo("Error writing data: %x", (unsigned)e);
     finish(e);
+    return;
   }
 
-  co.bus.write(txCobid, payload);
+  if (useCrc) crc.update(&payload[1], lastBlockBytes);
+
+  segmentsSent    = seqno;
+  lastSegmentSent = complete;
+  sendSegment(payload);
+}
+
+void Client::sendSubBlock()
+{
+  segmentsSent = 0;
+  startSubBlock();
+  noteSubBlock(blockSize);
+
+  for (uint8_t i = 1; i <= blockSize && !lastSegmentSent && !finished; ++i) {
+    blockSegmentWrite(i);
+  }
 }
 
 void Client::segmentWrite()
@@ -140,8 +174,203 @@ canfetti::Error Client::checkSize(uint32_t msgLen, bool tooBigCheck)
   return canfetti::Error::Success;
 }
 
+void Client::sendBlockAck(uint8_t ackseq, const canfetti::Msg &end)
+{
+  noteSubBlock(blockSize);
+  if (highestSeqNo > ackseq) stats.resentSegments += highestSeqNo - ackseq;
+
+  blockSize = blockSizeControl.subBlockDone(highestSeqNo, gap);
+
+  uint8_t payload[8] = {
+      static_cast<uint8_t>((5 << 5) | 2),
+      ackseq,
+      blockSize,
+  };
+
+  expectedSeqNo = 1;
+  highestSeqNo  = 0;
+  gap           = false;
+  sendSubBlockAck(payload, end);
+}
+
+bool Client::resumeAfterTimeout()
+{
+  if (timeoutRetries >= MaxTimeoutRetries) return false;
+
+  // Either the end of the sub-block or its ack went missing. The server acks
+  // the sub-block's last segment again in both cases.
+  if (blockDownload == BlockDownload::SubBlock) {
+    timeoutRetries++;
+    resendLastSegment();
+    return true;
+  }
+
+  // Likewise the server sends its last segment again for us to ack
+  if (blockUpload == BlockUpload::SubBlock || blockUpload == BlockUpload::End) {
+    LogDebug("Block upload of %x[%d] timed out, waiting on the server", proxy.idx, proxy.subIdx);
+    timeoutRetries++;
+    blockSizeControl.timedOut();
+    return true;
+  }
+
+  return false;
+}
+
+bool Client::processBlockUpload(const canfetti::Msg &msg)
+{
+  if (blockUpload == BlockUpload::Initiated && isAbortMsg(msg)) {
+    uint32_t abortCode;
+    memcpy(&abortCode, &msg.data[4], 4);
+
+    if (abortCode == static_cast<uint32_t>(canfetti::Error::InvalidCmd)) {
+      LogDebug("Block upload not supported on %x[%d], retrying segmented", proxy.idx, proxy.subIdx);
+
+      uint8_t payload[8] = {
+          static_cast<uint8_t>(2 << 5),
+          static_cast<uint8_t>(proxy.idx & 0xFF),
+          static_cast<uint8_t>(proxy.idx >> 8),
+          proxy.subIdx,
+          0, 0, 0, 0};
+
+      blockUpload = BlockUpload::None;
+      co.bus.write(txCobid, payload);
+      return false;
+    }
+  }
+
+  // The server never got our last ack and sent the segment it was for again.
+  // With c set that may look like an abort too.
+  if (resendLostAck(msg)) return false;
+
+  // Within a sub-block, segments with c set and seqNo up to 31 have the
+  // abort's command specifier, so they're checked for aborts separately
+  if (blockUpload != BlockUpload::SubBlock && isAbortMsg(msg)) {
+    return Protocol::abortCheck(msg);
+  }
+
+  switch (blockUpload) {
+    case BlockUpload::None:
+      break;
+
+    case BlockUpload::Initiated: {
+      if (isUploadResponse(msg)) {  // Server switched to a normal upload
+        blockUpload = BlockUpload::None;
+        return processMsg(msg);
+      }
+
+      if (!isUploadBlockResponse(msg) || (msg.data[0] & 1)) break;
+
+      useCrc = msg.data[0] & (1 << 2);
+
+      if (msg.data[0] & 0b10) {  // Size indicated, proactive resize
+        uint32_t msgLen;
+        memcpy(&msgLen, &msg.data[4], sizeof(msgLen));
+
+        if (canfetti::Error e = checkSize(msgLen, true); e != canfetti::Error::Success) {
+          finish(e);
+          return true;
+        }
+      }
+
+      uint8_t payload[8] = {static_cast<uint8_t>((5 << 5) | 3)};  // Start upload
+      co.bus.write(txCobid, payload);
+
+      blockUpload   = BlockUpload::SubBlock;
+      expectedSeqNo = 1;
+      return false;
+    }
+
+    case BlockUpload::SubBlock: {
+      // seqNo 0, which no segment uses
+      if (isSubBlockAbort(msg)) return Protocol::abortCheck(msg);
+
+      bool c         = msg.data[0] >> 7;
+      uint8_t seqNo  = msg.data[0] & 0x7f;
+      bool lastInSub = c || seqNo == blockSize;
+
+      blockSizeControl.segment(msg.timestamp);
+      if (seqNo > highestSeqNo) highestSeqNo = seqNo;
+
+      if (seqNo != expectedSeqNo) {
+        if (!gap) LogInfo("Out of sequence frame (%x, %x)", expectedSeqNo, seqNo);
+        gap = true;
+
+        // Once the sub-block is over, have the rest of it sent again
+        if (lastInSub) sendBlockAck(expectedSeqNo - 1, msg);
+        return false;
+      }
+
+      timeoutRetries = 0;
+
+      // The last segment is held until the end message says how much of it is data
+      if (c) {
+        memcpy(lastSegmentData, &msg.data[1], 7);
+      }
+      else if (canfetti::Error e = checkSize(7, false); e != canfetti::Error::Success) {
+        finish(e);
+        return true;
+      }
+      else if (canfetti::Error e = proxy.copyFrom(&msg.data[1], 7); e != canfetti::Error::Success) {
+        LogInfo("Error reading data: %x", (unsigned)e);
+        finish(e);
+        return true;
+      }
+      else if (useCrc) {
+        crc.update(&msg.data[1], 7);
+      }
+
+      expectedSeqNo = seqNo + 1;
+
+      if (lastInSub) {
+        sendBlockAck(seqNo, msg);
+        if (c) blockUpload = BlockUpload::End;
+      }
+
+      return false;
+    }
+
+    case BlockUpload::End: {
+      if (!isUploadBlockResponse(msg) || !(msg.data[0] & 1)) break;
+
+      uint8_t n       = (msg.data[0] >> 2) & 0b111;
+      uint8_t lastLen = 7 - n;
+
+      if (canfetti::Error e = checkSize(lastLen, false); e != canfetti::Error::Success) {
+        finish(e);
+        return true;
+      }
+      else if (canfetti::Error e = proxy.copyFrom(lastSegmentData, lastLen); e != canfetti::Error::Success) {
+        LogInfo("Error reading data: %x", (unsigned)e);
+        finish(e);
+        return true;
+      }
+
+      if (useCrc) {
+        crc.update(lastSegmentData, lastLen);
+        uint16_t expected = msg.data[1] | (msg.data[2] << 8);
+        if (crc.value() != expected) {
+          LogInfo("Block upload crc mismatch on %x[%d] (%x, %x)", proxy.idx, proxy.subIdx, expected, crc.value());
+          finish(canfetti::Error::CrcError);
+          return true;
+        }
+      }
+
+      uint8_t payload[8] = {static_cast<uint8_t>((5 << 5) | 1)};  // End response
+      co.bus.write(txCobid, payload);
+      finish(canfetti::Error::Success, false);
+      return true;
+    }
+  }
+
+  LogInfo("Unhandled SDO protocol: %x", msg.data[0]);
+  finish(canfetti::Error::InvalidCmd);
+  return true;
+}
+
 bool Client::processMsg(const canfetti::Msg &msg)
 {
+  if (blockUpload != BlockUpload::None) return processBlockUpload(msg);
+
   if (Protocol::abortCheck(msg)) return true;
 
   if (isUploadResponse(msg)) {  // Read
@@ -204,25 +433,67 @@ bool Client::processMsg(const canfetti::Msg &msg)
   }
   else if (isDownloadBlockResponse(msg)) {
     uint8_t ss = msg.data[0] & 3;
-    if (!proxy.remaining()) {
-      if (ss == 2) {
-        uint8_t payload[8] = {
-            static_cast<uint8_t>((6 << 5) | ((7 - lastBlockBytes) << 2)),
-            0, 0, 0, 0, 0, 0, 0};
-        co.bus.write(txCobid, payload);
-        return false;
-      }
-      else if (ss == 1) {
-        finish(canfetti::Error::Success, false);
+
+    if (ss == 0) {  // Initiate response
+      useCrc        = msg.data[0] & (1 << 2);
+      blockDownload = BlockDownload::SubBlock;
+      blockSize     = msg.data[4];
+
+      if (blockSize < 1 || blockSize > BlockSizeControl::MaxBlockSize) {
+        finish(canfetti::Error::InvalidBlkSize);
         return true;
       }
+
+      sendSubBlock();
+      return finished;
     }
-    else {
-      for (uint32_t i = 1; i <= 127 && proxy.remaining(); ++i) {
-        blockSegmentWrite(i);
+    else if (ss == 2) {  // Block ack
+      uint8_t ackseq  = msg.data[1];
+      uint8_t newSize = msg.data[2];
+      timeoutRetries  = 0;
+
+      if (newSize < 1 || newSize > BlockSizeControl::MaxBlockSize) {
+        finish(canfetti::Error::InvalidBlkSize);
+        return true;
+      }
+
+      if (ackseq > segmentsSent) {
+        LogInfo("Bad block ack (%x, %x)", segmentsSent, ackseq);
+        finish(canfetti::Error::InvalidSeqNum);
+        return true;
+      }
+
+      if (ackseq < segmentsSent) {  // Resend what follows the last good segment
+        LogDebug("Server lost segments %d..%d of %x[%d]", ackseq + 1, segmentsSent, proxy.idx, proxy.subIdx);
+        if (canfetti::Error e = rewindSubBlock(ackseq); e != canfetti::Error::Success) {
+          finish(e);
+          return true;
+        }
+        stats.resentSegments += segmentsSent - ackseq;
+        lastSegmentSent = false;
+      }
+
+      blockSize = newSize;
+
+      if (!lastSegmentSent) {
+        sendSubBlock();
+        return finished;
       }
+
+      uint16_t c         = crc.value();
+      uint8_t payload[8] = {
+          static_cast<uint8_t>((6 << 5) | ((7 - lastBlockBytes) << 2) | 1),
+          static_cast<uint8_t>(c & 0xFF),
+          static_cast<uint8_t>(c >> 8),
+          0, 0, 0, 0, 0};
+      co.bus.write(txCobid, payload);
+      blockDownload = BlockDownload::End;
       return false;
     }
+    else if (ss == 1) {  // End response
+      finish(canfetti::Error::Success, false);
+      return true;
+    }
   }
 
   LogInfo("Unhandled SDO protocol: %x", msg.data[0]);
@@ -67,6 +67,73 @@ bool Protocol::abortCheck(const Msg &msg)
   return false;
 }
 
+void Protocol::startSubBlock()
+{
+  subBlockStart = proxy.offset();
+  subBlockCrc   = crc.value();
+}
+
+Error Protocol::rewindSubBlock(uint8_t ackseq)
+{
+  if (!useCrc) return proxy.seek(subBlockStart + 7 * ackseq);
+
+  if (Error err = proxy.seek(subBlockStart); err != Error::Success) return err;
+
+  // Only whole segments are ever acknowledged short of the end, so redo the
+  // crc from the start of the sub-block over those
+  crc = Crc16(subBlockCrc);
+  uint8_t segment[7];
+  for (uint8_t i = 0; i < ackseq; ++i) {
+    if (Error err = proxy.copyInto(segment, sizeof(segment)); err != Error::Success) return err;
+    crc.update(segment, sizeof(segment));
+  }
+
+  return Error::Success;
+}
+
+void Protocol::noteSubBlock(uint8_t blksize)
+{
+  if (!stats.subBlocks || blksize < stats.minBlockSize) stats.minBlockSize = blksize;
+  if (blksize > stats.maxBlockSize) stats.maxBlockSize = blksize;
+  stats.lastBlockSize = blksize;
+  stats.subBlocks++;
+}
+
+void Protocol::sendSegment(const uint8_t (&payload)[8])
+{
+  memcpy(lastSegment, payload, sizeof(lastSegment));
+  co.bus.write(txCobid, lastSegment);
+}
+
+void Protocol::resendLastSegment()
+{
+  LogDebug("No block ack on %x[%d], resending segment %d", proxy.idx, proxy.subIdx, lastSegment[0] & 0x7f);
+  stats.resentSegments++;
+  co.bus.write(txCobid, lastSegment);
+}
+
+void Protocol::sendSubBlockAck(const uint8_t (&payload)[8], const Msg &end)
+{
+  memcpy(lastAck, payload, sizeof(lastAck));
+  memcpy(ackedSegment, end.data, sizeof(ackedSegment));
+  awaitingSubBlock = true;
+  co.bus.write(txCobid, lastAck);
+}
+
+bool Protocol::resendLostAck(const Msg &msg)
+{
+  // Sub-blocks are at least 2 segments, so the first of the next one is never
+  // taken for a repeat of this one's last. Only the next one's lead lost along
+  // with matching data can be, which a crc then catches.
+  bool resent = awaitingSubBlock && !memcmp(msg.data, ackedSegment, sizeof(ackedSegment));
+  awaitingSubBlock &= resent;
+  if (!resent) return false;
+
+  LogDebug("Block ack lost on %x[%d], resending it for segment %d", proxy.idx, proxy.subIdx, ackedSegment[0] & 0x7f);
+  co.bus.write(txCobid, lastAck);
+  return true;
+}
+
 uint32_t Protocol::getInitiateDataLen(const Msg &m)
 {
   uint8_t es = m.data[0] & 0b11;
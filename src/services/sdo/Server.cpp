@@ -1,6 +1,7 @@
 #include "canfetti/services/sdo/Server.h"
 #include <cstring>
 #include "canfetti/services/sdo/ServerBlockMode.h"
+#include "canfetti/services/sdo/ServerBlockUpload.h"
 
 using namespace canfetti;
 using namespace canfetti::Sdo;
@@ -104,10 +105,46 @@ std::shared_ptr<Server> Server::processInitiate(const Msg &msg, uint16_t txCobid
     }
   }
   else if (ServerBlockMode::isDownloadBlockMsg(msg)) {
-    uint32_t size     = *(uint32_t *)&msg.data[4];
+    uint32_t size      = *(uint32_t *)&msg.data[4];
+    auto [err, proxy]  = co.od.makeProxy(idx, subIdx);
+    bool sizeIndicated = msg.data[0] & (1 << 1);
+
+    if (err != canfetti::Error::Success) {
+      LogInfo("Bad SDO block write for cobid %x: %x[%d], err %x", msg.id, idx, subIdx, (unsigned)err);
+      abort(err, txCobid, idx, subIdx, co.bus);
+    }
+    else if (sizeIndicated && proxy.remaining() != size && !proxy.resize(size) && proxy.remaining() < size) {
+      LogDebug("Buf too small for block write");
+      abort(Error::ParamLength, txCobid, idx, subIdx, co.bus);
+    }
+    else {
+      bool crc    = msg.data[0] & (1 << 2);
+      auto server = std::make_shared<ServerBlockMode>(txCobid, std::move(proxy), co, size, crc);
+      server->sendInitiateResponse();
+      return server;
+    }
+  }
+
+  else if (ServerBlockUpload::isUploadBlockInitiate(msg)) {  // block read from us
     auto [err, proxy] = co.od.makeProxy(idx, subIdx);
-    if (err == canfetti::Error::Success) {
-      auto server = std::make_shared<ServerBlockMode>(txCobid, std::move(proxy), co, size);
+    uint8_t blksize   = msg.data[4];
+    uint8_t pst       = msg.data[5];
+
+    if (err != Error::Success) {
+      LogInfo("Bad SDO block read for cobid %x: %x[%d], err %x", msg.id, idx, subIdx, (unsigned)err);
+      abort(err, txCobid, idx, subIdx, co.bus);
+    }
+    else if (blksize < 1 || blksize > 127) {
+      abort(Error::InvalidBlkSize, txCobid, idx, subIdx, co.bus);
+    }
+    else if (pst && proxy.remaining() <= pst) {  // Client allows switching to a normal upload
+      if (!sendUploadInitRsp(txCobid, idx, subIdx, proxy, co.bus)) {
+        return std::make_shared<Server>(txCobid, std::move(proxy), co);
+      }
+    }
+    else {
+      bool crc    = msg.data[0] & (1 << 2);
+      auto server = std::make_shared<ServerBlockUpload>(txCobid, std::move(proxy), co, blksize, crc);
       server->sendInitiateResponse();
       return server;
     }
@@ -11,89 +11,78 @@ using namespace canfetti::Sdo;
 ServerBlockMode::ServerBlockMode(uint16_t txCobid,
                                  canfetti::OdProxy proxy,
                                  Node &co,
-                                 uint32_t totalsize) : Server(txCobid, std::move(proxy), co)
+                                 uint32_t totalsize,
+                                 bool crc) : Server(txCobid, std::move(proxy), co)
 {
+  useCrc = crc;
 }
 
 void ServerBlockMode::sendInitiateResponse()
 {
   uint8_t payload[8] = {
-      static_cast<uint8_t>(5 << 5),
+      static_cast<uint8_t>((5 << 5) | (1 << 2)),  // Crc supported
       static_cast<uint8_t>(proxy.idx & 0xFF),
       static_cast<uint8_t>(proxy.idx >> 8),
       proxy.subIdx,
-      NumSubBlockSegments,
+      blksize,
   };
 
-  expectedSeqNo = 1;
   co.bus.write(txCobid, payload);
 }
 
 bool ServerBlockMode::processMsg(const canfetti::Msg &msg)
 {
-  switch (state) {
-    case State::Start: {
-      uint8_t seqNo = msg.data[0] & 0x7f;
-      if (expectedSeqNo != seqNo) {
-        LogInfo("Out of sequence frame (%x, %x)", expectedSeqNo, seqNo);
-        finish(Error::DataXfer, true);
-        state = State::End;
-        return false;
-      }
-
-      memcpy(lastSegmentData, &msg.data[1], 7);
-      state         = State::SubBlock;
-      expectedSeqNo = 2;
-      return false;
-    }
+  // The client never got our last ack and sent the segment it was for again.
+  // With c set that may look like an abort too.
+  if (resendLostAck(msg)) return false;
 
+  switch (state) {
     case State::SubBlock: {
-      uint8_t c     = msg.data[0] >> 7;
-      uint8_t seqNo = msg.data[0] & 0x7f;
+      if (isSubBlockAbort(msg)) return abortCheck(msg);
 
-      if (Error err = proxy.copyFrom(lastSegmentData, 7); err != Error::Success) {
-        finish(err, true);
-        state = State::End;
-        return false;
-      }
+      uint8_t c      = msg.data[0] >> 7;
+      uint8_t seqNo  = msg.data[0] & 0x7f;
+      bool lastInSub = c || seqNo == blksize;
+
+      blockSize.segment(msg.timestamp);
+      if (seqNo > highestSeqNo) highestSeqNo = seqNo;
 
       if (expectedSeqNo != seqNo) {
-        LogInfo("Out of sequence frame (%x, %x)", expectedSeqNo, seqNo);
-        finish(Error::DataXfer, true);
-        // TODO request a resend of the block by sending the last good seqno
-        // uint8_t payload[8] = {
-        //     static_cast<uint8_t>((5 << 5) | 2),
-        //     expectedSeqNo - 1,
-        //     NumSubBlockSegments,
-        // };
-        // co.bus.write(txCobid, payload);
-        state = State::End;
+        if (!gap) LogInfo("Out of sequence frame (%x, %x)", expectedSeqNo, seqNo);
+        gap = true;
+
+        // Once the sub-block is over, have the rest of it sent again
+        if (lastInSub) sendAck(expectedSeqNo - 1, msg);
         return false;
       }
 
-      memcpy(lastSegmentData, &msg.data[1], 7);
-
-      expectedSeqNo = seqNo + 1;
+      timeoutRetries = 0;
 
+      // The last segment is held until the end message says how much of it is data
       if (c) {
-        state = State::End;
+        memcpy(lastSegmentData, &msg.data[1], 7);
+      }
+      else if (Error err = proxy.copyFrom(&msg.data[1], 7); err != Error::Success) {
+        finish(err, true);
+        return true;
+      }
+      else if (useCrc) {
+        crc.update(&msg.data[1], 7);
       }
 
-      if (seqNo == NumSubBlockSegments || c) {
-        uint8_t payload[8] = {
-            static_cast<uint8_t>((5 << 5) | 2),
-            seqNo,
-            NumSubBlockSegments,
-        };
+      expectedSeqNo = seqNo + 1;
 
-        expectedSeqNo = 1;
-        co.bus.write(txCobid, payload);
+      if (lastInSub) {
+        sendAck(seqNo, msg);
+        if (c) state = State::End;
       }
 
       return false;
     }
 
     case State::End: {
+      if (abortCheck(msg)) return true;
+
       if (!isDownloadBlockMsg(msg)) {
         // LogInfo("Junk %x", msg.data[0]);
         return false;
@@ -102,22 +91,63 @@ bool ServerBlockMode::processMsg(const canfetti::Msg &msg)
       uint8_t n       = (msg.data[0] >> 2) & 0b111;
       uint8_t lastLen = 7 - n;
 
-      if (!finished) {
-        if (Error err = proxy.copyFrom(lastSegmentData, lastLen); err != Error::Success) {
-          finish(err, true);
-        }
+      if (Error err = proxy.copyFrom(lastSegmentData, lastLen); err != Error::Success) {
+        finish(err, true);
+        return true;
       }
 
-      if (!finished) {
-        proxy.senderIsFinished();
-        uint8_t payload[8] = {static_cast<uint8_t>((5 << 5) | 1)};
-        co.bus.write(txCobid, payload);
-        finish(Error::Success);
+      if (useCrc) {
+        crc.update(lastSegmentData, lastLen);
+        uint16_t expected = msg.data[1] | (msg.data[2] << 8);
+        if (crc.value() != expected) {
+          LogInfo("Block download crc mismatch on %x[%d] (%x, %x)", proxy.idx, proxy.subIdx, expected, crc.value());
+          finish(Error::CrcError, true);
+          return true;
+        }
       }
 
+      proxy.senderIsFinished();
+      uint8_t payload[8] = {static_cast<uint8_t>((5 << 5) | 1)};
+      co.bus.write(txCobid, payload);
+      finish(Error::Success);
       return true;
     }
   }
 
   return true;
 }
+
+bool ServerBlockMode::resumeAfterTimeout()
+{
+  // Whether the end of a sub-block or its ack went missing, the client sends
+  // the sub-block's last segment again, and that prompts the ack
+  if (timeoutRetries >= MaxTimeoutRetries) return false;
+
+  LogDebug("Block download of %x[%d] timed out, waiting on the client", proxy.idx, proxy.subIdx);
+  timeoutRetries++;
+  blockSize.timedOut();
+  return true;
+}
+
+//******************************************************************************
+// Private
+//******************************************************************************
+
+void ServerBlockMode::sendAck(uint8_t ackseq, const canfetti::Msg &end)
+{
+  noteSubBlock(blksize);
+  if (highestSeqNo > ackseq) stats.resentSegments += highestSeqNo - ackseq;
+
+  blksize = blockSize.subBlockDone(highestSeqNo, gap);
+
+  uint8_t payload[8] = {
+      static_cast<uint8_t>((5 << 5) | 2),
+      ackseq,
+      blksize,
+  };
+
+  expectedSeqNo = 1;
+  highestSeqNo  = 0;
+  gap           = false;
+  sendSubBlockAck(payload, end);
+}
@@ -0,0 +1,153 @@
+#include "canfetti/services/sdo/ServerBlockUpload.h"
+#include <cstring>
+
+using namespace canfetti;
+using namespace canfetti::Sdo;
+
+//******************************************************************************
+// Public API
+//******************************************************************************
+
+ServerBlockUpload::ServerBlockUpload(uint16_t txCobid,
+                                     canfetti::OdProxy proxy,
+                                     Node &co,
+                                     uint8_t blksize,
+                                     bool crc) : Server(txCobid, std::move(proxy), co), blksize(blksize)
+{
+  useCrc = crc;
+}
+
+void ServerBlockUpload::sendInitiateResponse()
+{
+  uint8_t payload[8] = {
+      static_cast<uint8_t>((6 << 5) | (1 << 2) | (1 << 1)),  // Crc supported, size indicated
+      static_cast<uint8_t>(proxy.idx & 0xFF),
+      static_cast<uint8_t>(proxy.idx >> 8),
+      proxy.subIdx,
+  };
+
+  uint32_t l = proxy.remaining();
+  memcpy(&payload[4], &l, sizeof(l));
+
+  co.bus.write(txCobid, payload);
+}
+
+bool ServerBlockUpload::processMsg(const canfetti::Msg &msg)
+{
+  if (Protocol::abortCheck(msg)) return true;
+
+  uint8_t cs = msg.data[0] & 0b11;
+
+  if (!isUploadBlockMsg(msg)) {
+    LogInfo("Unhandled SDO protocol: %x", msg.data[0]);
+    finish(Error::InvalidCmd, true);
+    return true;
+  }
+
+  switch (state) {
+    case State::Initiated: {
+      if (cs != 3) break;  // Start upload
+      sendSubBlock();
+      return finished;
+    }
+
+    case State::SubBlock: {
+      if (cs != 2) break;  // Block ack
+
+      uint8_t ackseq  = msg.data[1];
+      uint8_t newSize = msg.data[2];
+      timeoutRetries  = 0;
+
+      if (ackseq > segmentsSent) {
+        LogInfo("Bad block ack (%x, %x)", segmentsSent, ackseq);
+        finish(Error::InvalidSeqNum, true);
+        return true;
+      }
+
+      if (ackseq < segmentsSent) {  // Resend what follows the last good segment
+        LogDebug("Client lost segments %d..%d of %x[%d]", ackseq + 1, segmentsSent, proxy.idx, proxy.subIdx);
+        if (Error err = rewindSubBlock(ackseq); err != Error::Success) {
+          finish(err, true);
+          return true;
+        }
+        stats.resentSegments += segmentsSent - ackseq;
+        lastSent = false;
+      }
+
+      if (newSize < 1 || newSize > 127) {
+        finish(Error::InvalidBlkSize, true);
+        return true;
+      }
+
+      blksize = newSize;
+
+      if (lastSent) {
+        uint16_t c         = crc.value();
+        uint8_t payload[8] = {
+            static_cast<uint8_t>((6 << 5) | ((7 - lastLen) << 2) | 1),
+            static_cast<uint8_t>(c & 0xFF),
+            static_cast<uint8_t>(c >> 8),
+        };
+
+        co.bus.write(txCobid, payload);
+        state = State::End;
+        return false;
+      }
+
+      sendSubBlock();
+      return finished;
+    }
+
+    case State::End: {
+      if (cs != 1) break;  // End response
+      finish(Error::Success, false);
+      return true;
+    }
+  }
+
+  LogInfo("Unexpected block upload cmd %x in state %d", msg.data[0], state);
+  finish(Error::InvalidCmd, true);
+  return true;
+}
+
+bool ServerBlockUpload::resumeAfterTimeout()
+{
+  // Either the end of the sub-block or its ack went missing. The client acks
+  // the sub-block's last segment again in both cases.
+  if (state != State::SubBlock || timeoutRetries >= MaxTimeoutRetries) return false;
+  timeoutRetries++;
+  resendLastSegment();
+  return true;
+}
+
+//******************************************************************************
+// Private
+//******************************************************************************
+
+void ServerBlockUpload::sendSubBlock()
+{
+  segmentsSent = 0;
+  startSubBlock();
+  noteSubBlock(blksize);
+
+  for (uint8_t seqNo = 1; seqNo <= blksize && !lastSent; ++seqNo) {
+    uint8_t payload[8] = {0};
+    size_t remaining   = proxy.remaining();
+    lastSent           = remaining <= 7;
+    uint8_t toSend     = lastSent ? remaining : 7;
+
+    payload[0] = (lastSent << 7) | seqNo;
+
+    if (Error err = proxy.copyInto(&payload[1], toSend); err != Error::Success) {
+      finish(err, true);
+      return;
+    }
+
+    if (useCrc) crc.update(&payload[1], toSend);
+    if (lastSent) lastLen = toSend;
+    segmentsSent = seqNo;
+    sendSegment(payload);
+  }
+
+  state = State::SubBlock;
+}